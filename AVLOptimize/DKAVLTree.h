@@ -7,6 +7,14 @@
 
 #pragma once
 #include <new>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+#include <thread>
+#include "DKParallelSort.h"
+#include "DKFrozenTree.h"
+#include "DKTreeInstrumentation.h"
+#include "DKFixedSizeAllocator.h"
 //#include "../DKInclude.h"
 //#include "DKTypeTraits.h"
 //#include "DKFunction.h"
@@ -26,6 +34,10 @@
 // CMPK: value to key comparison function or function object. (searching only)
 // COPY: copy value function or function object.
 //   (used when Update() called, You can ignore this type if you don't call Update)
+// ALLOC: node allocator (Alloc, Free), each tree has own instance.
+//   tree-private pool with FreeAll makes Clear O(chunks). (see DKFixedSizePool)
+// INSTRUMENTATION: operation counter policy. (see DKTreeInstrumentation.h)
+//   DKTreeNoInstrumentation (default) is compiled away.
 //
 // Note:
 //  value's pointer will not be changed after balancing process.
@@ -58,7 +70,8 @@ namespace DKFoundation
 		typename ValueComparator = DKTreeComparison<Value, Value>,	// value comparison
 		typename KeyComparator = DKTreeComparison<Value, Key>,	// value, key comparison (lookup only)
 		typename CopyValue = DKTreeCopyValue<Value>,		// value copy
-		typename Allocator = DKMemoryDefaultAllocator		// memory allocator
+		typename Allocator = DKMemoryDefaultAllocator,		// memory allocator
+		typename Instrumentation = DKTreeNoInstrumentation	// operation counter
 	>
 	class DKAVLTree
 	{
@@ -82,17 +95,17 @@ namespace DKFoundation
 				return leftHeight > rightHeight ? (leftHeight + 1) : (rightHeight + 1);
 			}
 
-			Node* Duplicate(void) const
+			Node* Duplicate(Allocator& allocator) const
 			{
-				Node* node = new(Allocator::Alloc(sizeof(Node))) Node(value, NULL);
+				Node* node = new(allocator.Alloc(sizeof(Node))) Node(value, NULL);
 				if (left)
 				{
-					node->left = left->Duplicate();
+					node->left = left->Duplicate(allocator);
 					node->left->parent = node;
 				}
 				if (right)
 				{
-					node->right = right->Duplicate();
+					node->right = right->Duplicate(allocator);
 					node->right->parent = node;
 				}
 				node->leftHeight = leftHeight;
@@ -129,30 +142,112 @@ namespace DKFoundation
 			}
 		};
 
+		// bidirectional iterator, steps with parent-nodes. (no recursion)
+		//  iterator remains valid until it's node removed.
+		template <typename N, typename V> class IteratorType
+		{
+		public:
+			using iterator_category = std::bidirectional_iterator_tag;
+			using value_type = Value;
+			using difference_type = ptrdiff_t;
+			using pointer = V*;
+			using reference = V&;
+
+			IteratorType(void) : tree(NULL), node(NULL) {}
+			template <typename N2, typename V2> IteratorType(const IteratorType<N2, V2>& it)
+				: tree(it.tree), node(it.node)
+			{
+				static_assert(std::is_convertible<N2*, N*>::value, "iterator is not convertible.");
+			}
+
+			FORCEINLINE V& operator * (void) const		{ return node->value; }
+			FORCEINLINE V* operator -> (void) const		{ return &node->value; }
+
+			FORCEINLINE IteratorType& operator ++ (void)
+			{
+				node = Successor(node);
+				return *this;
+			}
+			FORCEINLINE IteratorType& operator -- (void)
+			{
+				if (node)
+					node = Predecessor(node);
+				else	// end() to last item.
+					node = tree->lastNode;
+				return *this;
+			}
+			IteratorType operator ++ (int)
+			{
+				IteratorType it(*this);
+				++(*this);
+				return it;
+			}
+			IteratorType operator -- (int)
+			{
+				IteratorType it(*this);
+				--(*this);
+				return it;
+			}
+			FORCEINLINE bool operator == (const IteratorType& it) const	{ return node == it.node; }
+			FORCEINLINE bool operator != (const IteratorType& it) const	{ return node != it.node; }
+
+		private:
+			template <typename, typename> friend class IteratorType;
+			friend class DKAVLTree;
+			IteratorType(const DKAVLTree* t, N* n) : tree(t), node(n) {}
+
+			const DKAVLTree* tree;
+			N* node;
+		};
+		using Iterator = IteratorType<Node, Value>;
+		using ConstIterator = IteratorType<const Node, const Value>;
+		using ReverseIterator = std::reverse_iterator<Iterator>;
+		using ConstReverseIterator = std::reverse_iterator<ConstIterator>;
+
+		// STL compatible names.
+		using iterator = Iterator;
+		using const_iterator = ConstIterator;
+		using reverse_iterator = ReverseIterator;
+		using const_reverse_iterator = ConstReverseIterator;
+
 	public:
 		constexpr static size_t NodeSize(void)	{ return sizeof(Node); }
+		constexpr static size_t NodeAlignment(void)	{ return alignof(Node); }
+		static_assert(!DKTreeAllocatorTraits<Allocator>::CanFreeAll ||
+					  alignof(Node) <= DKTreeAllocatorTraits<Allocator>::Alignment,
+					  "Node alignment exceeds alignment of allocator.");
 
 		DKAVLTree(void)
-			: rootNode(NULL), count(0)
+			: rootNode(NULL), lastNode(NULL), count(0)
 		{
 		}
 		DKAVLTree(DKAVLTree&& tree)
-			: rootNode(NULL), count(0)
+			: rootNode(NULL), lastNode(NULL), count(0)
 		{
 			rootNode = tree.rootNode;
+			lastNode = tree.lastNode;
 			count = tree.count;
 			tree.rootNode = NULL;
+			tree.lastNode = NULL;
 			tree.count = 0;
+			std::swap(allocator, tree.allocator);
 		}
 		// Copy constructor. accepts same type of class.
 		// templates not works on MSVC (bug?)
 		DKAVLTree(const DKAVLTree& s)
-			: rootNode(NULL), count(0)
+			: rootNode(NULL), lastNode(NULL), count(0)
 		{
 			if (s.rootNode)
-				rootNode = s.rootNode->Duplicate();
+				rootNode = s.rootNode->Duplicate(allocator);
+			lastNode = RightmostNode();
 			count = s.count;
 		}
+		// Construct with sorted range. (see Assign)
+		template <typename Iterator> DKAVLTree(Iterator first, Iterator last)
+			: rootNode(NULL), lastNode(NULL), count(0)
+		{
+			Assign(first, last);
+		}
 		~DKAVLTree(void)
 		{
 			Clear();
@@ -162,6 +257,7 @@ namespace DKFoundation
 		{
 			bool created = false;
 			Node* node = SetNode(v, &created);
+			instrumentation.EndSearch();
 			if (!created)
 				copyValue(node->value, v);
 			return &node->value;
@@ -172,15 +268,84 @@ namespace DKFoundation
 		{
 			bool created = false;
 			Node* node = SetNode(v, &created);
+			instrumentation.EndSearch();
 			if (created && node)
 				return &node->value;
 			return NULL;
 		}
+		// Insert with hint: insert if not exist, search begins from 'hint'.
+		//  returns position of inserted item, or end() if already exists.
+		//  if 'v' is between hint and its neighbor, 'v' is linked next to hint
+		//  without search, otherwise search climbs from hint. (finger search)
+		//  position returned by previous insertion can be used as hint for
+		//  next insertion. (sorted or near-sorted input)
+		//  if hint is end(), last item is used as hint, appending greater item
+		//  than last item takes one comparison.
+		Iterator Insert(ConstIterator hint, const Value& v)
+		{
+			bool created = false;
+			Node* node = hint.node ? const_cast<Node*>(hint.node) : lastNode;
+			if (node == NULL)
+			{
+				node = SetNode(v, &created);
+				instrumentation.EndSearch();
+				return Iterator(this, node);
+			}
+			instrumentation.Compare();
+			int cmp = valueComparator(node->value, v);
+			if (cmp < 0)
+			{
+				// link between hint and successor.
+				Node* next = Successor(node);
+				if (next)
+				{
+					instrumentation.Compare();
+					cmp = valueComparator(next->value, v);
+				}
+				if (next == NULL || cmp > 0)
+				{
+					instrumentation.EndSearch();
+					if (node->right == NULL)
+						return Iterator(this, LinkNode(node, v, true));
+					return Iterator(this, LinkNode(next, v, false));	// next is leftmost of node->right
+				}
+				node = FingerNode(next, v, cmp);
+			}
+			else if (cmp > 0)
+			{
+				// link between predecessor and hint.
+				Node* prev = Predecessor(node);
+				if (prev)
+				{
+					instrumentation.Compare();
+					cmp = valueComparator(prev->value, v);
+				}
+				if (prev == NULL || cmp < 0)
+				{
+					instrumentation.EndSearch();
+					if (node->left == NULL)
+						return Iterator(this, LinkNode(node, v, false));
+					return Iterator(this, LinkNode(prev, v, true));	// prev is rightmost of node->left
+				}
+				node = FingerNode(prev, v, cmp);
+			}
+			else
+				node = NULL;
+			if (node)
+				node = SetNode(node, v, &created);
+			instrumentation.EndSearch();
+			if (created)
+				return Iterator(this, node);
+			return end();
+		}
 		void Remove(const Key& k)
 		{
 			Node* node = LookupNodeForKey(k);
+			instrumentation.EndSearch();
 			if (node == NULL)
 				return;
+			if (node == lastNode)
+				lastNode = Predecessor(node);
 
 			Node* retrace = NULL;	// entry node to begin rotation.
 
@@ -297,24 +462,187 @@ namespace DKFoundation
 			if (retrace)
 				Balancing(retrace);
 		}
+		// Assign: replace all items with sorted range [first, last).
+		//  range must be sorted in ascending order, duplicated values are skipped.
+		//  builds perfectly balanced tree in linear time without rotation.
+		template <typename Iterator> void Assign(Iterator first, Iterator last)
+		{
+			Clear();
+			if (first == last)
+				return;
+
+			size_t n = 1;
+			Iterator prev = first;
+			for (Iterator it = first; ++it != last; prev = it)
+			{
+				if (valueComparator(*prev, *it))
+					n++;
+			}
+			rootNode = BuildNodes(first, last, n, NULL);
+			lastNode = RightmostNode();
+			count = n;
+		}
+		// BuildParallel: replace all items with unsorted range [first, last).
+		//  items are sorted and deduplicated with multiple threads, then
+		//  balanced sub-trees are built on worker threads.
+		//  all nodes are allocated on calling thread, Allocator does not need
+		//  to be thread-safe. (threads = 0 for hardware concurrency)
+		template <typename Iterator> void BuildParallel(Iterator first, Iterator last, size_t threads)
+		{
+			Clear();
+
+			std::vector<Value> values(first, last);
+			size_t n = DKFoundation::DKParallelSortUnique(values, valueComparator, threads);
+			if (n == 0)
+				return;
+
+			std::vector<Node*> nodes(n);
+			for (size_t i = 0; i < n; ++i)
+				nodes[i] = static_cast<Node*>(allocator.Alloc(sizeof(Node)));
+
+			int depth = DKFoundation::DKParallelForkDepth(threads);
+			rootNode = BuildNodesParallel(nodes.data(), values.data(), n, NULL, depth);
+			lastNode = RightmostNode();
+			count = n;
+		}
+		// Clear: delete all nodes.
+		//  if Allocator provides FreeAll and Value is trivially destructible,
+		//  nodes are released at once without visiting. (O(chunks) with pool)
 		void Clear(void)
 		{
 			if (rootNode)
-				DeleteNode(rootNode);
+				DeleteAllNodes(std::integral_constant<bool, DKTreeAllocatorTraits<Allocator>::CanFreeAll &&
+								   std::is_trivially_destructible<Value>::value>());
 			rootNode = NULL;
+			lastNode = NULL;
 			count = 0;
 		}
 		FORCEINLINE const Value* Find(const Key& k) const
 		{
 			const Node* node = LookupNodeForKey(k);
+			instrumentation.EndSearch();
 			if (node)
 				return &node->value;
 			return NULL;
 		}
+		// FindMany: find 'numKeys' keys, results[i] is item of keys[i] or NULL.
+		//  GroupSize searches are advanced in turn, next node of each search is
+		//  prefetched before other searches are advanced. (hides memory latency)
+		//  finished search is replaced with next key.
+		template <int GroupSize = 8>
+		void FindMany(const Key* keys, size_t numKeys, const Value** results) const
+		{
+			static_assert(GroupSize > 0, "GroupSize must be greater than zero");
+			if (rootNode == NULL)
+			{
+				for (size_t i = 0; i < numKeys; ++i)
+					results[i] = NULL;
+				return;
+			}
+			struct { const Node* node; size_t index; } lanes[GroupSize];
+			int active = 0;
+			size_t next = 0;
+			for (; active < GroupSize && next < numKeys; ++active, ++next)
+			{
+				lanes[active].node = rootNode;
+				lanes[active].index = next;
+			}
+			while (active > 0)
+			{
+				for (int i = 0; i < active; )
+				{
+					const Node* node = lanes[i].node;
+					int cmp = keyComparator(node->value, keys[lanes[i].index]);
+					const Node* child = cmp > 0 ? node->left : node->right;
+					if (cmp == 0 || child == NULL)
+					{
+						results[lanes[i].index] = cmp == 0 ? &node->value : NULL;
+						if (next < numKeys)
+						{
+							lanes[i].node = rootNode;
+							lanes[i].index = next++;
+							++i;
+						}
+						else
+							lanes[i] = lanes[--active];
+					}
+					else
+					{
+						__builtin_prefetch(child);
+						lanes[i].node = child;
+						++i;
+					}
+				}
+			}
+		}
 		FORCEINLINE size_t Count(void) const
 		{
 			return count;
 		}
+		// LowerBound: returns first item which is not less than 'k'.
+		// UpperBound: returns first item which is greater than 'k'.
+		// Floor: returns last item which is not greater than 'k'.
+		// Ceiling: returns first item which is not less than 'k'. (same as LowerBound)
+		//  returns NULL if not exists.
+		const Value* LowerBound(const Key& k) const
+		{
+			const Node* node = LowerBoundNode(k);
+			if (node)
+				return &node->value;
+			return NULL;
+		}
+		const Value* UpperBound(const Key& k) const
+		{
+			const Node* node = UpperBoundNode(k);
+			if (node)
+				return &node->value;
+			return NULL;
+		}
+		const Value* Floor(const Key& k) const
+		{
+			const Node* node = FloorNode(k);
+			if (node)
+				return &node->value;
+			return NULL;
+		}
+		FORCEINLINE const Value* Ceiling(const Key& k) const
+		{
+			return LowerBound(k);
+		}
+		Iterator begin(void)
+		{
+			Node* node = rootNode;
+			if (node)
+				for (; node->left; node = node->left);
+			return Iterator(this, node);
+		}
+		ConstIterator begin(void) const
+		{
+			return const_cast<DKAVLTree*>(this)->begin();
+		}
+		FORCEINLINE Iterator end(void)						{ return Iterator(this, NULL); }
+		FORCEINLINE ConstIterator end(void) const			{ return ConstIterator(this, NULL); }
+		FORCEINLINE ReverseIterator rbegin(void)			{ return ReverseIterator(end()); }
+		FORCEINLINE ConstReverseIterator rbegin(void) const	{ return ConstReverseIterator(end()); }
+		FORCEINLINE ReverseIterator rend(void)				{ return ReverseIterator(begin()); }
+		FORCEINLINE ConstReverseIterator rend(void) const	{ return ConstReverseIterator(begin()); }
+		// Seek: returns iterator of first item which is not less than 'k'.
+		//  iterator can be saved to resume scan. (paginated scan)
+		FORCEINLINE Iterator Seek(const Key& k)
+		{
+			return Iterator(this, const_cast<Node*>(LowerBoundNode(k)));
+		}
+		FORCEINLINE ConstIterator Seek(const Key& k) const
+		{
+			return ConstIterator(this, LowerBoundNode(k));
+		}
+		// Freeze: returns read-only snapshot with flat layout.
+		//  snapshot can be searched with KeyComparator (DKFrozenTree::Find)
+		DKFrozenTree<Value> Freeze(DKFrozenTreeLayout layout = DKFrozenTreeLayout::Eytzinger) const
+		{
+			ConstIterator it = begin();
+			return DKFrozenTree<Value>(count, layout, [&it]() -> const Value& { return *it++; });
+		}
 		DKAVLTree& operator = (DKAVLTree&& tree)
 		{
 			if (this != &tree)
@@ -322,9 +650,12 @@ namespace DKFoundation
 				Clear();
 
 				rootNode = tree.rootNode;
+				lastNode = tree.lastNode;
 				count = tree.count;
 				tree.rootNode = NULL;
+				tree.lastNode = NULL;
 				tree.count = 0;
+				std::swap(allocator, tree.allocator);
 			}
 			return *this;
 		}
@@ -335,7 +666,8 @@ namespace DKFoundation
 			Clear();
 
 			if (s.rootNode)
-				rootNode = s.rootNode->Duplicate();
+				rootNode = s.rootNode->Duplicate(allocator);
+			lastNode = RightmostNode();
 			count = s.count;
 			return *this;
 		}
@@ -389,7 +721,108 @@ namespace DKFoundation
 				rootNode->EnumerateBackward(func);
 			}
 		}
+		// range enumerator (VALUE&, bool*) for items in range [lo, hi)
+		//  starts from lower-bound of 'lo' and walks successors until 'hi'.
+		template <typename T> void EnumerateRange(const Key& lo, const Key& hi, T&& enumerator)
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (VALUE&, bool*)");
+
+			bool stop = false;
+			for (Node* node = const_cast<Node*>(LowerBoundNode(lo));
+				 node && keyComparator(node->value, hi) < 0;
+				 node = Successor(node))
+			{
+				enumerator(node->value, &stop);
+				if (stop)
+					break;
+			}
+		}
+		// range enumerator (const VALUE&, bool*) for items in range [lo, hi)
+		template <typename T> void EnumerateRange(const Key& lo, const Key& hi, T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			bool stop = false;
+			for (const Node* node = LowerBoundNode(lo);
+				 node && keyComparator(node->value, hi) < 0;
+				 node = Successor(node))
+			{
+				enumerator(node->value, &stop);
+				if (stop)
+					break;
+			}
+		}
 	private:
+		// in-order successor, predecessor with parent-nodes.
+		template <typename N> FORCEINLINE static N* Successor(N* node)
+		{
+			if (node->right)
+			{
+				for (node = node->right; node->left; node = node->left);
+				return node;
+			}
+			while (node->parent && node->parent->right == node)
+				node = node->parent;
+			return node->parent;
+		}
+		template <typename N> FORCEINLINE static N* Predecessor(N* node)
+		{
+			if (node->left)
+			{
+				for (node = node->left; node->right; node = node->right);
+				return node;
+			}
+			while (node->parent && node->parent->left == node)
+				node = node->parent;
+			return node->parent;
+		}
+		const Node* LowerBoundNode(const Key& k) const
+		{
+			const Node* bound = NULL;
+			for (const Node* node = rootNode; node; )
+			{
+				if (keyComparator(node->value, k) >= 0)
+				{
+					bound = node;
+					node = node->left;
+				}
+				else
+					node = node->right;
+			}
+			return bound;
+		}
+		const Node* UpperBoundNode(const Key& k) const
+		{
+			const Node* bound = NULL;
+			for (const Node* node = rootNode; node; )
+			{
+				if (keyComparator(node->value, k) > 0)
+				{
+					bound = node;
+					node = node->left;
+				}
+				else
+					node = node->right;
+			}
+			return bound;
+		}
+		const Node* FloorNode(const Key& k) const
+		{
+			const Node* bound = NULL;
+			for (const Node* node = rootNode; node; )
+			{
+				if (keyComparator(node->value, k) <= 0)
+				{
+					bound = node;
+					node = node->right;
+				}
+				else
+					node = node->left;
+			}
+			return bound;
+		}
 		void DeleteNode(Node* node)
 		{
 			if (node->right)
@@ -400,10 +833,71 @@ namespace DKFoundation
 			count--;
 
 			(*node).~Node();
-			Allocator::Free(node);
+			allocator.Free(node);
+		}
+		FORCEINLINE void DeleteAllNodes(std::false_type)
+		{
+			DeleteNode(rootNode);
+		}
+		FORCEINLINE void DeleteAllNodes(std::true_type)
+		{
+			allocator.FreeAll();
+		}
+		// build balanced tree with 'n' unique items from sorted range.
+		// nodes are allocated in-order, 'it' moves to next unique item.
+		template <typename Iterator> Node* BuildNodes(Iterator& it, const Iterator& last, size_t n, Node* parentNode)
+		{
+			size_t numLeft = (n - 1) / 2;
+			Node* left = numLeft ? BuildNodes(it, last, numLeft, NULL) : NULL;
+
+			Node* node = new(allocator.Alloc(sizeof(Node))) Node(*it, parentNode);
+			for (++it; it != last && valueComparator(node->value, *it) == 0; ++it);
+
+			node->left = left;
+			if (left)
+			{
+				left->parent = node;
+				node->leftHeight = left->Height();
+			}
+			if (n - 1 > numLeft)
+			{
+				node->right = BuildNodes(it, last, n - 1 - numLeft, node);
+				node->rightHeight = node->right->Height();
+			}
+			return node;
+		}
+		// build balanced tree with pre-allocated nodes and sorted unique values.
+		// left sub-tree is built on worker thread while 'depth' > 0.
+		Node* BuildNodesParallel(Node* const* nodes, const Value* values, size_t n, Node* parentNode, int depth)
+		{
+			const size_t minNodesPerThread = 0x1000;
+			size_t numLeft = (n - 1) / 2;
+			size_t numRight = n - 1 - numLeft;
+
+			Node* node = new(nodes[numLeft]) Node(values[numLeft], parentNode);
+			if (depth > 0 && numLeft >= minNodesPerThread)
+			{
+				std::thread worker([=]()
+				{
+					node->left = BuildNodesParallel(nodes, values, numLeft, node, depth - 1);
+				});
+				node->right = BuildNodesParallel(nodes + numLeft + 1, values + numLeft + 1, numRight, node, depth - 1);
+				worker.join();
+			}
+			else
+			{
+				if (numLeft)
+					node->left = BuildNodesParallel(nodes, values, numLeft, node, 0);
+				if (numRight)
+					node->right = BuildNodesParallel(nodes + numLeft + 1, values + numLeft + 1, numRight, node, 0);
+			}
+			node->leftHeight = node->left ? node->left->Height() : 0;
+			node->rightHeight = node->right ? node->right->Height() : 0;
+			return node;
 		}
 		void LeftRotate(Node* pivot)
 		{
+			instrumentation.LeftRotate();
 			Node* parent = pivot->parent;
 
 			if (parent->parent)
@@ -422,6 +916,7 @@ namespace DKFoundation
 		}
 		void RightRotate(Node* pivot)
 		{
+			instrumentation.RightRotate();
 			Node* parent = pivot->parent;
 
 			if (parent->parent)
@@ -446,6 +941,7 @@ namespace DKFoundation
 		// do balancing tree weights.
 		void Balancing(Node* node)
 		{
+			instrumentation.Balance();
 			int left = node->left ? node->left->Height() : 0;
 			int right = node->right ? node->right->Height() : 0;
 
@@ -480,19 +976,26 @@ namespace DKFoundation
 				rootNode = node;
 		}
 		// find node and return. (create if not exists)
-		Node* SetNode(const Value& v, bool* created)
+		FORCEINLINE Node* SetNode(const Value& v, bool* created)
 		{
 			if (rootNode == NULL)
 			{
 				*created = true;
 
 				count++;
-				rootNode = new(Allocator::Alloc(sizeof(Node))) Node(v, NULL);
+				rootNode = new(allocator.Alloc(sizeof(Node))) Node(v, NULL);
+				lastNode = rootNode;
 				return rootNode;
 			}
-			Node* node = rootNode;
+			return SetNode(rootNode, v, created);
+		}
+		// find node from sub-tree 'node' and return. (create if not exists)
+		//  'v' should be in range of sub-tree.
+		Node* SetNode(Node* node, const Value& v, bool* created)
+		{
 			while (node)
 			{
+				instrumentation.Compare();
 				int cmp = valueComparator(node->value, v);
 				if (cmp > 0)
 				{
@@ -501,11 +1004,7 @@ namespace DKFoundation
 					else
 					{
 						*created = true;
-						count++;
-						Node* ret = new(Allocator::Alloc(sizeof(Node))) Node(v, node);
-						node->left = ret;
-						Balancing(node);
-						return ret;
+						return LinkNode(node, v, false);
 					}
 				}
 				else if (cmp < 0)
@@ -515,11 +1014,7 @@ namespace DKFoundation
 					else
 					{
 						*created = true;
-						count++;
-						Node* ret = new(Allocator::Alloc(sizeof(Node))) Node(v, node);
-						node->right = ret;
-						Balancing(node);
-						return ret;
+						return LinkNode(node, v, true);
 					}
 				}
 				else
@@ -530,6 +1025,78 @@ namespace DKFoundation
 			}
 			return NULL;
 		}
+		// link new node of 'v' to empty child of 'parent'.
+		Node* LinkNode(Node* parent, const Value& v, bool right)
+		{
+			count++;
+			Node* ret = new(allocator.Alloc(sizeof(Node))) Node(v, parent);
+			if (right)
+			{
+				parent->right = ret;
+				if (parent == lastNode)
+					lastNode = ret;
+			}
+			else
+				parent->left = ret;
+			Balancing(parent);
+			return ret;
+		}
+		// finger search: climb from 'node' to sub-tree which range includes 'v'.
+		//  'cmp' is result of comparison 'node' with 'v'.
+		//  returns lowest node of path which sub-tree includes 'v', or NULL if
+		//  ancestor equals to 'v'. ancestors reached from right-child (or
+		//  left-child if 'v' is less than 'node') are not compared, bound of
+		//  sub-tree on the side of 'v' is not changed.
+		Node* FingerNode(Node* node, const Value& v, int cmp)
+		{
+			Node* subtree = node;
+			if (cmp < 0)
+			{
+				// climb until ancestor greater than 'v'.
+				for (Node* parent = node->parent; parent; parent = node->parent)
+				{
+					if (parent->left == node)
+					{
+						instrumentation.Compare();
+						cmp = valueComparator(parent->value, v);
+						if (cmp > 0)
+							break;
+						if (cmp == 0)
+							return NULL;
+						subtree = parent;
+					}
+					node = parent;
+				}
+			}
+			else if (cmp > 0)
+			{
+				// climb until ancestor less than 'v'.
+				for (Node* parent = node->parent; parent; parent = node->parent)
+				{
+					if (parent->right == node)
+					{
+						instrumentation.Compare();
+						cmp = valueComparator(parent->value, v);
+						if (cmp < 0)
+							break;
+						if (cmp == 0)
+							return NULL;
+						subtree = parent;
+					}
+					node = parent;
+				}
+			}
+			else
+				return NULL;
+			return subtree;
+		}
+		Node* RightmostNode(void) const
+		{
+			Node* node = rootNode;
+			if (node)
+				for (; node->right; node = node->right);
+			return node;
+		}
 		// find node 'k' and return. (return NULL if not exists)
 		FORCEINLINE Node* LookupNodeForKey(const Key& k)
 		{
@@ -540,6 +1107,7 @@ namespace DKFoundation
 			Node* node = rootNode;
 			while (node)
 			{
+				instrumentation.Compare();
 				int cmp = keyComparator(node->value, k);
 				if (cmp > 0)
 					node = node->left;
@@ -552,10 +1120,13 @@ namespace DKFoundation
 		}
 	public:
 		Node*				rootNode;
+		Node*				lastNode;		// rightmost node, for end() hint and iterator
 		size_t				count;
 		ValueComparator		valueComparator;
 		KeyComparator		keyComparator;
 		CopyValue			copyValue;
+		Allocator			allocator;
+		mutable Instrumentation	instrumentation;
 	};
 }
 
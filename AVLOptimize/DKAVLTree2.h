@@ -7,6 +7,13 @@
 
 #pragma once
 #include <new>
+#include <type_traits>
+#include <vector>
+#include <thread>
+#include "DKParallelSort.h"
+#include "DKFrozenTree.h"
+#include "DKTreeInstrumentation.h"
+#include "DKFixedSizeAllocator.h"
 //#include "../DKInclude.h"
 //#include "DKTypeTraits.h"
 //#include "DKFunction.h"
@@ -25,6 +32,25 @@
 //  to serialize of access in multi-threaded environment.
 //  You can use DKMap, DKSet instead, they are thread safe.
 //
+// Augmentation: node augmentation policy.
+//  DKTreeNoAugmentation (default): no extra data, NodeSize is not changed.
+//  DKTreeSizeAugmentation: each node keeps size of sub-tree,
+//   enables Select, Rank, CountRange in O(log n).
+//  DKTreeAggregateAugmentation<Aggregator>: keeps size of sub-tree and
+//   user-defined aggregate of sub-tree, enables AggregateRange in O(log n).
+//   Aggregator should provide:
+//    Type: aggregate type
+//    Type Identity(void) const
+//    Type Aggregate(const Value&) const
+//    Type Combine(const Type& lhs, const Type& rhs) const  (must be associative)
+//
+// Allocator: node allocator (Alloc, Free), each tree has own instance.
+//  tree-private pool with FreeAll (DKFixedSizePool) releases all nodes at
+//  once in Clear if Value is trivially destructible.
+//
+// Instrumentation: operation counter policy. (see DKTreeInstrumentation.h)
+//  DKTreeNoInstrumentation (default) is compiled away.
+//
 
 namespace DKFoundation2
 {
@@ -45,16 +71,66 @@ namespace DKFoundation2
 		}
 	};
 
+	struct DKTreeNoAugmentation
+	{
+		enum { Enabled = false, SubtreeSize = false, ValueDependent = false };
+		struct NodeData {};
+		template <typename Node> FORCEINLINE static void Update(Node*) {}
+	};
+	struct DKTreeSizeAugmentation
+	{
+		enum { Enabled = true, SubtreeSize = true, ValueDependent = false };
+		struct NodeData
+		{
+			NodeData(void) : size(1) {}
+			size_t size;	// number of nodes in sub-tree (including self)
+		};
+		template <typename Node> FORCEINLINE static void Update(Node* node)
+		{
+			node->size = 1 + (node->left ? node->left->size : 0) + (node->right ? node->right->size : 0);
+		}
+	};
+	template <typename T> struct DKTreeAggregateAugmentation
+	{
+		using Aggregator = T;
+		using Type = typename Aggregator::Type;
+		enum { Enabled = true, SubtreeSize = true, ValueDependent = true };
+		struct NodeData
+		{
+			NodeData(void) : size(1) {}
+			size_t size;		// number of nodes in sub-tree (including self)
+			Type aggregate;		// aggregate of sub-tree
+		};
+		template <typename Node> FORCEINLINE static void Update(Node* node)
+		{
+			Aggregator aggregator;
+			node->size = 1;
+			node->aggregate = aggregator.Aggregate(node->value);
+			if (node->left)
+			{
+				node->size += node->left->size;
+				node->aggregate = aggregator.Combine(node->left->aggregate, node->aggregate);
+			}
+			if (node->right)
+			{
+				node->size += node->right->size;
+				node->aggregate = aggregator.Combine(node->aggregate, node->right->aggregate);
+			}
+		}
+	};
+
 	template <
 		typename Value,											// value-type
 		typename Comparator = DKTreeItemComparator<Value, Value>,	// value comparison
 		typename Replacer = DKTreeItemReplacer<Value>,				// value replacement
-		typename Allocator = DKMemoryDefaultAllocator			// memory allocator
+		typename Allocator = DKMemoryDefaultAllocator,			// memory allocator
+		typename Augmentation = DKTreeNoAugmentation,			// node augmentation
+		typename Instrumentation = DKFoundation::DKTreeNoInstrumentation	// operation counter
 	>
 	class DKAVLTree
 	{
 public:
-		struct Node
+		struct Node : public Augmentation::NodeData
 		{
 			Node(const Value& v) : value(v), left(NULL), right(NULL), leftHeight(0), rightHeight(0) {}
 
@@ -68,19 +144,20 @@ public:
 			{
 				return leftHeight > rightHeight ? (leftHeight + 1) : (rightHeight + 1);
 			}
-			Node* Duplicate(void) const
+			Node* Duplicate(Allocator& allocator) const
 			{
-				Node* node = new(Allocator::Alloc(sizeof(Node))) Node(value);
+				Node* node = new(allocator.Alloc(sizeof(Node))) Node(value);
 				if (left)
 				{
-					node->left = left->Duplicate();
+					node->left = left->Duplicate(allocator);
 				}
 				if (right)
 				{
-					node->right = right->Duplicate();
+					node->right = right->Duplicate(allocator);
 				}
 				node->leftHeight = leftHeight;
 				node->rightHeight = rightHeight;
+				Augmentation::Update(node);
 				return node;
 			}
 			template <typename R> bool EnumerateForward(R&& enumerator) const
@@ -99,10 +176,126 @@ public:
 			}
 		};
 
+		// Cursor: resumable in-order cursor without parent-node.
+		//  path from root is saved in fixed-size array, no heap allocation.
+		//  cursor should not be used after tree modified.
+		class Cursor
+		{
+		public:
+			// AVL tree height is less than 1.44 * log2(n+2), 1.5 bits per count bit.
+			enum { MaxDepth = sizeof(size_t) * 12 };
+
+			Cursor(const DKAVLTree& t) : tree(&t), depth(0) {}
+
+			FORCEINLINE bool IsValid(void) const		{ return depth > 0; }
+			FORCEINLINE const Value* Current(void) const
+			{
+				if (depth > 0)
+					return &path[depth-1]->value;
+				return NULL;
+			}
+			FORCEINLINE void Reset(void)				{ depth = 0; }
+
+			// move to first item. returns false if tree is empty.
+			bool First(void)
+			{
+				depth = 0;
+				if (tree->rootNode)
+					PushLeftMost(tree->rootNode);
+				return depth > 0;
+			}
+			// move to last item. returns false if tree is empty.
+			bool Last(void)
+			{
+				depth = 0;
+				if (tree->rootNode)
+					PushRightMost(tree->rootNode);
+				return depth > 0;
+			}
+			// move to next item. returns false if there is no more item.
+			bool Next(void)
+			{
+				if (depth == 0)
+					return false;
+				const Node* node = path[depth-1];
+				if (node->right)
+				{
+					PushLeftMost(node->right);
+					return true;
+				}
+				while (--depth > 0)
+				{
+					if (path[depth-1]->left == node)
+						return true;
+					node = path[depth-1];
+				}
+				return false;
+			}
+			// move to previous item. returns false if there is no more item.
+			bool Prev(void)
+			{
+				if (depth == 0)
+					return false;
+				const Node* node = path[depth-1];
+				if (node->left)
+				{
+					PushRightMost(node->left);
+					return true;
+				}
+				while (--depth > 0)
+				{
+					if (path[depth-1]->right == node)
+						return true;
+					node = path[depth-1];
+				}
+				return false;
+			}
+			// move to first item which is not less than 'k'.
+			// returns false if not exists.
+			template <typename Key, typename KeyValueComparator>
+			bool Seek(const Key& k, KeyValueComparator&& comp)
+			{
+				int boundDepth = 0;
+				depth = 0;
+				for (const Node* node = tree->rootNode; node; )
+				{
+					path[depth++] = node;
+					if (comp(node->value, k) >= 0)
+					{
+						boundDepth = depth;
+						node = node->left;
+					}
+					else
+						node = node->right;
+				}
+				depth = boundDepth;
+				return depth > 0;
+			}
+
+		private:
+			FORCEINLINE void PushLeftMost(const Node* node)
+			{
+				for (; node; node = node->left)
+					path[depth++] = node;
+			}
+			FORCEINLINE void PushRightMost(const Node* node)
+			{
+				for (; node; node = node->right)
+					path[depth++] = node;
+			}
+			const DKAVLTree* tree;
+			int depth;
+			const Node* path[MaxDepth];
+		};
+
 	public:
 		using ValueTraits = DKTypeTraits<Value>;
 
 		constexpr static size_t NodeSize(void)	{ return sizeof(Node); }
+		constexpr static size_t NodeAlignment(void)	{ return alignof(Node); }
+		static_assert(!DKFoundation::DKTreeAllocatorTraits<Allocator>::CanFreeAll ||
+					  alignof(Node) <= DKFoundation::DKTreeAllocatorTraits<Allocator>::Alignment,
+					  "Node alignment exceeds alignment of allocator.");
 
 		DKAVLTree(void)
 		: rootNode(NULL), count(0)
@@ -115,6 +308,7 @@ public:
 			count = tree.count;
 			tree.rootNode = NULL;
 			tree.count = 0;
+			std::swap(allocator, tree.allocator);
 		}
 		// Copy constructor. accepts same type of class.
 		// templates not works on MSVC (bug?)
@@ -122,9 +316,15 @@ public:
 		: rootNode(NULL), count(0)
 		{
 			if (s.rootNode)
-				rootNode = s.rootNode->Duplicate();
+				rootNode = s.rootNode->Duplicate(allocator);
 			count = s.count;
 		}
+		// Construct with sorted range. (see Assign)
+		template <typename Iterator> DKAVLTree(Iterator first, Iterator last)
+		: rootNode(NULL), count(0)
+		{
+			Assign(first, last);
+		}
 		~DKAVLTree(void)
 		{
 			Clear();
@@ -136,14 +336,21 @@ public:
 			{
 				LocationContext ctxt = {&v};
 				LocateNodeForValue(rootNode, &ctxt);
+				instrumentation.EndSearch();
 				if (ctxt.balancedNode)
 					rootNode = ctxt.balancedNode;
 				else
+				{
 					replacer(ctxt.locatedNode->value, v);
+					if (Augmentation::ValueDependent)
+						UpdateAugmentation(rootNode, v);
+				}
 				return &(ctxt.locatedNode->value);
 			}
+			instrumentation.EndSearch();
 			count = 1;
-			rootNode = new(Allocator::Alloc(sizeof(Node))) Node(v);
+			rootNode = new(allocator.Alloc(sizeof(Node))) Node(v);
+			Augmentation::Update(rootNode);
 			return &(rootNode->value);
 		}
 		// Insert: insert if not exist or fail if exists.
@@ -155,6 +362,7 @@ public:
 				size_t c = this->count;
 				LocationContext ctxt = {&v};
 				LocateNodeForValue(rootNode, &ctxt);
+				instrumentation.EndSearch();
 				if (ctxt.balancedNode)
 					rootNode = ctxt.balancedNode;
 
@@ -162,8 +370,10 @@ public:
 					return &(ctxt.locatedNode->value);
 				return NULL;
 			}
+			instrumentation.EndSearch();
 			count = 1;
-			rootNode = new(Allocator::Alloc(sizeof(Node))) Node(v);
+			rootNode = new(allocator.Alloc(sizeof(Node))) Node(v);
+			Augmentation::Update(rootNode);
 			return &(rootNode->value);
 		}
 		template <typename Key, typename KeyValueComparator>
@@ -180,11 +390,57 @@ public:
 					DeleteNode(node);
 				}
 			}
+			instrumentation.EndSearch();
+		}
+		// Assign: replace all items with sorted range [first, last).
+		//  range must be sorted in ascending order, duplicated values are skipped.
+		//  builds perfectly balanced tree in linear time without rotation.
+		template <typename Iterator> void Assign(Iterator first, Iterator last)
+		{
+			Clear();
+			if (first == last)
+				return;
+
+			size_t n = 1;
+			Iterator prev = first;
+			for (Iterator it = first; ++it != last; prev = it)
+			{
+				if (comparator(*prev, *it))
+					n++;
+			}
+			rootNode = BuildNodes(first, last, n);
+			count = n;
 		}
+		// BuildParallel: replace all items with unsorted range [first, last).
+		//  items are sorted and deduplicated with multiple threads, then
+		//  balanced sub-trees are built on worker threads.
+		//  all nodes are allocated on calling thread, Allocator does not need
+		//  to be thread-safe. (threads = 0 for hardware concurrency)
+		template <typename Iterator> void BuildParallel(Iterator first, Iterator last, size_t threads)
+		{
+			Clear();
+
+			std::vector<Value> values(first, last);
+			size_t n = DKFoundation::DKParallelSortUnique(values, comparator, threads);
+			if (n == 0)
+				return;
+
+			std::vector<Node*> nodes(n);
+			for (size_t i = 0; i < n; ++i)
+				nodes[i] = static_cast<Node*>(allocator.Alloc(sizeof(Node)));
+
+			int depth = DKFoundation::DKParallelForkDepth(threads);
+			rootNode = BuildNodesParallel(nodes.data(), values.data(), n, depth);
+			count = n;
+		}
+		// Clear: delete all nodes.
+		//  if Allocator provides FreeAll and Value is trivially destructible,
+		//  nodes are released at once without visiting. (O(chunks) with pool)
 		FORCEINLINE void Clear(void)
 		{
 			if (rootNode)
-				DeleteNode(rootNode);
+				DeleteAllNodes(std::integral_constant<bool, DKFoundation::DKTreeAllocatorTraits<Allocator>::CanFreeAll &&
+								   std::is_trivially_destructible<Value>::value>());
 			rootNode = NULL;
 			count = 0;
 		}
@@ -192,14 +448,368 @@ public:
 		FORCEINLINE const Value* Find(const Key& k, KeyValueComparator&& cmp) const
 		{
 			const Node* node = LookupNodeForKey(k, std::forward<KeyValueComparator>(cmp));
+			instrumentation.EndSearch();
 			if (node)
 				return &node->value;
 			return NULL;
 		}
+		// FindMany: find 'numKeys' keys, results[i] is item of keys[i] or NULL.
+		//  GroupSize searches are advanced in turn, next node of each search is
+		//  prefetched before other searches are advanced. (hides memory latency)
+		//  finished search is replaced with next key.
+		template <int GroupSize = 8, typename Key, typename KeyValueComparator>
+		void FindMany(const Key* keys, size_t numKeys, const Value** results, KeyValueComparator&& comp) const
+		{
+			static_assert(GroupSize > 0, "GroupSize must be greater than zero");
+			if (rootNode == NULL)
+			{
+				for (size_t i = 0; i < numKeys; ++i)
+					results[i] = NULL;
+				return;
+			}
+			struct { const Node* node; size_t index; } lanes[GroupSize];
+			int active = 0;
+			size_t next = 0;
+			for (; active < GroupSize && next < numKeys; ++active, ++next)
+			{
+				lanes[active].node = rootNode;
+				lanes[active].index = next;
+			}
+			while (active > 0)
+			{
+				for (int i = 0; i < active; )
+				{
+					const Node* node = lanes[i].node;
+					int cmp = comp(node->value, keys[lanes[i].index]);
+					const Node* child = cmp > 0 ? node->left : node->right;
+					if (cmp == 0 || child == NULL)
+					{
+						results[lanes[i].index] = cmp == 0 ? &node->value : NULL;
+						if (next < numKeys)
+						{
+							lanes[i].node = rootNode;
+							lanes[i].index = next++;
+							++i;
+						}
+						else
+							lanes[i] = lanes[--active];
+					}
+					else
+					{
+						__builtin_prefetch(child);
+						lanes[i].node = child;
+						++i;
+					}
+				}
+			}
+		}
 		FORCEINLINE size_t Count(void) const
 		{
 			return count;
 		}
+		// LowerBound: returns first item which is not less than 'k'.
+		// UpperBound: returns first item which is greater than 'k'.
+		// Floor: returns last item which is not greater than 'k'.
+		// Ceiling: returns first item which is not less than 'k'. (same as LowerBound)
+		//  returns NULL if not exists.
+		template <typename Key, typename KeyValueComparator>
+		const Value* LowerBound(const Key& k, KeyValueComparator&& comp) const
+		{
+			const Value* bound = NULL;
+			for (const Node* node = rootNode; node; )
+			{
+				if (comp(node->value, k) >= 0)
+				{
+					bound = &node->value;
+					node = node->left;
+				}
+				else
+					node = node->right;
+			}
+			return bound;
+		}
+		template <typename Key, typename KeyValueComparator>
+		const Value* UpperBound(const Key& k, KeyValueComparator&& comp) const
+		{
+			const Value* bound = NULL;
+			for (const Node* node = rootNode; node; )
+			{
+				if (comp(node->value, k) > 0)
+				{
+					bound = &node->value;
+					node = node->left;
+				}
+				else
+					node = node->right;
+			}
+			return bound;
+		}
+		template <typename Key, typename KeyValueComparator>
+		const Value* Floor(const Key& k, KeyValueComparator&& comp) const
+		{
+			const Value* bound = NULL;
+			for (const Node* node = rootNode; node; )
+			{
+				if (comp(node->value, k) <= 0)
+				{
+					bound = &node->value;
+					node = node->right;
+				}
+				else
+					node = node->left;
+			}
+			return bound;
+		}
+		template <typename Key, typename KeyValueComparator>
+		FORCEINLINE const Value* Ceiling(const Key& k, KeyValueComparator&& comp) const
+		{
+			return LowerBound(k, std::forward<KeyValueComparator>(comp));
+		}
+		// Freeze: returns read-only snapshot with flat layout.
+		DKFoundation::DKFrozenTree<Value> Freeze(DKFoundation::DKFrozenTreeLayout layout = DKFoundation::DKFrozenTreeLayout::Eytzinger) const
+		{
+			Cursor cursor(*this);
+			cursor.First();
+			return DKFoundation::DKFrozenTree<Value>(count, layout, [&cursor]() -> const Value&
+			{
+				const Value* v = cursor.Current();
+				cursor.Next();
+				return *v;
+			});
+		}
+		// Select: returns k-th (zero-based) smallest item, NULL if k >= Count().
+		//  Augmentation should provide sub-tree size.
+		const Value* Select(size_t k) const
+		{
+			static_assert(Augmentation::SubtreeSize, "Augmentation does not provide sub-tree size.");
+			const Node* node = rootNode;
+			while (node)
+			{
+				size_t left = SubtreeSize(node->left);
+				if (k < left)
+					node = node->left;
+				else if (k > left)
+				{
+					k -= left + 1;
+					node = node->right;
+				}
+				else
+					return &node->value;
+			}
+			return NULL;
+		}
+		// Rank: returns number of items less than 'k'.
+		template <typename Key, typename KeyValueComparator>
+		size_t Rank(const Key& k, KeyValueComparator&& comp) const
+		{
+			static_assert(Augmentation::SubtreeSize, "Augmentation does not provide sub-tree size.");
+			size_t rank = 0;
+			const Node* node = rootNode;
+			while (node)
+			{
+				int cmp = comp(node->value, k);
+				if (cmp > 0)
+					node = node->left;
+				else if (cmp < 0)
+				{
+					rank += SubtreeSize(node->left) + 1;
+					node = node->right;
+				}
+				else
+				{
+					rank += SubtreeSize(node->left);
+					break;
+				}
+			}
+			return rank;
+		}
+		// CountRange: returns number of items in range [lo, hi).
+		template <typename Key, typename KeyValueComparator>
+		size_t CountRange(const Key& lo, const Key& hi, KeyValueComparator&& comp) const
+		{
+			size_t r1 = Rank(lo, comp);
+			size_t r2 = Rank(hi, comp);
+			return r2 > r1 ? r2 - r1 : 0;
+		}
+		// AggregateRange: returns aggregate of items in range [lo, hi).
+		//  Augmentation should be DKTreeAggregateAugmentation.
+		template <typename Key, typename KeyValueComparator, typename A = Augmentation>
+		typename A::Type AggregateRange(const Key& lo, const Key& hi, KeyValueComparator&& comp) const
+		{
+			static_assert(A::ValueDependent, "Augmentation does not provide aggregate.");
+			using Aggregator = typename A::Aggregator;
+			Aggregator aggregator;
+
+			// find top-most node in range.
+			const Node* node = rootNode;
+			while (node)
+			{
+				if (comp(node->value, lo) < 0)
+					node = node->right;
+				else if (comp(node->value, hi) >= 0)
+					node = node->left;
+				else
+					break;
+			}
+			if (node == NULL)
+				return aggregator.Identity();
+
+			// items greater than or equal to 'lo' in left sub-tree.
+			typename Aggregator::Type left = aggregator.Identity();
+			for (const Node* n = node->left; n; )
+			{
+				if (comp(n->value, lo) < 0)
+					n = n->right;
+				else
+				{
+					typename Aggregator::Type t = aggregator.Aggregate(n->value);
+					if (n->right)
+						t = aggregator.Combine(t, n->right->aggregate);
+					left = aggregator.Combine(t, left);
+					n = n->left;
+				}
+			}
+			// items less than 'hi' in right sub-tree.
+			typename Aggregator::Type right = aggregator.Identity();
+			for (const Node* n = node->right; n; )
+			{
+				if (comp(n->value, hi) >= 0)
+					n = n->left;
+				else
+				{
+					if (n->left)
+						right = aggregator.Combine(right, n->left->aggregate);
+					right = aggregator.Combine(right, aggregator.Aggregate(n->value));
+					n = n->right;
+				}
+			}
+			return aggregator.Combine(aggregator.Combine(left, aggregator.Aggregate(node->value)), right);
+		}
+		// Split: move items which are greater than or equal to 'k' into 'right'.
+		//  previous items of 'right' are removed.
+		//  nodes are reused, tree is split with O(log n) joins.
+		//  (counting moved items takes linear time of 'right' unless
+		//   Augmentation provides sub-tree size)
+		template <typename Key, typename KeyValueComparator>
+		void Split(const Key& k, KeyValueComparator&& comp, DKAVLTree& right)
+		{
+			static_assert(!DKFoundation::DKTreeAllocatorTraits<Allocator>::CanFreeAll, "Nodes cannot be moved between trees with private pool.");
+			if (this == &right)
+				return;
+			right.Clear();
+			if (rootNode)
+			{
+				Node* left = NULL;
+				Node* node = SplitNodes(rootNode, k, comp, &left, &right.rootNode);
+				if (node)
+					right.rootNode = JoinNodes(NULL, node, right.rootNode);
+				rootNode = left;
+				right.count = SubtreeSize(right.rootNode);
+				count -= right.count;
+			}
+		}
+		// Join: concatenate 'left', 'pivot' and 'right' into this tree.
+		//  all items of 'left' must be less than 'pivot' and all items of
+		//  'right' must be greater than 'pivot'. previous items are removed.
+		//  nodes of 'left', 'right' are reused. (left, right will be empty)
+		void Join(DKAVLTree& left, const Value& pivot, DKAVLTree& right)
+		{
+			static_assert(!DKFoundation::DKTreeAllocatorTraits<Allocator>::CanFreeAll, "Nodes cannot be moved between trees with private pool.");
+			Node* node = new(allocator.Alloc(sizeof(Node))) Node(pivot);
+			size_t c = left.count + right.count + 1;
+			Node* l = left.rootNode;
+			Node* r = right.rootNode;
+			left.rootNode = right.rootNode = NULL;
+			left.count = right.count = 0;
+			Clear();
+
+			rootNode = JoinNodes(l, node, r);
+			count = c;
+		}
+		// Join: concatenate 'left' and 'right' into this tree.
+		//  all items of 'left' must be less than items of 'right'.
+		void Join(DKAVLTree& left, DKAVLTree& right)
+		{
+			static_assert(!DKFoundation::DKTreeAllocatorTraits<Allocator>::CanFreeAll, "Nodes cannot be moved between trees with private pool.");
+			size_t c = left.count + right.count;
+			Node* l = left.rootNode;
+			Node* r = right.rootNode;
+			left.rootNode = right.rootNode = NULL;
+			left.count = right.count = 0;
+			Clear();
+
+			rootNode = JoinNodes(l, r);
+			count = c;
+		}
+		// ApplyBatch: apply operations sorted by value in one pass.
+		//  operations should be sorted by value without duplicated value.
+		//  sub-trees without operation are not visited, each node on path of
+		//  operations is visited and re-joined once. new items are built as
+		//  balanced sub-tree and joined.
+		//  Insert: insert if not exist. Update: insert or overwrite.
+		//  Remove: remove if exists.
+		enum class BatchOperationType
+		{
+			Insert,
+			Update,
+			Remove,
+		};
+		struct BatchOperation
+		{
+			BatchOperationType type;
+			Value value;
+		};
+		struct BatchResult
+		{
+			size_t inserted;
+			size_t updated;
+			size_t removed;
+		};
+		BatchResult ApplyBatch(const BatchOperation* ops, size_t numOps)
+		{
+			BatchResult result = { 0, 0, 0 };
+			rootNode = ApplyBatchNodes(rootNode, ops, numOps, &result);
+			count = count + result.inserted - result.removed;
+			return result;
+		}
+		// Union: merge items of 'tree' into this tree. (threads = 0 for hardware concurrency)
+		//  Intersect: keep items which also exist in 'tree'.
+		//  Difference: remove items which exist in 'tree'.
+		//  if item exists in both trees, item of this tree will be kept.
+		//  nodes are reused, both halves are processed in parallel.
+		//  work is O(m log(n/m + 1)), 'tree' will be empty.
+		//  (Split, Join, Union, Intersect, Difference move nodes between trees,
+		//   these are not available with tree-private pool allocator)
+		void Union(DKAVLTree& tree, size_t threads = 0)
+		{
+			static_assert(!DKFoundation::DKTreeAllocatorTraits<Allocator>::CanFreeAll, "Nodes cannot be moved between trees with private pool.");
+			if (this == &tree)
+				return;
+			NodeList discarded = { NULL, NULL };
+			rootNode = UnionNodes(rootNode, tree.rootNode, &discarded, DKFoundation::DKParallelForkDepth(threads));
+			MergeCount(tree, discarded);
+		}
+		void Intersect(DKAVLTree& tree, size_t threads = 0)
+		{
+			static_assert(!DKFoundation::DKTreeAllocatorTraits<Allocator>::CanFreeAll, "Nodes cannot be moved between trees with private pool.");
+			if (this == &tree)
+				return;
+			NodeList discarded = { NULL, NULL };
+			rootNode = IntersectNodes(rootNode, tree.rootNode, &discarded, DKFoundation::DKParallelForkDepth(threads));
+			MergeCount(tree, discarded);
+		}
+		void Difference(DKAVLTree& tree, size_t threads = 0)
+		{
+			static_assert(!DKFoundation::DKTreeAllocatorTraits<Allocator>::CanFreeAll, "Nodes cannot be moved between trees with private pool.");
+			if (this == &tree)
+			{
+				Clear();
+				return;
+			}
+			NodeList discarded = { NULL, NULL };
+			rootNode = DifferenceNodes(rootNode, tree.rootNode, &discarded, DKFoundation::DKParallelForkDepth(threads));
+			MergeCount(tree, discarded);
+		}
 		DKAVLTree& operator = (DKAVLTree&& tree)
 		{
 			if (this != &tree)
@@ -210,6 +820,7 @@ public:
 				count = tree.count;
 				tree.rootNode = NULL;
 				tree.count = 0;
+				std::swap(allocator, tree.allocator);
 			}
 			return *this;
 		}
@@ -220,7 +831,7 @@ public:
 			Clear();
 
 			if (s.rootNode)
-				rootNode = s.rootNode->Duplicate();
+				rootNode = s.rootNode->Duplicate(allocator);
 			count = s.count;
 			return *this;
 		}
@@ -249,7 +860,38 @@ public:
 				rootNode->EnumerateBackward(func);
 			}
 		}
+		// range enumerator (const VALUE&, bool*) for items in range [lo, hi)
+		//  sub-trees out of range are skipped, O(log n + number of items).
+		template <typename Key, typename KeyValueComparator, typename T>
+		void EnumerateRange(const Key& lo, const Key& hi, KeyValueComparator&& comp, T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			if (count > 0)
+			{
+				bool stop = false;
+				EnumerateNodesInRange(rootNode, lo, hi, comp, enumerator, &stop);
+			}
+		}
 	private:
+		template <typename Key, typename KeyComparator, typename T>
+		static bool EnumerateNodesInRange(const Node* node, const Key& lo, const Key& hi, KeyComparator& comp, T& enumerator, bool* stop)
+		{
+			bool afterLo = comp(node->value, lo) >= 0;
+			bool beforeHi = comp(node->value, hi) < 0;
+			if (afterLo && node->left && EnumerateNodesInRange(node->left, lo, hi, comp, enumerator, stop))
+				return true;
+			if (afterLo && beforeHi)
+			{
+				enumerator(node->value, stop);
+				if (*stop)
+					return true;
+			}
+			if (beforeHi && node->right && EnumerateNodesInRange(node->right, lo, hi, comp, enumerator, stop))
+				return true;
+			return false;
+		}
 		void DeleteNode(Node* node)
 		{
 			if (node->right)
@@ -260,10 +902,63 @@ public:
 			count--;
 
 			(*node).~Node();
-			Allocator::Free(node);
+			allocator.Free(node);
+		}
+		FORCEINLINE void DeleteAllNodes(std::false_type)
+		{
+			DeleteNode(rootNode);
+		}
+		FORCEINLINE void DeleteAllNodes(std::true_type)
+		{
+			allocator.FreeAll();
+		}
+		// build balanced tree with 'n' unique items from sorted range.
+		// nodes are allocated in-order, 'it' moves to next unique item.
+		template <typename Iterator> Node* BuildNodes(Iterator& it, const Iterator& last, size_t n)
+		{
+			size_t numLeft = (n - 1) / 2;
+			Node* left = numLeft ? BuildNodes(it, last, numLeft) : NULL;
+
+			Node* node = new(allocator.Alloc(sizeof(Node))) Node(*it);
+			for (++it; it != last && comparator(node->value, *it) == 0; ++it);
+
+			node->left = left;
+			if (n - 1 > numLeft)
+				node->right = BuildNodes(it, last, n - 1 - numLeft);
+			UpdateHeight(node);
+			return node;
+		}
+		// build balanced tree with pre-allocated nodes and sorted unique values.
+		// left sub-tree is built on worker thread while 'depth' > 0.
+		Node* BuildNodesParallel(Node* const* nodes, const Value* values, size_t n, int depth)
+		{
+			const size_t minNodesPerThread = 0x1000;
+			size_t numLeft = (n - 1) / 2;
+			size_t numRight = n - 1 - numLeft;
+
+			Node* node = new(nodes[numLeft]) Node(values[numLeft]);
+			if (depth > 0 && numLeft >= minNodesPerThread)
+			{
+				std::thread worker([=]()
+				{
+					node->left = BuildNodesParallel(nodes, values, numLeft, depth - 1);
+				});
+				node->right = BuildNodesParallel(nodes + numLeft + 1, values + numLeft + 1, numRight, depth - 1);
+				worker.join();
+			}
+			else
+			{
+				if (numLeft)
+					node->left = BuildNodesParallel(nodes, values, numLeft, 0);
+				if (numRight)
+					node->right = BuildNodesParallel(nodes + numLeft + 1, values + numLeft + 1, numRight, 0);
+			}
+			UpdateHeight(node);
+			return node;
 		}
 		FORCEINLINE Node* LeftRotate(Node* node)
 		{
+			instrumentation.LeftRotate();
 			Node* right = node->right;
 			node->right = right->left;
 			right->left = node;
@@ -271,6 +966,7 @@ public:
 		}
 		FORCEINLINE Node* RightRotate(Node* node)
 		{
+			instrumentation.RightRotate();
 			Node* left = node->left;
 			node->left = left->right;
 			left->right = node;
@@ -280,10 +976,12 @@ public:
 		{
 			node->leftHeight = node->left ? node->left->Height() : 0;
 			node->rightHeight = node->right ? node->right->Height() : 0;
+			Augmentation::Update(node);
 		}
 		// balance tree weights.
 		FORCEINLINE Node* Balance(Node* node)
 		{
+			instrumentation.Balance();
 			Node* node2 = node;
 			int left = node->left ? node->left->Height() : 0;
 			int right = node->right ? node->right->Height() : 0;
@@ -357,6 +1055,7 @@ public:
 		template <typename Key, typename KeyComparator>
 		void TakeOutNodeForKey(Node* node, const Key& key, KeyComparator&& comp, LocationContext* ctxt)
 		{
+			instrumentation.Compare();
 			ctxt->cmp = comp(node->value, key);
 			if (ctxt->cmp > 0)
 			{
@@ -420,6 +1119,7 @@ public:
 		// stack variables, because of called recursively.
 		void LocateNodeForValue(Node* node, LocationContext* ctxt)
 		{
+			instrumentation.Compare();
 			ctxt->cmp = comparator(node->value, *ctxt->value);
 			if (ctxt->cmp > 0)
 			{
@@ -434,10 +1134,12 @@ public:
 				}
 				else
 				{
-					node->left = new(Allocator::Alloc(sizeof(Node))) Node(*ctxt->value);
+					node->left = new(allocator.Alloc(sizeof(Node))) Node(*ctxt->value);
 					node->leftHeight = 1;
 					ctxt->locatedNode = node->left;
-					ctxt->balancedNode = node->right ? NULL : node;
+					ctxt->balancedNode = (node->right && !Augmentation::Enabled) ? NULL : node;
+					Augmentation::Update(node->left);
+					Augmentation::Update(node);
 					count++;
 					return;
 				}
@@ -455,10 +1157,12 @@ public:
 				}
 				else
 				{
-					node->right = new(Allocator::Alloc(sizeof(Node))) Node(*ctxt->value);
+					node->right = new(allocator.Alloc(sizeof(Node))) Node(*ctxt->value);
 					node->rightHeight = 1;
 					ctxt->locatedNode = node->right;
-					ctxt->balancedNode = node->left ? NULL : node;
+					ctxt->balancedNode = (node->left && !Augmentation::Enabled) ? NULL : node;
+					Augmentation::Update(node->right);
+					Augmentation::Update(node);
 					count++;
 					return;
 				}
@@ -475,6 +1179,7 @@ public:
 			Node* node = rootNode;
 			while (node)
 			{
+				instrumentation.Compare();
 				int d = comp(node->value, k);
 				if (d > 0)
 					node = node->left;
@@ -485,10 +1190,319 @@ public:
 			}
 			return NULL;
 		}
+		// list of detached nodes, linked with 'right'.
+		struct NodeList
+		{
+			Node* head;
+			Node* tail;
+		};
+		FORCEINLINE static void PushNode(Node* node, NodeList* list)
+		{
+			node->left = NULL;
+			node->right = list->head;
+			list->head = node;
+			if (list->tail == NULL)
+				list->tail = node;
+		}
+		FORCEINLINE static void AppendNodes(NodeList* list, const NodeList& nodes)
+		{
+			if (nodes.head)
+			{
+				nodes.tail->right = list->head;
+				list->head = nodes.head;
+				if (list->tail == NULL)
+					list->tail = nodes.tail;
+			}
+		}
+		// flatten sub-tree with rotations and push all nodes to list.
+		static void PushNodes(Node* node, NodeList* list)
+		{
+			while (node)
+			{
+				if (node->left)
+				{
+					Node* left = node->left;
+					node->left = left->right;
+					left->right = node;
+					node = left;
+				}
+				else
+				{
+					Node* right = node->right;
+					PushNode(node, list);
+					node = right;
+				}
+			}
+		}
+		static size_t CountNodes(const Node* node)
+		{
+			if (node)
+				return CountNodes(node->left) + CountNodes(node->right) + 1;
+			return 0;
+		}
+		FORCEINLINE static size_t SubtreeSize(const Node* node, std::true_type)
+		{
+			return node ? node->size : 0;
+		}
+		FORCEINLINE static size_t SubtreeSize(const Node* node, std::false_type)
+		{
+			return CountNodes(node);
+		}
+		FORCEINLINE static size_t SubtreeSize(const Node* node)
+		{
+			return SubtreeSize(node, std::integral_constant<bool, Augmentation::SubtreeSize>());
+		}
+		// update augmented data of nodes on the path to 'v'.
+		void UpdateAugmentation(Node* node, const Value& v)
+		{
+			int cmp = comparator(node->value, v);
+			if (cmp > 0)
+				UpdateAugmentation(node->left, v);
+			else if (cmp < 0)
+				UpdateAugmentation(node->right, v);
+			Augmentation::Update(node);
+		}
+		// take nodes of 'tree' and delete discarded nodes on calling thread.
+		void MergeCount(DKAVLTree& tree, const NodeList& discarded)
+		{
+			count += tree.count;
+			tree.rootNode = NULL;
+			tree.count = 0;
+			for (Node* node = discarded.head; node; )
+			{
+				Node* next = node->right;
+				node->right = NULL;
+				DeleteNode(node);
+				node = next;
+			}
+		}
+		FORCEINLINE static int NodeHeight(const Node* node)
+		{
+			return node ? node->Height() : 0;
+		}
+		// join sub-trees with pivot node. (left < pivot < right)
+		// descends the taller tree's spine and rebalance on the way up.
+		Node* JoinNodes(Node* left, Node* pivot, Node* right)
+		{
+			int lh = NodeHeight(left);
+			int rh = NodeHeight(right);
+			if (lh > rh + 1)
+			{
+				left->right = JoinNodes(left->right, pivot, right);
+				return Balance(left);
+			}
+			if (rh > lh + 1)
+			{
+				right->left = JoinNodes(left, pivot, right->left);
+				return Balance(right);
+			}
+			pivot->left = left;
+			pivot->right = right;
+			UpdateHeight(pivot);
+			return pivot;
+		}
+		// join sub-trees without pivot. (left < right)
+		Node* JoinNodes(Node* left, Node* right)
+		{
+			if (left == NULL)
+				return right;
+			if (right == NULL)
+				return left;
+			LocationContext ctxt = { NULL, NULL, NULL };
+			TakeOutRightMostNode(left, &ctxt);
+			return JoinNodes(ctxt.balancedNode, ctxt.locatedNode, right);
+		}
+		Node* ApplyBatchNodes(Node* node, const BatchOperation* ops, size_t n, BatchResult* result)
+		{
+			if (n == 0)
+				return node;
+			if (node == NULL)
+				return BuildBatchNodes(ops, n, result);
+
+			// first operation which is not less than node.
+			size_t begin = 0;
+			size_t end = n;
+			while (begin < end)
+			{
+				size_t mid = (begin + end) / 2;
+				if (comparator(ops[mid].value, node->value) < 0)
+					begin = mid + 1;
+				else
+					end = mid;
+			}
+			size_t located = (begin < n && comparator(ops[begin].value, node->value) == 0) ? 1 : 0;
+
+			Node* left = ApplyBatchNodes(node->left, ops, begin, result);
+			Node* right = ApplyBatchNodes(node->right, ops + begin + located, n - begin - located, result);
+			if (located)
+			{
+				switch (ops[begin].type)
+				{
+				case BatchOperationType::Insert:
+					break;
+				case BatchOperationType::Update:
+					replacer(node->value, ops[begin].value);
+					result->updated++;
+					break;
+				case BatchOperationType::Remove:
+					result->removed++;
+					(*node).~Node();
+					allocator.Free(node);
+					return JoinNodes(left, right);
+				}
+			}
+			return JoinNodes(left, node, right);
+		}
+		// build sub-tree with inserting operations. (removing operations are ignored)
+		Node* BuildBatchNodes(const BatchOperation* ops, size_t n, BatchResult* result)
+		{
+			if (n == 0)
+				return NULL;
+			size_t mid = n / 2;
+			Node* left = BuildBatchNodes(ops, mid, result);
+			Node* right = BuildBatchNodes(ops + mid + 1, n - mid - 1, result);
+			if (ops[mid].type == BatchOperationType::Remove)
+				return JoinNodes(left, right);
+			Node* node = new(allocator.Alloc(sizeof(Node))) Node(ops[mid].value);
+			result->inserted++;
+			return JoinNodes(left, node, right);
+		}
+		// split sub-tree into 'left' (less than k) and 'right' (greater than k).
+		// returns detached node which equals to k or NULL if not exists.
+		template <typename Key, typename KeyComparator>
+		Node* SplitNodes(Node* node, const Key& k, KeyComparator& comp, Node** left, Node** right)
+		{
+			if (node == NULL)
+			{
+				*left = NULL;
+				*right = NULL;
+				return NULL;
+			}
+			int cmp = comp(node->value, k);
+			if (cmp > 0)
+			{
+				Node* r = node->right;
+				Node* located = SplitNodes(node->left, k, comp, left, right);
+				*right = JoinNodes(*right, node, r);
+				return located;
+			}
+			else if (cmp < 0)
+			{
+				Node* l = node->left;
+				Node* located = SplitNodes(node->right, k, comp, left, right);
+				*left = JoinNodes(l, node, *left);
+				return located;
+			}
+			*left = node->left;
+			*right = node->right;
+			node->left = NULL;
+			node->right = NULL;
+			UpdateHeight(node);
+			return node;
+		}
+		// run left(list, depth), right(list, depth).
+		// left runs on worker thread if depth > 0.
+		template <typename L, typename R>
+		void ForkJoin(int depth, NodeList* discarded, L&& left, R&& right)
+		{
+			if (depth > 0)
+			{
+				NodeList list = { NULL, NULL };
+				std::thread worker([&]() { left(&list, depth - 1); });
+				right(discarded, depth - 1);
+				worker.join();
+				AppendNodes(discarded, list);
+			}
+			else
+			{
+				left(discarded, 0);
+				right(discarded, 0);
+			}
+		}
+		enum { MinParallelHeight = 12 };	// do not fork small sub-trees.
+		Node* UnionNodes(Node* t1, Node* t2, NodeList* discarded, int depth)
+		{
+			if (t1 == NULL)
+				return t2;
+			if (t2 == NULL)
+				return t1;
+			if (std::min(t1->Height(), t2->Height()) < MinParallelHeight)
+				depth = 0;
+			Node* l1 = t1->left;
+			Node* r1 = t1->right;
+			Node* l2 = NULL;
+			Node* r2 = NULL;
+			Node* located = SplitNodes(t2, t1->value, comparator, &l2, &r2);
+			if (located)
+				PushNode(located, discarded);
+
+			Node* left = NULL;
+			Node* right = NULL;
+			ForkJoin(depth, discarded,
+					 [&](NodeList* list, int d) { left = UnionNodes(l1, l2, list, d); },
+					 [&](NodeList* list, int d) { right = UnionNodes(r1, r2, list, d); });
+			return JoinNodes(left, t1, right);
+		}
+		Node* IntersectNodes(Node* t1, Node* t2, NodeList* discarded, int depth)
+		{
+			if (t1 == NULL || t2 == NULL)
+			{
+				PushNodes(t1, discarded);
+				PushNodes(t2, discarded);
+				return NULL;
+			}
+			if (std::min(t1->Height(), t2->Height()) < MinParallelHeight)
+				depth = 0;
+			Node* l1 = t1->left;
+			Node* r1 = t1->right;
+			Node* l2 = NULL;
+			Node* r2 = NULL;
+			Node* located = SplitNodes(t2, t1->value, comparator, &l2, &r2);
+
+			Node* left = NULL;
+			Node* right = NULL;
+			ForkJoin(depth, discarded,
+					 [&](NodeList* list, int d) { left = IntersectNodes(l1, l2, list, d); },
+					 [&](NodeList* list, int d) { right = IntersectNodes(r1, r2, list, d); });
+			if (located)
+			{
+				PushNode(located, discarded);
+				return JoinNodes(left, t1, right);
+			}
+			PushNode(t1, discarded);
+			return JoinNodes(left, right);
+		}
+		Node* DifferenceNodes(Node* t1, Node* t2, NodeList* discarded, int depth)
+		{
+			if (t1 == NULL || t2 == NULL)
+			{
+				PushNodes(t2, discarded);
+				return t1;
+			}
+			if (std::min(t1->Height(), t2->Height()) < MinParallelHeight)
+				depth = 0;
+			Node* l1 = NULL;
+			Node* r1 = NULL;
+			Node* l2 = t2->left;
+			Node* r2 = t2->right;
+			Node* located = SplitNodes(t1, t2->value, comparator, &l1, &r1);
+			if (located)
+				PushNode(located, discarded);
+			PushNode(t2, discarded);
+
+			Node* left = NULL;
+			Node* right = NULL;
+			ForkJoin(depth, discarded,
+					 [&](NodeList* list, int d) { left = DifferenceNodes(l1, l2, list, d); },
+					 [&](NodeList* list, int d) { right = DifferenceNodes(r1, r2, list, d); });
+			return JoinNodes(left, right);
+		}
 public:
 		Node*			rootNode;
 		size_t			count;
 		Comparator		comparator;
 		Replacer		replacer;
+		Allocator		allocator;
+		mutable Instrumentation	instrumentation;
 	};
 }
\ No newline at end of file
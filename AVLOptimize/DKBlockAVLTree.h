@@ -0,0 +1,597 @@
+//
+//  File: DKBlockAVLTree.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <new>
+#include <string.h>
+#include <type_traits>
+#include "DKAVLTree2.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// DKBlockAVLTree
+// AVL tree with fat node, each node has sorted block of values.
+//
+// all values of left sub-tree are less than first value of block, all values
+// of right sub-tree are greater than last value of block.
+// Block is searched with DKTreeBlockSearch, 32bit unsigned integer block is
+// searched with SSE2 (or AVX2) comparison.
+//
+// Insertion into full block moves first value of block to left sub-tree.
+// (as last value of left sub-tree) Node which has child-node refills block
+// from sub-tree if block is less than half, leaf-node is merged into parent
+// if parent has room for values of leaf.
+//
+// Value should be trivial type. (values are moved with memmove)
+//
+// Note:
+//  value's pointer is valid until tree is modified. (values are moved
+//  inside of block and between blocks)
+//
+//  This class is not thread-safe. You need to use synchronization object
+//  to serialize of access in multi-threaded environment.
+//
+
+namespace DKFoundation2
+{
+	// number of values per node, node is 128 bytes. (two cache-lines)
+	template <typename Value> constexpr int DKTreeDefaultBlockSize(void)
+	{
+		return (128 - sizeof(void*) * 2 - 4) / sizeof(Value) > 4 ? int((128 - sizeof(void*) * 2 - 4) / sizeof(Value)) : 4;
+	}
+
+	// search sorted block, returns index of first value which is not less than 'k'.
+	template <typename Value, typename Key, typename KeyValueComparator> struct DKTreeBlockSearch
+	{
+		FORCEINLINE static int LowerBound(const Value* values, int count, const Key& k, KeyValueComparator& comp)
+		{
+			const Value* base = values;
+			int n = count;
+			while (n > 1)
+			{
+				int half = n / 2;
+				base = (comp(base[half], k) < 0) ? base + half : base;
+				n -= half;
+			}
+			return static_cast<int>(base - values) + (comp(*base, k) < 0);
+		}
+	};
+	// 32bit unsigned integer, count values less than 'k' with SIMD.
+	struct DKTreeBlockSearchUInt32
+	{
+		FORCEINLINE static int LowerBound(const uint32_t* values, int count, uint32_t k)
+		{
+			int n = 0;
+			int i = 0;
+#if defined(__AVX2__)
+			const __m256i bias8 = _mm256_set1_epi32(0x80000000);
+			const __m256i key8 = _mm256_xor_si256(_mm256_set1_epi32(k), bias8);
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)), bias8);
+				n += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(key8, v))));
+			}
+#endif
+#if defined(__SSE2__)
+			// unsigned comparison with signed compare instruction, flip sign bits.
+			const __m128i bias = _mm_set1_epi32(0x80000000);
+			const __m128i key = _mm_xor_si128(_mm_set1_epi32(k), bias);
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)), bias);
+				n += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, key))));
+			}
+#endif
+			for (; i < count; ++i)
+				n += values[i] < k;
+			return n;
+		}
+	};
+	template <> struct DKTreeBlockSearch<uint32_t, uint32_t, DKTreeItemComparator<uint32_t, uint32_t>>
+	{
+		FORCEINLINE static int LowerBound(const uint32_t* values, int count, uint32_t k, const DKTreeItemComparator<uint32_t, uint32_t>&)
+		{
+			return DKTreeBlockSearchUInt32::LowerBound(values, count, k);
+		}
+	};
+
+	template <
+		typename Value,											// value-type
+		typename Comparator = DKTreeItemComparator<Value, Value>,	// value comparison
+		typename Replacer = DKTreeItemReplacer<Value>,				// value replacement
+		typename Allocator = DKMemoryDefaultAllocator,			// memory allocator
+		int BlockSize = DKTreeDefaultBlockSize<Value>()			// values per node
+	>
+	class DKBlockAVLTree
+	{
+		static_assert(std::is_trivial<Value>::value, "Value should be trivial type.");
+		static_assert(BlockSize > 1 && BlockSize < 0x10000, "BlockSize is out of range.");
+public:
+		enum { MinFill = BlockSize / 2 };	// node which has child-node keeps this number of values at least.
+
+		struct Node
+		{
+			Node(const Value& v) : count(1), leftHeight(0), rightHeight(0), left(NULL), right(NULL) { values[0] = v; }
+
+			Value			values[BlockSize];
+			unsigned short	count;
+			unsigned char	leftHeight;
+			unsigned char	rightHeight;
+			Node*			left;
+			Node*			right;
+
+			FORCEINLINE int Height(void) const
+			{
+				return leftHeight > rightHeight ? (leftHeight + 1) : (rightHeight + 1);
+			}
+			Node* Duplicate(void) const
+			{
+				Node* node = new(Allocator::Alloc(sizeof(Node))) Node(*this);
+				if (left)
+					node->left = left->Duplicate();
+				if (right)
+					node->right = right->Duplicate();
+				return node;
+			}
+			template <typename R> bool EnumerateForward(R&& enumerator) const
+			{
+				if (left && left->EnumerateForward(std::forward<R>(enumerator)))	return true;
+				for (int i = 0; i < count; ++i)
+					if (enumerator(values[i]))										return true;
+				if (right && right->EnumerateForward(std::forward<R>(enumerator)))	return true;
+				return false;
+			}
+			template <typename R> bool EnumerateBackward(R&& enumerator) const
+			{
+				if (right && right->EnumerateBackward(std::forward<R>(enumerator)))	return true;
+				for (int i = count; i > 0; --i)
+					if (enumerator(values[i-1]))									return true;
+				if (left && left->EnumerateBackward(std::forward<R>(enumerator)))	return true;
+				return false;
+			}
+		};
+
+	public:
+		constexpr static size_t NodeSize(void)	{ return sizeof(Node); }
+
+		DKBlockAVLTree(void)
+		: rootNode(NULL), count(0)
+		{
+		}
+		DKBlockAVLTree(DKBlockAVLTree&& tree)
+		: rootNode(NULL), count(0)
+		{
+			rootNode = tree.rootNode;
+			count = tree.count;
+			tree.rootNode = NULL;
+			tree.count = 0;
+		}
+		DKBlockAVLTree(const DKBlockAVLTree& s)
+		: rootNode(NULL), count(0)
+		{
+			if (s.rootNode)
+				rootNode = s.rootNode->Duplicate();
+			count = s.count;
+		}
+		~DKBlockAVLTree(void)
+		{
+			Clear();
+		}
+		// Update: insertion if not exist or overwrite if exists.
+		FORCEINLINE const Value* Update(const Value& v)
+		{
+			LocationContext ctxt = { NULL, 0, false };
+			rootNode = InsertNode(rootNode, v, &ctxt);
+			if (!ctxt.created)
+				replacer(ctxt.node->values[ctxt.index], v);
+			return &(ctxt.node->values[ctxt.index]);
+		}
+		// Insert: insert if not exist or fail if exists.
+		//  returns NULL if function failed. (already exists)
+		FORCEINLINE const Value* Insert(const Value& v)
+		{
+			LocationContext ctxt = { NULL, 0, false };
+			rootNode = InsertNode(rootNode, v, &ctxt);
+			if (ctxt.created)
+				return &(ctxt.node->values[ctxt.index]);
+			return NULL;
+		}
+		template <typename Key, typename KeyValueComparator>
+		FORCEINLINE void Remove(const Key& k, KeyValueComparator&& comp)
+		{
+			if (rootNode)
+				rootNode = RemoveNode(rootNode, k, comp);
+		}
+		FORCEINLINE void Clear(void)
+		{
+			if (rootNode)
+				DeleteNode(rootNode);
+			rootNode = NULL;
+			count = 0;
+		}
+		template <typename Key, typename KeyValueComparator>
+		FORCEINLINE const Value* Find(const Key& k, KeyValueComparator&& comp) const
+		{
+			using KeySearch = DKTreeBlockSearch<Value, Key, typename std::decay<KeyValueComparator>::type>;
+			const Node* node = rootNode;
+			while (node)
+			{
+				if (comp(node->values[0], k) > 0)
+					node = node->left;
+				else if (comp(node->values[node->count - 1], k) < 0)
+					node = node->right;
+				else
+				{
+					int index = KeySearch::LowerBound(node->values, node->count, k, comp);
+					if (comp(node->values[index], k) == 0)
+						return &node->values[index];
+					return NULL;
+				}
+			}
+			return NULL;
+		}
+		FORCEINLINE size_t Count(void) const
+		{
+			return count;
+		}
+		// number of nodes, linear time.
+		size_t NumberOfNodes(void) const
+		{
+			return CountNodes(rootNode);
+		}
+		DKBlockAVLTree& operator = (DKBlockAVLTree&& tree)
+		{
+			if (this != &tree)
+			{
+				Clear();
+
+				rootNode = tree.rootNode;
+				count = tree.count;
+				tree.rootNode = NULL;
+				tree.count = 0;
+			}
+			return *this;
+		}
+		DKBlockAVLTree& operator = (const DKBlockAVLTree& s)
+		{
+			if (this == &s)	return *this;
+
+			Clear();
+
+			if (s.rootNode)
+				rootNode = s.rootNode->Duplicate();
+			count = s.count;
+			return *this;
+		}
+		// lambda enumerator bool (const VALUE&, bool*)
+		template <typename T> void EnumerateForward(T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			if (count > 0)
+			{
+				bool stop = false;
+				auto func = [=, &enumerator](const Value& v) mutable -> bool {enumerator(v, &stop); return stop;};
+				rootNode->EnumerateForward(func);
+			}
+		}
+		template <typename T> void EnumerateBackward(T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			if (count > 0)
+			{
+				bool stop = false;
+				auto func = [=, &enumerator](const Value& v) mutable -> bool {enumerator(v, &stop); return stop;};
+				rootNode->EnumerateBackward(func);
+			}
+		}
+
+	private:
+		using BlockSearch = DKTreeBlockSearch<Value, Value, Comparator>;
+
+		struct LocationContext
+		{
+			Node* node;		// node of located value
+			int index;		// index of located value in block
+			bool created;
+		};
+		FORCEINLINE Node* NewNode(const Value& v)
+		{
+			return new(Allocator::Alloc(sizeof(Node))) Node(v);
+		}
+		FORCEINLINE void FreeNode(Node* node)
+		{
+			node->~Node();
+			Allocator::Free(node);
+		}
+		FORCEINLINE static void InsertValue(Node* node, int index, const Value& v)
+		{
+			memmove(&node->values[index + 1], &node->values[index], sizeof(Value) * (node->count - index));
+			node->values[index] = v;
+			node->count++;
+		}
+		FORCEINLINE static void RemoveValue(Node* node, int index)
+		{
+			node->count--;
+			memmove(&node->values[index], &node->values[index + 1], sizeof(Value) * (node->count - index));
+		}
+		Node* InsertNode(Node* node, const Value& v, LocationContext* ctxt)
+		{
+			if (node == NULL)
+			{
+				node = NewNode(v);
+				count++;
+				ctxt->node = node;
+				ctxt->index = 0;
+				ctxt->created = true;
+				return node;
+			}
+			if (comparator(node->values[0], v) > 0)
+			{
+				if (node->left == NULL && node->count < BlockSize)
+				{
+					InsertValue(node, 0, v);
+					count++;
+					ctxt->node = node;
+					ctxt->index = 0;
+					ctxt->created = true;
+					return node;
+				}
+				node->left = InsertNode(node->left, v, ctxt);
+			}
+			else if (comparator(node->values[node->count - 1], v) < 0)
+			{
+				if (node->right == NULL && node->count < BlockSize)
+				{
+					ctxt->node = node;
+					ctxt->index = node->count;
+					ctxt->created = true;
+					node->values[node->count++] = v;
+					count++;
+					return node;
+				}
+				node->right = InsertNode(node->right, v, ctxt);
+			}
+			else
+			{
+				int index = BlockSearch::LowerBound(node->values, node->count, v, comparator);
+				ctxt->node = node;
+				if (comparator(node->values[index], v) == 0)
+				{
+					ctxt->index = index;
+					ctxt->created = false;
+					return node;
+				}
+				ctxt->created = true;
+				count++;
+				if (node->count < BlockSize)
+				{
+					ctxt->index = index;
+					InsertValue(node, index, v);
+					return node;
+				}
+				// block is full, move first value to left sub-tree.
+				// ('v' is greater than first value, index > 0)
+				Value first = node->values[0];
+				memmove(&node->values[0], &node->values[1], sizeof(Value) * (index - 1));
+				node->values[index - 1] = v;
+				ctxt->index = index - 1;
+				node->left = AppendNode(node->left, first);
+			}
+			return Balance(node);
+		}
+		// insert 'v' which is greater than all values of sub-tree.
+		Node* AppendNode(Node* node, const Value& v)
+		{
+			if (node == NULL)
+				return NewNode(v);
+			if (node->right)
+				node->right = AppendNode(node->right, v);
+			else if (node->count < BlockSize)
+			{
+				node->values[node->count++] = v;
+				return node;
+			}
+			else
+				node->right = NewNode(v);
+			return Balance(node);
+		}
+		template <typename Key, typename KeyValueComparator>
+		Node* RemoveNode(Node* node, const Key& k, KeyValueComparator& comp)
+		{
+			if (comp(node->values[0], k) > 0)
+			{
+				if (node->left == NULL)
+					return node;
+				node->left = RemoveNode(node->left, k, comp);
+			}
+			else if (comp(node->values[node->count - 1], k) < 0)
+			{
+				if (node->right == NULL)
+					return node;
+				node->right = RemoveNode(node->right, k, comp);
+			}
+			else
+			{
+				using KeySearch = DKTreeBlockSearch<Value, Key, typename std::decay<KeyValueComparator>::type>;
+				int index = KeySearch::LowerBound(node->values, node->count, k, comp);
+				if (comp(node->values[index], k) != 0)
+					return node;
+
+				RemoveValue(node, index);
+				count--;
+				if (node->count == 0 && node->left == NULL && node->right == NULL)
+				{
+					FreeNode(node);
+					return NULL;
+				}
+				if (node->count < MinFill)
+					Refill(node);
+			}
+			MergeLeaf(node);
+			return Balance(node);
+		}
+		// refill block with last value of left sub-tree or first value of right sub-tree.
+		FORCEINLINE void Refill(Node* node)
+		{
+			Value v;
+			if (node->left)
+			{
+				node->left = TakeOutLastValue(node->left, &v);
+				InsertValue(node, 0, v);
+			}
+			else if (node->right)
+			{
+				node->right = TakeOutFirstValue(node->right, &v);
+				node->values[node->count++] = v;
+			}
+		}
+		Node* TakeOutLastValue(Node* node, Value* v)
+		{
+			if (node->right)
+				node->right = TakeOutLastValue(node->right, v);
+			else
+			{
+				*v = node->values[--node->count];
+				if (node->count == 0 && node->left == NULL)
+				{
+					FreeNode(node);
+					return NULL;
+				}
+				if (node->count < MinFill)
+					Refill(node);
+			}
+			MergeLeaf(node);
+			return Balance(node);
+		}
+		Node* TakeOutFirstValue(Node* node, Value* v)
+		{
+			if (node->left)
+				node->left = TakeOutFirstValue(node->left, v);
+			else
+			{
+				*v = node->values[0];
+				RemoveValue(node, 0);
+				if (node->count == 0 && node->right == NULL)
+				{
+					FreeNode(node);
+					return NULL;
+				}
+				if (node->count < MinFill)
+					Refill(node);
+			}
+			MergeLeaf(node);
+			return Balance(node);
+		}
+		// merge leaf child-node into 'node' if 'node' has room.
+		FORCEINLINE void MergeLeaf(Node* node)
+		{
+			Node* left = node->left;
+			if (left && left->left == NULL && left->right == NULL && left->count < MinFill &&
+				node->count + left->count <= BlockSize)
+			{
+				memmove(&node->values[left->count], &node->values[0], sizeof(Value) * node->count);
+				memcpy(&node->values[0], &left->values[0], sizeof(Value) * left->count);
+				node->count += left->count;
+				node->left = NULL;
+				FreeNode(left);
+			}
+			Node* right = node->right;
+			if (right && right->left == NULL && right->right == NULL && right->count < MinFill &&
+				node->count + right->count <= BlockSize)
+			{
+				memcpy(&node->values[node->count], &right->values[0], sizeof(Value) * right->count);
+				node->count += right->count;
+				node->right = NULL;
+				FreeNode(right);
+			}
+		}
+		void DeleteNode(Node* node)
+		{
+			if (node->left)
+				DeleteNode(node->left);
+			if (node->right)
+				DeleteNode(node->right);
+			FreeNode(node);
+		}
+		static size_t CountNodes(const Node* node)
+		{
+			if (node)
+				return CountNodes(node->left) + CountNodes(node->right) + 1;
+			return 0;
+		}
+		FORCEINLINE Node* LeftRotate(Node* node)
+		{
+			Node* right = node->right;
+			node->right = right->left;
+			right->left = node;
+			return right;
+		}
+		FORCEINLINE Node* RightRotate(Node* node)
+		{
+			Node* left = node->left;
+			node->left = left->right;
+			left->right = node;
+			return left;
+		}
+		FORCEINLINE void UpdateHeight(Node* node)
+		{
+			node->leftHeight = node->left ? node->left->Height() : 0;
+			node->rightHeight = node->right ? node->right->Height() : 0;
+		}
+		// balance tree weights.
+		FORCEINLINE Node* Balance(Node* node)
+		{
+			Node* node2 = node;
+			int left = node->left ? node->left->Height() : 0;
+			int right = node->right ? node->right->Height() : 0;
+
+			int d = left - right;
+			if (d > 1)
+			{
+				if (node->left->rightHeight > 0 && node->left->rightHeight > node->left->leftHeight)
+				{
+					// do left-rotate with 'node->left' and right-rotate recursively.
+					node->left = LeftRotate(node->left);
+					UpdateHeight(node->left->left);
+				}
+				// right-rotate with 'node' and 'node->left'
+				node2 = RightRotate(node);
+			}
+			else if (d < -1)
+			{
+				if (node->right->leftHeight > 0 && node->right->leftHeight > node->right->rightHeight)
+				{
+					// right-rotate with 'node->right' and left-rotate recursively.
+					node->right = RightRotate(node->right);
+					UpdateHeight(node->right->right);
+				}
+				// left-rotate with 'node' and 'node->right'
+				node2 = LeftRotate(node);
+			}
+			UpdateHeight(node);
+			if (node != node2)
+				UpdateHeight(node2);
+			return node2;
+		}
+
+	public:
+		Node* rootNode;
+		size_t count;
+		Comparator comparator;
+		Replacer replacer;
+	};
+}
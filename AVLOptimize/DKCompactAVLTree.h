@@ -0,0 +1,448 @@
+//
+//  File: DKCompactAVLTree.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <new>
+#include "DKAVLTree2.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// DKCompactAVLTree
+// AVL tree with compact node layout.
+//
+// Node has no height fields, balance factor (-1, 0, +1) is stored in low
+// bits of left-node pointer. Node is smaller than DKFoundation2::DKAVLTree
+// by 8 bytes. (24 bytes for 32bit value on 64bit system)
+// Insertion and removal track sub-tree height changes instead of heights.
+//
+// Note:
+//  Allocator should return memory aligned to 4 bytes at least.
+//  value's pointer will not be changed after balancing process.
+//
+//  This class is not thread-safe. You need to use synchronization object
+//  to serialize of access in multi-threaded environment.
+//
+
+namespace DKFoundation2
+{
+	template <
+		typename Value,											// value-type
+		typename Comparator = DKTreeItemComparator<Value, Value>,	// value comparison
+		typename Replacer = DKTreeItemReplacer<Value>,				// value replacement
+		typename Allocator = DKMemoryDefaultAllocator			// memory allocator
+	>
+	class DKCompactAVLTree
+	{
+public:
+		struct Node
+		{
+			enum : uintptr_t { BalanceMask = 3 };
+
+			Node(const Value& v) : value(v), leftAndBalance(1), right(NULL) {}
+
+			Value		value;
+			uintptr_t	leftAndBalance;		// left-node | (balance + 1)
+			Node*		right;
+
+			// balance factor: right-height - left-height
+			FORCEINLINE int Balance(void) const		{ return static_cast<int>(leftAndBalance & BalanceMask) - 1; }
+			FORCEINLINE Node* Left(void) const		{ return reinterpret_cast<Node*>(leftAndBalance & ~uintptr_t(BalanceMask)); }
+			FORCEINLINE void SetBalance(int b)		{ leftAndBalance = (leftAndBalance & ~uintptr_t(BalanceMask)) | static_cast<uintptr_t>(b + 1); }
+			FORCEINLINE void SetLeft(Node* node)	{ leftAndBalance = reinterpret_cast<uintptr_t>(node) | (leftAndBalance & BalanceMask); }
+
+			Node* Duplicate(void) const
+			{
+				Node* node = new(Allocator::Alloc(sizeof(Node))) Node(value);
+				if (Left())
+					node->SetLeft(Left()->Duplicate());
+				if (right)
+					node->right = right->Duplicate();
+				node->SetBalance(Balance());
+				return node;
+			}
+			template <typename R> bool EnumerateForward(R&& enumerator) const
+			{
+				if (Left() && Left()->EnumerateForward(std::forward<R>(enumerator)))	return true;
+				if (enumerator(value))													return true;
+				if (right && right->EnumerateForward(std::forward<R>(enumerator)))		return true;
+				return false;
+			}
+			template <typename R> bool EnumerateBackward(R&& enumerator) const
+			{
+				if (right && right->EnumerateBackward(std::forward<R>(enumerator)))		return true;
+				if (enumerator(value))													return true;
+				if (Left() && Left()->EnumerateBackward(std::forward<R>(enumerator)))	return true;
+				return false;
+			}
+		};
+		static_assert(alignof(Node) > Node::BalanceMask, "Node alignment is too small to store balance.");
+
+	public:
+		constexpr static size_t NodeSize(void)	{ return sizeof(Node); }
+
+		DKCompactAVLTree(void)
+		: rootNode(NULL), count(0)
+		{
+		}
+		DKCompactAVLTree(DKCompactAVLTree&& tree)
+		: rootNode(NULL), count(0)
+		{
+			rootNode = tree.rootNode;
+			count = tree.count;
+			tree.rootNode = NULL;
+			tree.count = 0;
+		}
+		DKCompactAVLTree(const DKCompactAVLTree& s)
+		: rootNode(NULL), count(0)
+		{
+			if (s.rootNode)
+				rootNode = s.rootNode->Duplicate();
+			count = s.count;
+		}
+		~DKCompactAVLTree(void)
+		{
+			Clear();
+		}
+		// Update: insertion if not exist or overwrite if exists.
+		FORCEINLINE const Value* Update(const Value& v)
+		{
+			LocationContext ctxt = { &v, NULL, false };
+			rootNode = InsertNode(rootNode, &ctxt);
+			if (!ctxt.created)
+				replacer(ctxt.locatedNode->value, v);
+			return &(ctxt.locatedNode->value);
+		}
+		// Insert: insert if not exist or fail if exists.
+		//  returns NULL if function failed. (already exists)
+		FORCEINLINE const Value* Insert(const Value& v)
+		{
+			LocationContext ctxt = { &v, NULL, false };
+			rootNode = InsertNode(rootNode, &ctxt);
+			if (ctxt.created)
+				return &(ctxt.locatedNode->value);
+			return NULL;
+		}
+		template <typename Key, typename KeyValueComparator>
+		FORCEINLINE void Remove(const Key& k, KeyValueComparator&& comp)
+		{
+			if (rootNode)
+			{
+				LocationContext ctxt = { NULL, NULL, false };
+				rootNode = RemoveNode(rootNode, k, comp, &ctxt);
+				if (ctxt.locatedNode)
+				{
+					ctxt.locatedNode->SetLeft(NULL);
+					ctxt.locatedNode->right = NULL;
+					DeleteNode(ctxt.locatedNode);
+				}
+			}
+		}
+		FORCEINLINE void Clear(void)
+		{
+			if (rootNode)
+				DeleteNode(rootNode);
+			rootNode = NULL;
+			count = 0;
+		}
+		template <typename Key, typename KeyValueComparator>
+		FORCEINLINE const Value* Find(const Key& k, KeyValueComparator&& comp) const
+		{
+			const Node* node = rootNode;
+			while (node)
+			{
+				int d = comp(node->value, k);
+				if (d > 0)
+					node = node->Left();
+				else if (d < 0)
+					node = node->right;
+				else
+					return &node->value;
+			}
+			return NULL;
+		}
+		FORCEINLINE size_t Count(void) const
+		{
+			return count;
+		}
+		DKCompactAVLTree& operator = (DKCompactAVLTree&& tree)
+		{
+			if (this != &tree)
+			{
+				Clear();
+
+				rootNode = tree.rootNode;
+				count = tree.count;
+				tree.rootNode = NULL;
+				tree.count = 0;
+			}
+			return *this;
+		}
+		DKCompactAVLTree& operator = (const DKCompactAVLTree& s)
+		{
+			if (this == &s)	return *this;
+
+			Clear();
+
+			if (s.rootNode)
+				rootNode = s.rootNode->Duplicate();
+			count = s.count;
+			return *this;
+		}
+		// lambda enumerator bool (const VALUE&, bool*)
+		template <typename T> void EnumerateForward(T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			if (count > 0)
+			{
+				bool stop = false;
+				auto func = [=, &enumerator](const Value& v) mutable -> bool {enumerator(v, &stop); return stop;};
+				rootNode->EnumerateForward(func);
+			}
+		}
+		template <typename T> void EnumerateBackward(T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			if (count > 0)
+			{
+				bool stop = false;
+				auto func = [=, &enumerator](const Value& v) mutable -> bool {enumerator(v, &stop); return stop;};
+				rootNode->EnumerateBackward(func);
+			}
+		}
+	private:
+		void DeleteNode(Node* node)
+		{
+			if (node->right)
+				DeleteNode(node->right);
+			if (node->Left())
+				DeleteNode(node->Left());
+
+			count--;
+
+			(*node).~Node();
+			Allocator::Free(node);
+		}
+		// rotate left-heavy (balance -2) sub-tree and return new root.
+		// 'shrunk' is true if height of sub-tree decreased.
+		FORCEINLINE static Node* RotateLeftHeavy(Node* node, bool* shrunk)
+		{
+			Node* left = node->Left();
+			int b = left->Balance();
+			if (b <= 0)
+			{
+				// right-rotate with 'node'
+				node->SetLeft(left->right);
+				left->right = node;
+				node->SetBalance(b ? 0 : -1);
+				left->SetBalance(b ? 0 : 1);
+				*shrunk = b != 0;
+				return left;
+			}
+			// left-rotate with 'node->left' and right-rotate with 'node'
+			Node* pivot = left->right;
+			int b2 = pivot->Balance();
+			left->right = pivot->Left();
+			node->SetLeft(pivot->right);
+			pivot->SetLeft(left);
+			pivot->right = node;
+			node->SetBalance(b2 < 0 ? 1 : 0);
+			left->SetBalance(b2 > 0 ? -1 : 0);
+			pivot->SetBalance(0);
+			*shrunk = true;
+			return pivot;
+		}
+		// rotate right-heavy (balance +2) sub-tree and return new root.
+		FORCEINLINE static Node* RotateRightHeavy(Node* node, bool* shrunk)
+		{
+			Node* right = node->right;
+			int b = right->Balance();
+			if (b >= 0)
+			{
+				// left-rotate with 'node'
+				node->right = right->Left();
+				right->SetLeft(node);
+				node->SetBalance(b ? 0 : 1);
+				right->SetBalance(b ? 0 : -1);
+				*shrunk = b != 0;
+				return right;
+			}
+			// right-rotate with 'node->right' and left-rotate with 'node'
+			Node* pivot = right->Left();
+			int b2 = pivot->Balance();
+			right->SetLeft(pivot->right);
+			node->right = pivot->Left();
+			pivot->SetLeft(node);
+			pivot->right = right;
+			node->SetBalance(b2 > 0 ? -1 : 0);
+			right->SetBalance(b2 < 0 ? 1 : 0);
+			pivot->SetBalance(0);
+			*shrunk = true;
+			return pivot;
+		}
+		// left sub-tree height decreased, 'shrunk' is true if node's height decreased.
+		FORCEINLINE static Node* LeftShrunk(Node* node, bool* shrunk)
+		{
+			int b = node->Balance();
+			if (b < 0)
+				node->SetBalance(0);
+			else if (b == 0)
+			{
+				node->SetBalance(1);
+				*shrunk = false;
+			}
+			else
+				node = RotateRightHeavy(node, shrunk);
+			return node;
+		}
+		// right sub-tree height decreased, 'shrunk' is true if node's height decreased.
+		FORCEINLINE static Node* RightShrunk(Node* node, bool* shrunk)
+		{
+			int b = node->Balance();
+			if (b > 0)
+				node->SetBalance(0);
+			else if (b == 0)
+			{
+				node->SetBalance(-1);
+				*shrunk = false;
+			}
+			else
+				node = RotateLeftHeavy(node, shrunk);
+			return node;
+		}
+		struct LocationContext
+		{
+			const Value* value;
+			Node* locatedNode;
+			bool created;
+			bool heightChanged;	// sub-tree height increased (insertion) or decreased (removal)
+			Node* takenNode;
+		};
+		// locate node for value. (create if not exists)
+		// returns sub-tree root after balancing.
+		Node* InsertNode(Node* node, LocationContext* ctxt)
+		{
+			if (node == NULL)
+			{
+				count++;
+				ctxt->locatedNode = new(Allocator::Alloc(sizeof(Node))) Node(*ctxt->value);
+				ctxt->created = true;
+				ctxt->heightChanged = true;
+				return ctxt->locatedNode;
+			}
+			int cmp = comparator(node->value, *ctxt->value);
+			if (cmp > 0)
+			{
+				node->SetLeft(InsertNode(node->Left(), ctxt));
+				if (ctxt->heightChanged)
+				{
+					int b = node->Balance();
+					if (b < 0)
+					{
+						bool shrunk;
+						node = RotateLeftHeavy(node, &shrunk);
+						ctxt->heightChanged = false;
+					}
+					else
+					{
+						node->SetBalance(b - 1);
+						ctxt->heightChanged = (b == 0);
+					}
+				}
+			}
+			else if (cmp < 0)
+			{
+				node->right = InsertNode(node->right, ctxt);
+				if (ctxt->heightChanged)
+				{
+					int b = node->Balance();
+					if (b > 0)
+					{
+						bool shrunk;
+						node = RotateRightHeavy(node, &shrunk);
+						ctxt->heightChanged = false;
+					}
+					else
+					{
+						node->SetBalance(b + 1);
+						ctxt->heightChanged = (b == 0);
+					}
+				}
+			}
+			else
+			{
+				ctxt->locatedNode = node;
+				ctxt->heightChanged = false;
+			}
+			return node;
+		}
+		// take out left-most node from sub-tree into 'takenNode'.
+		Node* TakeOutLeftMostNode(Node* node, LocationContext* ctxt)
+		{
+			if (node->Left())
+			{
+				node->SetLeft(TakeOutLeftMostNode(node->Left(), ctxt));
+				if (ctxt->heightChanged)
+					node = LeftShrunk(node, &ctxt->heightChanged);
+				return node;
+			}
+			ctxt->takenNode = node;
+			ctxt->heightChanged = true;
+			return node->right;
+		}
+		// find item and take out from tree, returns sub-tree root after balancing.
+		template <typename Key, typename KeyComparator>
+		Node* RemoveNode(Node* node, const Key& key, KeyComparator& comp, LocationContext* ctxt)
+		{
+			int cmp = comp(node->value, key);
+			if (cmp > 0)
+			{
+				if (node->Left())
+				{
+					node->SetLeft(RemoveNode(node->Left(), key, comp, ctxt));
+					if (ctxt->heightChanged)
+						node = LeftShrunk(node, &ctxt->heightChanged);
+				}
+			}
+			else if (cmp < 0)
+			{
+				if (node->right)
+				{
+					node->right = RemoveNode(node->right, key, comp, ctxt);
+					if (ctxt->heightChanged)
+						node = RightShrunk(node, &ctxt->heightChanged);
+				}
+			}
+			else
+			{
+				ctxt->locatedNode = node;
+				Node* left = node->Left();
+				if (left && node->right)
+				{
+					// replace with smallest node of right sub-tree.
+					Node* right = TakeOutLeftMostNode(node->right, ctxt);
+					Node* replace = ctxt->takenNode;
+					replace->leftAndBalance = node->leftAndBalance;
+					replace->right = right;
+					if (ctxt->heightChanged)
+						replace = RightShrunk(replace, &ctxt->heightChanged);
+					return replace;
+				}
+				ctxt->heightChanged = true;
+				return left ? left : node->right;
+			}
+			return node;
+		}
+public:
+		Node*			rootNode;
+		size_t			count;
+		Comparator		comparator;
+		Replacer		replacer;
+	};
+}
@@ -0,0 +1,951 @@
+//
+//  File: DKConcurrentAVLTree.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <new>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include "DKAVLTree.h"
+#include "DKEpochReclaimer.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// DKConcurrentAVLTree
+// concurrent AVL tree with optimistic hand-over-hand validation.
+// (N. G. Bronson, J. Casper, H. Chafi, K. Olukotun:
+//  A Practical Concurrent Binary Search Tree, PPoPP 2010)
+//
+// Find does not lock, it validates version of each node while descending
+// and retries from parent if sub-tree was shrunk by rotation or unlinked.
+// Insert, Update, Remove lock only nodes which are modified, rebalancing is
+// relaxed and done with parent, node and child locked. (bottom to up)
+// Removed node which has two children remains as routing node (not present)
+// and it will be unlinked later when it has less than two children.
+// Unlinked nodes are reclaimed by DKEpochReclaimer.
+//
+// Note:
+//  All functions are thread-safe except Clear and destructor.
+//  Value should be trivially copyable, value is copied out with per-node
+//  sequence validation. Update should not change ordering of value.
+//  Node keeps immutable copy of value inserted first for ordering (key),
+//  searching threads compare key only, not value being written.
+//  Count is not atomic with modification. (approximate while modifying)
+//  Enumeration is not atomic, values are visited in order, but values
+//  modified while enumerating can be missed.
+//  Allocator should be thread-safe.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace DKFoundation
+{
+	template <
+		typename Value,										// value-type
+		typename Key,										// key-type (Lookup key)
+		typename ValueComparator = DKTreeComparison<Value, Value>,	// value comparison
+		typename KeyComparator = DKTreeComparison<Value, Key>,	// value, key comparison (lookup only)
+		typename Allocator = DKMemoryDefaultAllocator		// memory allocator
+	>
+	class DKConcurrentAVLTree
+	{
+		static_assert(std::is_trivially_copyable<Value>::value, "Value must be trivially copyable.");
+
+		struct Node;
+		// links of node, root holder has no value.
+		struct NodeBase
+		{
+			NodeBase(NodeBase* parentNode)
+			: parent(parentNode), left(NULL), right(NULL), version(0), height(1), present(false), locked(false)
+			{
+			}
+			std::atomic<NodeBase*>	parent;
+			std::atomic<Node*>		left;
+			std::atomic<Node*>		right;
+			std::atomic<uint64_t>	version;	// shrink count, Shrinking, Unlinked
+			std::atomic<int>		height;
+			std::atomic<bool>		present;	// false if routing node
+			std::atomic<bool>		locked;
+
+			FORCEINLINE std::atomic<Node*>& Child(int cmp)	// cmp: node compared to key
+			{
+				return cmp > 0 ? left : right;
+			}
+			FORCEINLINE const std::atomic<Node*>& Child(int cmp) const
+			{
+				return cmp > 0 ? left : right;
+			}
+			FORCEINLINE void Lock(void)
+			{
+				for (int spin = 0; locked.exchange(true, std::memory_order_acquire); )
+				{
+					while (locked.load(std::memory_order_relaxed))
+						Pause(spin);
+				}
+			}
+			FORCEINLINE void Unlock(void)
+			{
+				locked.store(false, std::memory_order_release);
+			}
+		};
+		struct Node : public NodeBase
+		{
+			Node(const Value& v, NodeBase* parentNode) : NodeBase(parentNode), key(v), value(v), valueVersion(0)
+			{
+				this->present.store(true, std::memory_order_relaxed);
+			}
+			const Value key;	// ordering, not modified after construction. (search path)
+			Value value;		// payload, modified by Update. (sequence validated)
+			std::atomic<unsigned int> valueVersion;	// odd while value is being written.
+		};
+
+		// version of node
+		enum : uint64_t
+		{
+			Unlinked = 1,
+			Shrinking = 2,
+			VersionIncrement = 4,
+		};
+		// result of node condition
+		enum : int
+		{
+			UnlinkRequired = -1,
+			RebalanceRequired = -2,
+			NothingRequired = -3,
+		};
+		// result of attempt
+		enum Result
+		{
+			Retry,
+			NotFound,
+			Found,
+			Created,
+			Updated,
+			Removed,
+		};
+
+	public:
+		constexpr static size_t NodeSize(void)	{ return sizeof(Node); }
+
+		DKConcurrentAVLTree(void)
+		: rootHolder(NULL)
+		{
+			for (Counter& c : counters)
+				c.value.store(0, std::memory_order_relaxed);
+		}
+		~DKConcurrentAVLTree(void)
+		{
+			Clear();
+		}
+		// Update: insertion if not exist or overwrite if exists.
+		//  returns true if value inserted.
+		bool Update(const Value& v)
+		{
+			DKEpochReclaimer::Guard guard;
+			Result r;
+			while ((r = AttemptPut(v, &rootHolder, -1, 0, true)) == Retry) {}
+			if (r == Created)
+				AddCount(1);
+			return r == Created;
+		}
+		// Insert: insert if not exist or fail if exists.
+		//  returns false if function failed. (already exists)
+		bool Insert(const Value& v)
+		{
+			DKEpochReclaimer::Guard guard;
+			Result r;
+			while ((r = AttemptPut(v, &rootHolder, -1, 0, false)) == Retry) {}
+			if (r == Created)
+				AddCount(1);
+			return r == Created;
+		}
+		// Remove: returns true if value removed.
+		bool Remove(const Key& k)
+		{
+			DKEpochReclaimer::Guard guard;
+			Result r;
+			while ((r = AttemptRemove(k, &rootHolder, -1, 0)) == Retry) {}
+			if (r == Removed)
+				AddCount(-1);
+			return r == Removed;
+		}
+		// Find: value is copied to 'value' if found and 'value' is not NULL.
+		bool Find(const Key& k, Value* value = NULL) const
+		{
+			DKEpochReclaimer::Guard guard;
+			const Node* node;
+			while (AttemptGet(k, &rootHolder, -1, 0, &node) == Retry) {}
+			return node && ReadValue(node, value);
+		}
+		// remove all values, should not be called while other threads use tree.
+		void Clear(void)
+		{
+			DeleteNodes(rootHolder.right.load(std::memory_order_relaxed));
+			rootHolder.right.store(NULL, std::memory_order_relaxed);
+			for (Counter& c : counters)
+				c.value.store(0, std::memory_order_relaxed);
+		}
+		size_t Count(void) const
+		{
+			ptrdiff_t count = 0;
+			for (const Counter& c : counters)
+				count += c.value.load(std::memory_order_relaxed);
+			return count > 0 ? (size_t)count : 0;
+		}
+		// lambda enumerator (const VALUE&, bool*)
+		template <typename T> void EnumerateForward(T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			DKEpochReclaimer::Guard guard;
+			const Node* last = NULL;
+			bool stop = false;
+			EnumerateNodes(rootHolder.right.load(), enumerator, std::true_type(), &last, &stop);
+		}
+		template <typename T> void EnumerateBackward(T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			DKEpochReclaimer::Guard guard;
+			const Node* last = NULL;
+			bool stop = false;
+			EnumerateNodes(rootHolder.right.load(), enumerator, std::false_type(), &last, &stop);
+		}
+
+		DKConcurrentAVLTree(const DKConcurrentAVLTree&) = delete;
+		DKConcurrentAVLTree& operator = (const DKConcurrentAVLTree&) = delete;
+
+	private:
+		FORCEINLINE static void Pause(int& spin)
+		{
+			if (++spin < 64)
+			{
+#if defined(__i386__) || defined(__x86_64__)
+				__builtin_ia32_pause();
+#endif
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+		FORCEINLINE static int Height(const Node* node)
+		{
+			return node ? node->height.load(std::memory_order_relaxed) : 0;
+		}
+		FORCEINLINE static bool IsShrinkingOrUnlinked(uint64_t version)
+		{
+			return (version & (Shrinking | Unlinked)) != 0;
+		}
+		FORCEINLINE static uint64_t BeginShrink(uint64_t version)
+		{
+			return version | Shrinking;
+		}
+		FORCEINLINE static uint64_t EndShrink(uint64_t version)
+		{
+			return version + VersionIncrement;
+		}
+		static void WaitUntilNotShrinking(const NodeBase* node)
+		{
+			for (int spin = 0; node->version.load() & Shrinking; )
+				Pause(spin);
+		}
+		static void DeleteNode(void* p)
+		{
+			Node* node = reinterpret_cast<Node*>(p);
+			node->~Node();
+			Allocator::Free(node);
+		}
+		static void DeleteNodes(Node* node)
+		{
+			if (node)
+			{
+				DeleteNodes(node->left.load(std::memory_order_relaxed));
+				DeleteNodes(node->right.load(std::memory_order_relaxed));
+				DeleteNode(node);
+			}
+		}
+		// copy value with sequence validation, returns false if not present.
+		static bool ReadValue(const Node* node, Value* value)
+		{
+			for (int spin = 0; ; )
+			{
+				unsigned int seq = node->valueVersion.load(std::memory_order_acquire);
+				if (seq & 1)
+				{
+					Pause(spin);
+					continue;
+				}
+				bool present = node->present.load(std::memory_order_acquire);
+				if (present && value)
+					memcpy(value, &node->value, sizeof(Value));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (node->valueVersion.load(std::memory_order_relaxed) == seq)
+					return present;
+			}
+		}
+		// node should be locked.
+		static void WriteValue(Node* node, const Value& v)
+		{
+			unsigned int seq = node->valueVersion.load(std::memory_order_relaxed);
+			node->valueVersion.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			memcpy(&node->value, &v, sizeof(Value));
+			node->present.store(true, std::memory_order_relaxed);
+			node->valueVersion.store(seq + 2, std::memory_order_release);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////
+		// optimistic search, 'node' is validated with 'nodeVersion'.
+		Result AttemptGet(const Key& k, const NodeBase* node, int dir, uint64_t nodeVersion, const Node** result) const
+		{
+			while (true)
+			{
+				const Node* child = node->Child(dir).load();
+				if (child == NULL)
+				{
+					if (node->version.load() != nodeVersion)
+						return Retry;
+					*result = NULL;
+					return NotFound;
+				}
+				int childCmp = keyComparator(child->key, k);
+				if (childCmp == 0)
+				{
+					*result = child;
+					return Found;
+				}
+				uint64_t childVersion = child->version.load();
+				if (IsShrinkingOrUnlinked(childVersion))
+				{
+					WaitUntilNotShrinking(child);
+					if (node->version.load() != nodeVersion)
+						return Retry;
+				}
+				else if (child != node->Child(dir).load())
+				{
+					if (node->version.load() != nodeVersion)
+						return Retry;
+				}
+				else
+				{
+					if (node->version.load() != nodeVersion)
+						return Retry;
+					Result r = AttemptGet(k, child, childCmp, childVersion, result);
+					if (r != Retry)
+						return r;
+				}
+			}
+		}
+		Result AttemptPut(const Value& v, NodeBase* node, int dir, uint64_t nodeVersion, bool overwrite)
+		{
+			while (true)
+			{
+				Node* child = node->Child(dir).load();
+				if (node->version.load() != nodeVersion)
+					return Retry;
+				if (child == NULL)
+				{
+					node->Lock();
+					if (node->version.load() != nodeVersion)
+					{
+						node->Unlock();
+						return Retry;
+					}
+					if (node->Child(dir).load() != NULL)
+					{
+						node->Unlock();
+						continue;
+					}
+					node->Child(dir).store(new(Allocator::Alloc(sizeof(Node))) Node(v, node));
+					NodeBase* damaged = FixHeight(node);
+					node->Unlock();
+					FixHeightAndRebalance(damaged);
+					return Created;
+				}
+				int childCmp = valueComparator(child->key, v);
+				if (childCmp == 0)
+				{
+					Result r = AttemptNodeUpdate(child, v, overwrite);
+					if (r != Retry)
+						return r;
+					continue;
+				}
+				uint64_t childVersion = child->version.load();
+				if (IsShrinkingOrUnlinked(childVersion))
+				{
+					WaitUntilNotShrinking(child);
+				}
+				else if (child == node->Child(dir).load())
+				{
+					if (node->version.load() != nodeVersion)
+						return Retry;
+					Result r = AttemptPut(v, child, childCmp, childVersion, overwrite);
+					if (r != Retry)
+						return r;
+				}
+			}
+		}
+		Result AttemptNodeUpdate(Node* node, const Value& v, bool overwrite)
+		{
+			node->Lock();
+			if (node->version.load() == Unlinked)
+			{
+				node->Unlock();
+				return Retry;
+			}
+			bool present = node->present.load();
+			if (present && !overwrite)
+			{
+				node->Unlock();
+				return Found;
+			}
+			WriteValue(node, v);
+			node->Unlock();
+			return present ? Updated : Created;
+		}
+		Result AttemptRemove(const Key& k, NodeBase* node, int dir, uint64_t nodeVersion)
+		{
+			while (true)
+			{
+				Node* child = node->Child(dir).load();
+				if (node->version.load() != nodeVersion)
+					return Retry;
+				if (child == NULL)
+					return NotFound;
+				int childCmp = keyComparator(child->key, k);
+				if (childCmp == 0)
+				{
+					Result r = AttemptRemoveNode(node, child);
+					if (r != Retry)
+						return r;
+					continue;
+				}
+				uint64_t childVersion = child->version.load();
+				if (IsShrinkingOrUnlinked(childVersion))
+				{
+					WaitUntilNotShrinking(child);
+				}
+				else if (child == node->Child(dir).load())
+				{
+					if (node->version.load() != nodeVersion)
+						return Retry;
+					Result r = AttemptRemove(k, child, childCmp, childVersion);
+					if (r != Retry)
+						return r;
+				}
+			}
+		}
+		Result AttemptRemoveNode(NodeBase* parent, Node* node)
+		{
+			if (!node->present.load())
+				return NotFound;
+
+			if (node->left.load() == NULL || node->right.load() == NULL)
+			{
+				// node can be unlinked, lock parent first.
+				parent->Lock();
+				if (parent->version.load() == Unlinked || node->parent.load() != parent)
+				{
+					parent->Unlock();
+					return Retry;
+				}
+				node->Lock();
+				if (!node->present.load())
+				{
+					node->Unlock();
+					parent->Unlock();
+					return NotFound;
+				}
+				if (!AttemptUnlink(parent, node))
+				{
+					node->Unlock();
+					parent->Unlock();
+					return Retry;
+				}
+				node->Unlock();
+				NodeBase* damaged = FixHeight(parent);
+				parent->Unlock();
+				FixHeightAndRebalance(damaged);
+				return Removed;
+			}
+			// node has two children, node becomes routing node.
+			node->Lock();
+			if (node->version.load() == Unlinked)
+			{
+				node->Unlock();
+				return Retry;
+			}
+			if (!node->present.load())
+			{
+				node->Unlock();
+				return NotFound;
+			}
+			if (node->left.load() == NULL || node->right.load() == NULL)
+			{
+				node->Unlock();
+				return Retry;		// node can be unlinked now.
+			}
+			node->present.store(false);
+			node->Unlock();
+			return Removed;
+		}
+		// parent, node should be locked.
+		bool AttemptUnlink(NodeBase* parent, Node* node)
+		{
+			Node* parentLeft = parent->left.load();
+			Node* parentRight = parent->right.load();
+			if (parentLeft != node && parentRight != node)
+				return false;
+
+			Node* left = node->left.load();
+			Node* right = node->right.load();
+			if (left && right)
+				return false;
+
+			Node* splice = left ? left : right;
+			if (parentLeft == node)
+				parent->left.store(splice);
+			else
+				parent->right.store(splice);
+			if (splice)
+				splice->parent.store(parent);
+
+			node->version.store(Unlinked);
+			node->present.store(false);
+			DKEpochReclaimer::Retire(node, DeleteNode);
+			return true;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////
+		// relaxed balancing
+		static int NodeCondition(NodeBase* node)
+		{
+			Node* left = node->left.load();
+			Node* right = node->right.load();
+			if ((left == NULL || right == NULL) && !node->present.load())
+				return UnlinkRequired;
+
+			int h = node->height.load(std::memory_order_relaxed);
+			int hL = Height(left);
+			int hR = Height(right);
+			int hRepl = 1 + std::max(hL, hR);
+			int d = hL - hR;
+			if (d < -1 || d > 1)
+				return RebalanceRequired;
+			return h != hRepl ? hRepl : NothingRequired;
+		}
+		// node should be locked, returns node which should be fixed next.
+		static NodeBase* FixHeight(NodeBase* node)
+		{
+			int c = NodeCondition(node);
+			switch (c)
+			{
+			case UnlinkRequired:
+			case RebalanceRequired:
+				return node;
+			case NothingRequired:
+				return NULL;
+			default:
+				node->height.store(c, std::memory_order_relaxed);
+				return node->parent.load();
+			}
+		}
+		void FixHeightAndRebalance(NodeBase* node)
+		{
+			std::vector<NodeBase*> deferred;
+			while (true)
+			{
+				int c = NothingRequired;
+				if (node && node->parent.load() && node->version.load() != Unlinked)
+					c = NodeCondition(node);
+				if (c == NothingRequired)
+				{
+					if (deferred.empty())
+						return;
+					node = deferred.back();
+					deferred.pop_back();
+				}
+				else if (c != UnlinkRequired && c != RebalanceRequired)
+				{
+					NodeBase* locked = node;
+					locked->Lock();
+					node = FixHeight(locked);
+					locked->Unlock();
+				}
+				else
+				{
+					NodeBase* parent = node->parent.load();
+					parent->Lock();
+					if (parent->version.load() != Unlinked && node->parent.load() == parent)
+					{
+						NodeBase* pending = NULL;
+						Node* locked = static_cast<Node*>(node);
+						locked->Lock();
+						node = Rebalance(parent, locked, &pending);
+						locked->Unlock();
+						if (pending)
+							deferred.push_back(pending);
+					}
+					parent->Unlock();
+				}
+			}
+		}
+		// parent, node should be locked.
+		NodeBase* Rebalance(NodeBase* parent, Node* node, NodeBase** pending)
+		{
+			Node* left = node->left.load();
+			Node* right = node->right.load();
+			if ((left == NULL || right == NULL) && !node->present.load())
+			{
+				if (AttemptUnlink(parent, node))
+					return FixHeight(parent);
+				return node;
+			}
+			int h = node->height.load(std::memory_order_relaxed);
+			int hL = Height(left);
+			int hR = Height(right);
+			int hRepl = 1 + std::max(hL, hR);
+			int d = hL - hR;
+			if (d > 1)
+				return RebalanceToRight(parent, node, left, hR, pending);
+			else if (d < -1)
+				return RebalanceToLeft(parent, node, right, hL, pending);
+			else if (hRepl != h)
+			{
+				node->height.store(hRepl, std::memory_order_relaxed);
+				return FixHeight(parent);
+			}
+			return NULL;
+		}
+		NodeBase* RebalanceToRight(NodeBase* parent, Node* node, Node* left, int hR, NodeBase** pending)
+		{
+			NodeBase* damaged = node;
+			left->Lock();
+			int hL = left->height.load(std::memory_order_relaxed);
+			if (hL - hR > 1)
+			{
+				Node* leftRight = left->right.load();
+				int hLL = Height(left->left.load());
+				int hLR = Height(leftRight);
+				if (hLL >= hLR)
+				{
+					damaged = RotateRight(parent, node, left, hR, hLL, leftRight, hLR, pending);
+				}
+				else
+				{
+					leftRight->Lock();
+					hLR = leftRight->height.load(std::memory_order_relaxed);
+					if (hLL >= hLR)
+					{
+						damaged = RotateRight(parent, node, left, hR, hLL, leftRight, hLR, pending);
+						leftRight->Unlock();
+					}
+					else
+					{
+						int hLRL = Height(leftRight->left.load());
+						int d = hLL - hLRL;
+						if (d >= -1 && d <= 1)
+						{
+							damaged = RotateRightOverLeft(parent, node, left, hR, hLL, leftRight, hLRL, pending);
+							leftRight->Unlock();
+						}
+						else
+						{
+							// fix left first, node will be balanced later.
+							leftRight->Unlock();
+							damaged = RebalanceToLeft(node, left, leftRight, hLL, pending);
+						}
+					}
+				}
+			}
+			left->Unlock();
+			return damaged;
+		}
+		NodeBase* RebalanceToLeft(NodeBase* parent, Node* node, Node* right, int hL, NodeBase** pending)
+		{
+			NodeBase* damaged = node;
+			right->Lock();
+			int hR = right->height.load(std::memory_order_relaxed);
+			if (hL - hR < -1)
+			{
+				Node* rightLeft = right->left.load();
+				int hRL = Height(rightLeft);
+				int hRR = Height(right->right.load());
+				if (hRR >= hRL)
+				{
+					damaged = RotateLeft(parent, node, hL, right, rightLeft, hRL, hRR, pending);
+				}
+				else
+				{
+					rightLeft->Lock();
+					hRL = rightLeft->height.load(std::memory_order_relaxed);
+					if (hRR >= hRL)
+					{
+						damaged = RotateLeft(parent, node, hL, right, rightLeft, hRL, hRR, pending);
+						rightLeft->Unlock();
+					}
+					else
+					{
+						int hRLR = Height(rightLeft->right.load());
+						int d = hRR - hRLR;
+						if (d >= -1 && d <= 1)
+						{
+							damaged = RotateLeftOverRight(parent, node, hL, right, rightLeft, hRR, hRLR, pending);
+							rightLeft->Unlock();
+						}
+						else
+						{
+							// fix right first, node will be balanced later.
+							rightLeft->Unlock();
+							damaged = RebalanceToRight(node, right, rightLeft, hRR, pending);
+						}
+					}
+				}
+			}
+			right->Unlock();
+			return damaged;
+		}
+		// 'node' should be fixed first, parent of rotated sub-tree is fixed now
+		// and remaining damage of parent is fixed later.
+		static NodeBase* DeferParent(NodeBase* parent, NodeBase* node, NodeBase** pending)
+		{
+			*pending = FixHeight(parent);
+			return node;
+		}
+		// rotations: links from shrinking node are changed first, links to
+		// shrinking node are changed last. (searching thread should see version
+		// changed if it missed sub-tree)
+		NodeBase* RotateRight(NodeBase* parent, Node* node, Node* left, int hR, int hLL, Node* leftRight, int hLR, NodeBase** pending)
+		{
+			uint64_t nodeVersion = node->version.load();
+			Node* parentLeft = parent->left.load();
+
+			node->version.store(BeginShrink(nodeVersion));
+
+			node->left.store(leftRight);
+			if (leftRight)
+				leftRight->parent.store(node);
+			left->right.store(node);
+			node->parent.store(left);
+			if (parentLeft == node)
+				parent->left.store(left);
+			else
+				parent->right.store(left);
+			left->parent.store(parent);
+
+			int hNRepl = 1 + std::max(hLR, hR);
+			node->height.store(hNRepl, std::memory_order_relaxed);
+			left->height.store(1 + std::max(hLL, hNRepl), std::memory_order_relaxed);
+
+			node->version.store(EndShrink(nodeVersion));
+
+			// fix damaged nodes as many as possible with locks we have.
+			int dN = hLR - hR;
+			if (dN < -1 || dN > 1)
+				return DeferParent(parent, node, pending);
+			if ((leftRight == NULL || hR == 0) && !node->present.load())
+				return DeferParent(parent, node, pending);
+			int dL = hLL - hNRepl;
+			if (dL < -1 || dL > 1)
+				return DeferParent(parent, left, pending);
+			if (hLL == 0 && !left->present.load())
+				return DeferParent(parent, left, pending);
+			return FixHeight(parent);
+		}
+		NodeBase* RotateLeft(NodeBase* parent, Node* node, int hL, Node* right, Node* rightLeft, int hRL, int hRR, NodeBase** pending)
+		{
+			uint64_t nodeVersion = node->version.load();
+			Node* parentLeft = parent->left.load();
+
+			node->version.store(BeginShrink(nodeVersion));
+
+			node->right.store(rightLeft);
+			if (rightLeft)
+				rightLeft->parent.store(node);
+			right->left.store(node);
+			node->parent.store(right);
+			if (parentLeft == node)
+				parent->left.store(right);
+			else
+				parent->right.store(right);
+			right->parent.store(parent);
+
+			int hNRepl = 1 + std::max(hL, hRL);
+			node->height.store(hNRepl, std::memory_order_relaxed);
+			right->height.store(1 + std::max(hNRepl, hRR), std::memory_order_relaxed);
+
+			node->version.store(EndShrink(nodeVersion));
+
+			int dN = hRL - hL;
+			if (dN < -1 || dN > 1)
+				return DeferParent(parent, node, pending);
+			if ((rightLeft == NULL || hL == 0) && !node->present.load())
+				return DeferParent(parent, node, pending);
+			int dR = hRR - hNRepl;
+			if (dR < -1 || dR > 1)
+				return DeferParent(parent, right, pending);
+			if (hRR == 0 && !right->present.load())
+				return DeferParent(parent, right, pending);
+			return FixHeight(parent);
+		}
+		NodeBase* RotateRightOverLeft(NodeBase* parent, Node* node, Node* left, int hR, int hLL, Node* leftRight, int hLRL, NodeBase** pending)
+		{
+			uint64_t nodeVersion = node->version.load();
+			uint64_t leftVersion = left->version.load();
+			Node* parentLeft = parent->left.load();
+			Node* leftRightLeft = leftRight->left.load();
+			Node* leftRightRight = leftRight->right.load();
+			int hLRR = Height(leftRightRight);
+
+			node->version.store(BeginShrink(nodeVersion));
+			left->version.store(BeginShrink(leftVersion));
+
+			node->left.store(leftRightRight);
+			if (leftRightRight)
+				leftRightRight->parent.store(node);
+			left->right.store(leftRightLeft);
+			if (leftRightLeft)
+				leftRightLeft->parent.store(left);
+			leftRight->left.store(left);
+			left->parent.store(leftRight);
+			leftRight->right.store(node);
+			node->parent.store(leftRight);
+			if (parentLeft == node)
+				parent->left.store(leftRight);
+			else
+				parent->right.store(leftRight);
+			leftRight->parent.store(parent);
+
+			int hNRepl = 1 + std::max(hLRR, hR);
+			node->height.store(hNRepl, std::memory_order_relaxed);
+			int hLRepl = 1 + std::max(hLL, hLRL);
+			left->height.store(hLRepl, std::memory_order_relaxed);
+			leftRight->height.store(1 + std::max(hLRepl, hNRepl), std::memory_order_relaxed);
+
+			node->version.store(EndShrink(nodeVersion));
+			left->version.store(EndShrink(leftVersion));
+
+			// routing node with one child is unlinked, leftRight is locked.
+			bool unlinked = (hLL == 0 || hLRL == 0) && !left->present.load() && AttemptUnlink(leftRight, left);
+
+			int dN = hLRR - hR;
+			if (dN < -1 || dN > 1)
+				return DeferParent(parent, node, pending);
+			if ((leftRightRight == NULL || hR == 0) && !node->present.load())
+				return DeferParent(parent, node, pending);
+			if (unlinked)
+				return FixHeight(leftRight) == leftRight ? DeferParent(parent, leftRight, pending) : FixHeight(parent);
+			int dLR = hLRepl - hNRepl;
+			if (dLR < -1 || dLR > 1)
+				return DeferParent(parent, leftRight, pending);
+			return FixHeight(parent);
+		}
+		NodeBase* RotateLeftOverRight(NodeBase* parent, Node* node, int hL, Node* right, Node* rightLeft, int hRR, int hRLR, NodeBase** pending)
+		{
+			uint64_t nodeVersion = node->version.load();
+			uint64_t rightVersion = right->version.load();
+			Node* parentLeft = parent->left.load();
+			Node* rightLeftLeft = rightLeft->left.load();
+			Node* rightLeftRight = rightLeft->right.load();
+			int hRLL = Height(rightLeftLeft);
+
+			node->version.store(BeginShrink(nodeVersion));
+			right->version.store(BeginShrink(rightVersion));
+
+			node->right.store(rightLeftLeft);
+			if (rightLeftLeft)
+				rightLeftLeft->parent.store(node);
+			right->left.store(rightLeftRight);
+			if (rightLeftRight)
+				rightLeftRight->parent.store(right);
+			rightLeft->right.store(right);
+			right->parent.store(rightLeft);
+			rightLeft->left.store(node);
+			node->parent.store(rightLeft);
+			if (parentLeft == node)
+				parent->left.store(rightLeft);
+			else
+				parent->right.store(rightLeft);
+			rightLeft->parent.store(parent);
+
+			int hNRepl = 1 + std::max(hL, hRLL);
+			node->height.store(hNRepl, std::memory_order_relaxed);
+			int hRRepl = 1 + std::max(hRLR, hRR);
+			right->height.store(hRRepl, std::memory_order_relaxed);
+			rightLeft->height.store(1 + std::max(hNRepl, hRRepl), std::memory_order_relaxed);
+
+			node->version.store(EndShrink(nodeVersion));
+			right->version.store(EndShrink(rightVersion));
+
+			// routing node with one child is unlinked, rightLeft is locked.
+			bool unlinked = (hRR == 0 || hRLR == 0) && !right->present.load() && AttemptUnlink(rightLeft, right);
+
+			int dN = hRLL - hL;
+			if (dN < -1 || dN > 1)
+				return DeferParent(parent, node, pending);
+			if ((rightLeftLeft == NULL || hL == 0) && !node->present.load())
+				return DeferParent(parent, node, pending);
+			if (unlinked)
+				return FixHeight(rightLeft) == rightLeft ? DeferParent(parent, rightLeft, pending) : FixHeight(parent);
+			int dRL = hRRepl - hNRepl;
+			if (dRL < -1 || dRL > 1)
+				return DeferParent(parent, rightLeft, pending);
+			return FixHeight(parent);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////
+		// in-order traversal, skips values which are not ordered after last one.
+		template <typename T, bool Forward>
+		bool EnumerateNodes(const Node* node, T& enumerator, std::integral_constant<bool, Forward>, const Node** last, bool* stop) const
+		{
+			if (node == NULL)
+				return false;
+
+			const Node* first = Forward ? node->left.load() : node->right.load();
+			const Node* second = Forward ? node->right.load() : node->left.load();
+			if (EnumerateNodes(first, enumerator, std::integral_constant<bool, Forward>(), last, stop))
+				return true;
+
+			int cmp = *last ? valueComparator(node->key, (*last)->key) : (Forward ? 1 : -1);
+			if (Forward ? cmp > 0 : cmp < 0)
+			{
+				typename std::aligned_storage<sizeof(Value), alignof(Value)>::type buffer;
+				Value* value = reinterpret_cast<Value*>(&buffer);
+				if (ReadValue(node, value))
+				{
+					*last = node;
+					enumerator(*value, stop);
+					if (*stop)
+						return true;
+				}
+			}
+			return EnumerateNodes(second, enumerator, std::integral_constant<bool, Forward>(), last, stop);
+		}
+
+		void AddCount(ptrdiff_t n)
+		{
+			static std::atomic<size_t> numThreads(0);
+			static thread_local size_t index = numThreads.fetch_add(1, std::memory_order_relaxed);
+			counters[index % NumCounters].value.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		// count is distributed to reduce contention.
+		enum { NumCounters = 16 };
+		struct Counter
+		{
+			std::atomic<ptrdiff_t> value;
+			unsigned char padding[64 - sizeof(std::atomic<ptrdiff_t>)];
+		};
+
+		NodeBase		rootHolder;		// tree is right child of rootHolder.
+		Counter			counters[NumCounters];
+		ValueComparator	valueComparator;
+		KeyComparator	keyComparator;
+	};
+}
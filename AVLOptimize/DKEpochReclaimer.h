@@ -0,0 +1,250 @@
+//
+//  File: DKEpochReclaimer.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+////////////////////////////////////////////////////////////////////////////////
+// DKEpochReclaimer
+// epoch based memory reclamation for lock-free readers. (process-wide)
+//
+// Object which is unlinked from shared structure can still be accessed by
+// other threads which read it's pointer before unlinked. Retired object is
+// deleted after all threads leave critical sections (Guard) entered before
+// object was retired. (global epoch advanced twice)
+//
+// Usage:
+//  DKEpochReclaimer::Guard guard;		// enter critical section
+//  ... access shared objects ...
+//  DKEpochReclaimer::Retire(obj, deleter);	// after unlinked
+//
+// Note:
+//  Guard can be nested, objects are not deleted while any thread is in
+//  critical section which entered before retired.
+//  deleter is called on any thread which calls Retire or Reclaim.
+//  Objects retired by exited thread are moved to shared list.
+//  Objects are not deleted at process exit, call Reclaim(true) before
+//  allocator of objects destroyed.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace DKFoundation
+{
+	class DKEpochReclaimer
+	{
+		struct ThreadRecord;
+	public:
+		using Deleter = void (*)(void*);
+
+		// critical section of current thread.
+		class Guard
+		{
+		public:
+			Guard(void) : record(CurrentRecord())
+			{
+				if (record->nesting++ == 0)
+				{
+					// publish epoch before any shared object accessed.
+					uint64_t epoch = GetDomain().epoch.load(std::memory_order_seq_cst);
+					record->epoch.store((epoch << 1) | ActiveFlag, std::memory_order_seq_cst);
+				}
+			}
+			~Guard(void)
+			{
+				if (--record->nesting == 0)
+					record->epoch.store(0, std::memory_order_release);
+			}
+			Guard(const Guard&) = delete;
+			Guard& operator = (const Guard&) = delete;
+		private:
+			ThreadRecord* record;
+		};
+
+		// retire object, object should be unlinked already.
+		static void Retire(void* p, Deleter deleter)
+		{
+			ThreadRecord* record = CurrentRecord();
+			uint64_t epoch = GetDomain().epoch.load(std::memory_order_seq_cst);
+			record->retired.push_back({ p, deleter, epoch });
+			if (record->retired.size() - record->reclaimed >= ReclaimThreshold)
+			{
+				TryAdvance();
+				ReclaimRecord(record);
+			}
+		}
+		// delete objects which can be reclaimed, returns number of objects deleted.
+		// if wait is true, waits until all retired objects of current thread and
+		// exited threads are deleted. (current thread should not be in Guard)
+		static size_t Reclaim(bool wait = false)
+		{
+			ThreadRecord* record = CurrentRecord();
+			Domain& domain = GetDomain();
+			size_t numReclaimed = 0;
+			uint64_t target = domain.epoch.load(std::memory_order_seq_cst) + 2;
+			do
+			{
+				if (!TryAdvance() && wait)
+					std::this_thread::yield();
+				numReclaimed += ReclaimRecord(record);
+				numReclaimed += ReclaimOrphans();
+			} while (wait && domain.epoch.load(std::memory_order_seq_cst) < target);
+			if (wait)
+			{
+				numReclaimed += ReclaimRecord(record);
+				numReclaimed += ReclaimOrphans();
+			}
+			return numReclaimed;
+		}
+		// number of retired objects which are not deleted yet.
+		// (current thread and exited threads)
+		static size_t NumberOfPendingObjects(void)
+		{
+			ThreadRecord* record = CurrentRecord();
+			Domain& domain = GetDomain();
+			std::lock_guard<std::mutex> guard(domain.orphanLock);
+			return record->retired.size() - record->reclaimed + domain.orphans.size();
+		}
+
+	private:
+		enum : uint64_t { ActiveFlag = 1 };
+		enum : size_t { ReclaimThreshold = 128 };
+
+		struct RetiredObject
+		{
+			void* object;
+			Deleter deleter;
+			uint64_t epoch;
+		};
+		using RetiredList = std::vector<RetiredObject>;
+
+		struct ThreadRecord
+		{
+			ThreadRecord(void) : epoch(0), inUse(true), next(NULL), nesting(0), reclaimed(0) {}
+			std::atomic<uint64_t> epoch;	// (epoch << 1) | ActiveFlag while in Guard
+			std::atomic<bool> inUse;
+			ThreadRecord* next;
+			unsigned int nesting;
+			RetiredList retired;			// ordered by epoch
+			size_t reclaimed;				// number of deleted objects at front
+			unsigned char padding[64];		// prevent false-sharing with other records.
+		};
+		struct Domain
+		{
+			Domain(void) : epoch(2), records(NULL) {}
+			std::atomic<uint64_t> epoch;
+			std::atomic<ThreadRecord*> records;	// records are reused, never deleted.
+			std::mutex orphanLock;
+			RetiredList orphans;			// retired objects of exited threads.
+		};
+		// release record when thread exits.
+		struct RecordOwner
+		{
+			RecordOwner(void) : record(AcquireRecord()) {}
+			~RecordOwner(void)
+			{
+				Domain& domain = GetDomain();
+				{
+					std::lock_guard<std::mutex> guard(domain.orphanLock);
+					domain.orphans.insert(domain.orphans.end(), record->retired.begin() + record->reclaimed, record->retired.end());
+				}
+				record->retired.clear();
+				record->reclaimed = 0;
+				record->inUse.store(false, std::memory_order_release);
+			}
+			ThreadRecord* record;
+		};
+
+		static Domain& GetDomain(void)
+		{
+			static Domain* domain = new Domain();	// not deleted, objects can be retired at exit.
+			return *domain;
+		}
+		static ThreadRecord* CurrentRecord(void)
+		{
+			static thread_local RecordOwner owner;
+			return owner.record;
+		}
+		static ThreadRecord* AcquireRecord(void)
+		{
+			Domain& domain = GetDomain();
+			for (ThreadRecord* r = domain.records.load(std::memory_order_acquire); r; r = r->next)
+			{
+				bool expected = false;
+				if (!r->inUse.load(std::memory_order_relaxed) &&
+					r->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+					return r;
+			}
+			ThreadRecord* record = new ThreadRecord();
+			ThreadRecord* head = domain.records.load(std::memory_order_relaxed);
+			do {
+				record->next = head;
+			} while (!domain.records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+			return record;
+		}
+		// advance global epoch if all threads in Guard observed current epoch.
+		static bool TryAdvance(void)
+		{
+			Domain& domain = GetDomain();
+			uint64_t epoch = domain.epoch.load(std::memory_order_seq_cst);
+			for (ThreadRecord* r = domain.records.load(std::memory_order_acquire); r; r = r->next)
+			{
+				uint64_t e = r->epoch.load(std::memory_order_seq_cst);
+				if ((e & ActiveFlag) && (e >> 1) != epoch)
+					return false;
+			}
+			return domain.epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+		}
+		// objects retired two epochs ago can not be accessed by current thread,
+		// even if current thread is in Guard. (Guard entered after retired)
+		static size_t ReclaimRecord(ThreadRecord* record)
+		{
+			return ReclaimList(record->retired, record->reclaimed);
+		}
+		// delete objects retired at least two epochs ago.
+		static size_t ReclaimList(RetiredList& list, size_t& reclaimed)
+		{
+			uint64_t epoch = GetDomain().epoch.load(std::memory_order_seq_cst);
+			size_t num = 0;
+			for (; reclaimed < list.size() && list[reclaimed].epoch + 2 <= epoch; ++reclaimed, ++num)
+				list[reclaimed].deleter(list[reclaimed].object);
+
+			if (reclaimed == list.size())
+			{
+				list.clear();
+				reclaimed = 0;
+			}
+			else if (reclaimed > list.size() / 2)
+			{
+				list.erase(list.begin(), list.begin() + reclaimed);
+				reclaimed = 0;
+			}
+			return num;
+		}
+		// orphans are merged from many threads, not ordered by epoch.
+		static size_t ReclaimOrphans(void)
+		{
+			Domain& domain = GetDomain();
+			std::lock_guard<std::mutex> guard(domain.orphanLock);
+			uint64_t epoch = domain.epoch.load(std::memory_order_seq_cst);
+			size_t num = domain.orphans.size();
+			auto it = std::remove_if(domain.orphans.begin(), domain.orphans.end(), [epoch](const RetiredObject& r)
+			{
+				if (r.epoch + 2 <= epoch)
+				{
+					r.deleter(r.object);
+					return true;
+				}
+				return false;
+			});
+			domain.orphans.erase(it, domain.orphans.end());
+			return num - domain.orphans.size();
+		}
+	};
+}
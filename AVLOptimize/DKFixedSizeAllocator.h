@@ -7,6 +7,14 @@
 
 #pragma once
 #include <algorithm>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
 //#include "../DKinclude.h"
 //#include "DKAllocator.h"
 //#include "DKMemory.h"
@@ -18,16 +26,93 @@
 // DKFixedSizeAllocator
 // an allocator which can allocate memory of fixed length.
 // it is useful to template collection classes like DKMap, DKSet.
+//
+// AlignedChunk: chunk is allocated at address aligned to chunk size (power
+//  of two) with small header, chunk of unit is found by masking address.
+//  Dealloc is O(1) and chunk table is not sorted. UnitAllocator should
+//  provide AlignedAlloc(size, alignment), AlignedFree(ptr, size).
+//  (DKMemoryAlignedAllocator, DKMemoryMappedAllocator)
+//  ConditionalDealloc, AlignedChunkAddress scan chunk table (O(number of
+//  chunks)), header can not be read, given address can be allocated from
+//  other allocator.
+//
+// Units of chunk are linked lazily, large chunk (multi-megabytes) is not
+// touched until units are used. With DKMemoryMappedAllocator and large
+// chunk, Reserve maps whole pool in few regions backed by huge pages.
+//
+// Statistics: snapshot of chunk occupancy and counters (alloc, dealloc,
+//  purge, peak, cached chunk hit/miss). can be used to size Reserve and
+//  to choose threshold of ConditionalPurge.
 ////////////////////////////////////////////////////////////////////////////////
 
+// spin lock, for short critical sections (chunk table update)
 struct DKSpinLock
 {
-	void Lock() {}
-	void Unlock() {}
+	DKSpinLock(void) : locked(false) {}
+	void Lock(void) const
+	{
+		for (int spin = 0; !TryLock(); )
+		{
+			// wait without writing cache line until lock released.
+			while (locked.load(std::memory_order_relaxed))
+			{
+				if (++spin < 64)
+				{
+#if defined(__i386__) || defined(__x86_64__)
+					__builtin_ia32_pause();
+#endif
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+	}
+	bool TryLock(void) const
+	{
+		return !locked.load(std::memory_order_relaxed) &&
+			!locked.exchange(true, std::memory_order_acquire);
+	}
+	void Unlock(void) const
+	{
+		locked.store(false, std::memory_order_release);
+	}
+	DKSpinLock(const DKSpinLock&) = delete;
+	DKSpinLock& operator = (const DKSpinLock&) = delete;
+private:
+	mutable std::atomic<bool> locked;
+};
+// mutex, blocks thread if contended.
+struct DKMutex
+{
+	void Lock(void) const		{ mutex.lock(); }
+	bool TryLock(void) const	{ return mutex.try_lock(); }
+	void Unlock(void) const		{ mutex.unlock(); }
+private:
+	mutable std::mutex mutex;
+};
+// no lock, for single thread or externally locked object.
+struct DKDummyLock
+{
+	void Lock(void) const {}
+	bool TryLock(void) const { return true; }
+	void Unlock(void) const {}
 };
 template <typename T> struct DKCriticalSection
 {
-	DKCriticalSection(const T&) {}
+	DKCriticalSection(const T& lockObject) : lock(lockObject)
+	{
+		lock.Lock();
+	}
+	~DKCriticalSection(void)
+	{
+		lock.Unlock();
+	}
+	DKCriticalSection(const DKCriticalSection&) = delete;
+	DKCriticalSection& operator = (const DKCriticalSection&) = delete;
+private:
+	const T& lock;
 };
 
 struct DKAllocator {};
@@ -46,25 +131,108 @@ enum DKMemoryLocation
 
 namespace DKFoundation
 {
+	// unit allocator which can allocate chunk aligned to it's size.
+	struct DKMemoryAlignedAllocator
+	{
+		static void* Alloc(size_t s)	{ return ::malloc(s); }
+		static void Free(void* p)		{ ::free(p); }
+		static void* AlignedAlloc(size_t s, size_t alignment)
+		{
+			void* p = NULL;
+			if (::posix_memalign(&p, alignment, s) == 0)
+				return p;
+			return NULL;
+		}
+		static void AlignedFree(void* p, size_t)	{ ::free(p); }
+	};
+	// unit allocator for aligned chunk, chunk is mapped from system.
+	// transparent huge pages are used if available. (chunk should be 2MB or larger)
+	struct DKMemoryMappedAllocator
+	{
+		static void* AlignedAlloc(size_t s, size_t alignment)
+		{
+			size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+			s = (s + pageSize - 1) & ~(pageSize - 1);
+			alignment = std::max(alignment, pageSize);
+
+			// map more than required, and unmap unaligned head and tail.
+			size_t length = s + alignment - pageSize;
+			void* p = ::mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+			if (p == MAP_FAILED)
+				return NULL;
+			uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+			uintptr_t aligned = (addr + alignment - 1) & ~(uintptr_t)(alignment - 1);
+			if (aligned > addr)
+				::munmap(p, aligned - addr);
+			if (addr + length > aligned + s)
+				::munmap(reinterpret_cast<void*>(aligned + s), addr + length - (aligned + s));
+#ifdef MADV_HUGEPAGE
+			::madvise(reinterpret_cast<void*>(aligned), s, MADV_HUGEPAGE);
+#endif
+			return reinterpret_cast<void*>(aligned);
+		}
+		static void AlignedFree(void* p, size_t s)
+		{
+			size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+			::munmap(p, (s + pageSize - 1) & ~(pageSize - 1));
+		}
+	};
+
+	constexpr size_t DKPowerOfTwoCeil(size_t n, size_t p = 1)
+	{
+		return p < n ? DKPowerOfTwoCeil(n, p << 1) : p;
+	}
+
+	// statistics snapshot of DKFixedSizeAllocator. (see Statistics)
+	//  counters are accumulated since allocator was created.
+	struct DKFixedSizeAllocatorStatistics
+	{
+		enum { NumOccupancyBins = 8 };
+
+		size_t unitSize;			// aligned unit size
+		size_t unitsPerChunk;
+		size_t chunkSize;			// bytes of chunk (units and header)
+
+		size_t numChunks;
+		size_t emptyChunks;
+		size_t partialChunks;
+		size_t fullChunks;
+		size_t peakChunks;
+		// non-empty chunks by occupancy, bin i: occupied ratio in (i/8, (i+1)/8]
+		size_t occupancy[NumOccupancyBins];
+
+		size_t numAllocated;		// units in use
+		size_t peakAllocated;
+		size_t bytesReserved;		// chunks and chunk table
+		size_t bytesInUse;			// units in use
+		size_t peakBytesReserved;	// chunks at peak
+
+		size_t allocCount;
+		size_t deallocCount;		// includes units released by DeallocAll
+		size_t purgeCount;			// purges which released chunks
+		size_t purgedChunks;
+		size_t cacheHits;			// allocated from cached chunk
+		size_t cacheMisses;			// allocated from other chunk or new chunk
+	};
+
 	template <
 		unsigned int UnitSize,				// allocation size (fixed size)
 		unsigned int Alignment = 1,			// byte alignment
 		unsigned int MaxUnits = 1024,			// max units per chunk
 		typename Lock = DKSpinLock,
 		typename BaseAllocator = DKMemoryDefaultAllocator, // info table allocator. (small)
-		typename UnitAllocator = DKMemoryDefaultAllocator  // unit chunk allocator. (large)
+		typename UnitAllocator = DKMemoryDefaultAllocator, // unit chunk allocator. (large)
+		bool AlignedChunk = false				// chunk aligned to it's size, O(1) Dealloc
 	>
 	class DKFixedSizeAllocator
 	{
-		template <unsigned int, unsigned int, unsigned int, typename, typename, typename>
+		template <unsigned int, unsigned int, unsigned int, typename, typename, typename, bool>
 			friend class DKFixedSizeAllocator;
 		static_assert(UnitSize > 0, "Size must be greater than zero.");
 		static_assert(MaxUnits > 1, "MaxUnits must be greater than one.");
 		static_assert(Alignment > 0, "Alignment must be greater than zero.");
 		static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be power of two.");
 
-		// maximum number of units per chunk.
-		enum : unsigned int { MaxUnitsPerChunk = MaxUnits };
 		enum : unsigned int { AlignedUnitSize = (UnitSize + (Alignment - 1)) & ~(Alignment - 1) };
 		union Unit
 		{
@@ -73,15 +241,37 @@ namespace DKFoundation
 		};
 		static_assert((sizeof(Unit) % Alignment) == 0, "Invalid unit alignment");
 
+		// header of aligned chunk, located in front of units.
+		struct ChunkHeader
+		{
+			size_t index;	// index of chunk in chunk table.
+		};
+		enum : size_t { ChunkHeaderSize = AlignedChunk ? (sizeof(ChunkHeader) + Alignment - 1) & ~(size_t)(Alignment - 1) : 0 };
+
+		// size of chunk, aligned chunk is power of two and filled with units.
+		enum : size_t { ChunkSize = AlignedChunk ? DKPowerOfTwoCeil(ChunkHeaderSize + sizeof(Unit) * MaxUnits) : sizeof(Unit) * MaxUnits };
+
+		// maximum number of units per chunk.
+		enum : unsigned int { MaxUnitsPerChunk = (ChunkSize - ChunkHeaderSize) / sizeof(Unit) };
+
+		// partial chunks (not full) are linked by occupancy class,
+		// chunk of fullest class is used first when cached chunk is full.
+		enum : unsigned int { NumOccupancyClasses = 8 };
+
 		using Index = unsigned int;
 		enum : Index { EndOfUnits = (Index)-1 };
+		enum : Index { NullChunk = (Index)-1 };
+		static_assert((Index)MaxUnitsPerChunk < (Index)EndOfUnits, "Too many units per chunk.");
 
 		struct ChunkInfo
 		{
 			uintptr_t address;
 			Index freeUnitIndex;
-			unsigned short offset;
-			unsigned short occupied;
+			Index offset;
+			Index occupied;
+			Index initialized;	// units after this index are not linked. (unused)
+			Index prevPartial;	// links of partial chunk list (index)
+			Index nextPartial;
 		};
 
 		// size of all units per chunk.
@@ -92,13 +282,13 @@ namespace DKFoundation
 		template <unsigned int BaseAlignment> struct _RebindAlignment
 		{
 			enum { AlignedUnitSize = UnitSize + ((UnitSize % BaseAlignment) ? (BaseAlignment - (UnitSize % BaseAlignment)) : 0) };
-			using Allocator = DKFixedSizeAllocator < AlignedUnitSize, BaseAlignment, MaxUnits, Lock, BaseAllocator, UnitAllocator > ;
+			using Allocator = DKFixedSizeAllocator < AlignedUnitSize, BaseAlignment, MaxUnits, Lock, BaseAllocator, UnitAllocator, AlignedChunk > ;
 		};
 
 	public:
 		enum { FixedLength = UnitSize };
 		enum { BaseAlignment = Alignment };
-		enum { AlignedChunkSize = MaxUnitsPerChunkSize + Alignment - 1 };
+		enum { AlignedChunkSize = AlignedChunk ? ChunkSize : MaxUnitsPerChunkSize + Alignment - 1 };
 
 		template <unsigned int Align>
 		using RebindAlignment = typename _RebindAlignment<Align>::Allocator;
@@ -123,78 +313,7 @@ namespace DKFoundation
 				return NULL;
 
 			CriticalSection guard(lock);
-
-			if (cachedChunk && cachedChunk->occupied < MaxUnitsPerChunk)
-			{
-				uintptr_t ptr = AllocUnit(cachedChunk);
-				DKASSERT_MEM_DEBUG(ptr);
-				return reinterpret_cast<void*>(ptr);
-			}
-			// find unoccupied unit from each chunks.
-			for (size_t i = 0; i < numChunks; ++i)
-			{
-				if (chunkTable[i].occupied < MaxUnitsPerChunk)
-				{
-					cachedChunk = &chunkTable[i];
-					uintptr_t ptr = AllocUnit(cachedChunk);
-					DKASSERT_MEM_DEBUG(ptr);
-					return reinterpret_cast<void*>(ptr);
-				}
-			}
-			// no space, create new chunk.
-			cachedChunk = NULL;
-			if (numChunks > 0)
-			{
-				ChunkInfo* table = (ChunkInfo*)BaseAllocator::Realloc(chunkTable, sizeof(ChunkInfo) * (numChunks + 1));
-				if (table == NULL) // out of memory!
-					return NULL;
-				chunkTable = table;
-
-				ChunkInfo chunk;
-				if (!AllocChunk(&chunk))
-					return NULL;	// out of memory!
-
-				uintptr_t pos = reinterpret_cast<uintptr_t>(
-															std::upper_bound(&chunkTable[0], &chunkTable[numChunks], chunk.address,
-																			 [](uintptr_t lhs, const ChunkInfo& rhs)
-																			 {
-																				 return lhs < rhs.address;
-																			 }));
-				size_t chunkIndex = (pos - reinterpret_cast<uintptr_t>(&chunkTable[0])) / sizeof(ChunkInfo);
-
-				if (chunkIndex < numChunks)
-				{
-#if 1
-					memmove(&chunkTable[chunkIndex + 1], &chunkTable[chunkIndex], sizeof(ChunkInfo) * (numChunks - chunkIndex));
-#else
-					for (size_t i = numChunks; i > chunkIndex; --i)
-						chunkTable[i] = chunkTable[i-1];
-#endif
-				}
-				chunkTable[chunkIndex] = chunk;
-				cachedChunk = &chunkTable[chunkIndex];
-			}
-			else
-			{
-				chunkTable = (ChunkInfo*)BaseAllocator::Alloc(sizeof(ChunkInfo) * (numChunks + 1));
-				if (chunkTable == NULL)
-					return NULL; // out of memory!
-
-				cachedChunk = &chunkTable[numChunks];
-				if (!AllocChunk(cachedChunk)) // out of memory!
-				{
-					BaseAllocator::Free(chunkTable);
-					chunkTable = NULL;
-					cachedChunk = NULL;
-					return NULL;
-				}
-			}
-			DKASSERT_MEM_DEBUG(cachedChunk);
-			numChunks++;
-
-			uintptr_t ptr = AllocUnit(cachedChunk);
-			DKASSERT_MEM_DEBUG(ptr);
-			return reinterpret_cast<void*>(ptr);
+			return AllocInternal();
 		}
 
 		void Dealloc(void* ptr)
@@ -202,7 +321,7 @@ namespace DKFoundation
 			if (ptr)
 			{
 				CriticalSection guard(lock);
-				if (FindChunkAndDealloc(reinterpret_cast<uintptr_t>(ptr)))
+				if (FindChunkAndDealloc(reinterpret_cast<uintptr_t>(ptr), true))
 					return;
 
 				// error: ptr was not allocated from this allocator!
@@ -210,6 +329,33 @@ namespace DKFoundation
 			}
 		}
 
+		// allocate n units with lock acquired once, returns number of units allocated.
+		// (can be less than n if out of memory)
+		size_t AllocBatch(void** units, size_t n)
+		{
+			CriticalSection guard(lock);
+			for (size_t i = 0; i < n; ++i)
+			{
+				units[i] = AllocInternal();
+				if (units[i] == NULL)
+					return i;
+			}
+			return n;
+		}
+
+		// deallocate n units with lock acquired once.
+		void DeallocBatch(void* const* units, size_t n)
+		{
+			CriticalSection guard(lock);
+			for (size_t i = 0; i < n; ++i)
+			{
+				if (units[i] && FindChunkAndDealloc(reinterpret_cast<uintptr_t>(units[i]), true))
+					continue;
+				// error: ptr was not allocated from this allocator!
+				DKASSERT_MEM_DESC_DEBUG(units[i] == NULL, "Given address was not allocated from this allocator!");
+			}
+		}
+
 		bool ConditionalDealloc(void* ptr)
 		{
 			if (ptr)
@@ -217,7 +363,7 @@ namespace DKFoundation
 				CriticalSection guard(lock);
 				if (numChunks > 0)
 				{
-					return FindChunkAndDealloc(reinterpret_cast<uintptr_t>(ptr));
+					return FindChunkAndDealloc(reinterpret_cast<uintptr_t>(ptr), false);
 				}
 			}
 			return false;
@@ -230,7 +376,7 @@ namespace DKFoundation
 				CriticalSection guard(lock);
 				if (numChunks > 0)
 				{
-					if (FindChunkAndDealloc(reinterpret_cast<uintptr_t>(ptr)))
+					if (FindChunkAndDealloc(reinterpret_cast<uintptr_t>(ptr), false))
 					{
 						if (this->emptyChunks > 0)
 						{
@@ -276,10 +422,10 @@ namespace DKFoundation
 				CriticalSection guard(lock);
 				if (numChunksRequired > numChunks)
 				{
-					ChunkInfo* table = (ChunkInfo*)BaseAllocator::Realloc(chunkTable, sizeof(ChunkInfo) * numChunksRequired);
-					if (table)
+					// table can be moved, save cached chunk's address.
+					uintptr_t cachedAddr = cachedChunk ? cachedChunk->address : 0;
+					if (ReserveChunkTable(numChunksRequired))
 					{
-						chunkTable = table;
 						for (size_t i = numChunks; i < numChunksRequired; ++i)
 						{
 							if (!AllocChunk(&chunkTable[i]))
@@ -287,15 +433,21 @@ namespace DKFoundation
 								// out of memory!
 								break;
 							}
+							SetChunkIndex(&chunkTable[i], i);
 							numChunks++;
 						}
+						if (numChunks > peakChunks)
+							peakChunks = numChunks;
 						if (numChunks > 0)
 						{
 							// save last chunk's address.
 							uintptr_t addr = chunkTable[numChunks-1].address;
-							SortChunkTable();
+							if (!AlignedChunk)
+								SortChunkTable();
+							RebuildPartialChunks();
+							cachedChunk = cachedAddr ? FindOwnedChunkInfo(cachedAddr) : NULL;
 							if (cachedChunk == NULL || cachedChunk->occupied == MaxUnitsPerChunk)
-								cachedChunk = FindChunkInfo(addr);
+								cachedChunk = FindOwnedChunkInfo(addr);
 							DKASSERT_MEM_DEBUG(cachedChunk != NULL);
 						}
 					}
@@ -324,10 +476,27 @@ namespace DKFoundation
 			return PurgeInternal();
 		}
 
+		// deallocate all units at once without visiting, O(number of chunks).
+		//  chunks are kept for reuse (see Purge), objects are not destroyed.
+		void DeallocAll(void)
+		{
+			CriticalSection guard(lock);
+			for (size_t i = 0; i < numChunks; ++i)
+			{
+				chunkTable[i].freeUnitIndex = EndOfUnits;
+				chunkTable[i].initialized = 0;
+				chunkTable[i].occupied = 0;
+			}
+			deallocCount += numAllocated;
+			numAllocated = 0;
+			emptyChunks = numChunks;
+			RebuildPartialChunks();
+		}
+
 		size_t Size(void) const
 		{
 			CriticalSection guard(lock);
-			return numChunks * (MaxUnitsPerChunkSize + sizeof(ChunkInfo));
+			return numChunks * (ChunkSize + sizeof(ChunkInfo));
 		}
 
 		size_t NumberOfAllocatedUnits(void) const
@@ -336,13 +505,64 @@ namespace DKFoundation
 			return numAllocated;
 		}
 
+		// statistics snapshot, chunk table is scanned. O(number of chunks)
+		//  counters are updated with lock acquired, no extra synchronization.
+		DKFixedSizeAllocatorStatistics Statistics(void) const
+		{
+			DKFixedSizeAllocatorStatistics st = {};
+			CriticalSection guard(lock);
+			st.unitSize = sizeof(Unit);
+			st.unitsPerChunk = MaxUnitsPerChunk;
+			st.chunkSize = ChunkSize;
+			st.numChunks = numChunks;
+			for (size_t i = 0; i < numChunks; ++i)
+			{
+				size_t occupied = chunkTable[i].occupied;
+				if (occupied == 0)
+					st.emptyChunks++;
+				else
+				{
+					if (occupied < MaxUnitsPerChunk)
+						st.partialChunks++;
+					else
+						st.fullChunks++;
+					st.occupancy[(occupied * st.NumOccupancyBins - 1) / MaxUnitsPerChunk]++;
+				}
+			}
+			st.peakChunks = peakChunks;
+			st.numAllocated = numAllocated;
+			st.peakAllocated = peakAllocated;
+			st.bytesReserved = numChunks * ChunkSize + tableCapacity * sizeof(ChunkInfo);
+			st.bytesInUse = numAllocated * sizeof(Unit);
+			st.peakBytesReserved = peakChunks * ChunkSize;
+			st.allocCount = allocCount;
+			st.deallocCount = deallocCount;
+			st.purgeCount = purgeCount;
+			st.purgedChunks = purgedChunks;
+			st.cacheHits = cacheHits;
+			st.cacheMisses = cacheMisses;
+			return st;
+		}
+
 		DKFixedSizeAllocator(void)
 			: chunkTable(NULL)
 			, cachedChunk(NULL)
 			, numAllocated(0)
 			, numChunks(0)
+			, tableCapacity(0)
 			, emptyChunks(0)
+			, partialClasses(0)
+			, peakChunks(0)
+			, peakAllocated(0)
+			, allocCount(0)
+			, deallocCount(0)
+			, purgeCount(0)
+			, purgedChunks(0)
+			, cacheHits(0)
+			, cacheMisses(0)
 		{
+			for (Index& c : partialChunks)
+				c = NullChunk;
 		}
 
 		~DKFixedSizeAllocator(void) noexcept(!DKGL_MEMORY_DEBUG)
@@ -357,20 +577,124 @@ namespace DKFoundation
 					FreeChunk(&chunkTable[i]);
 				}
 				DKASSERT_MEM_DEBUG(emptyChunks == 0);
-				BaseAllocator::Free(chunkTable);
 			}
+			if (chunkTable)
+				BaseAllocator::Free(chunkTable);
 		}
 
 		DKFixedSizeAllocator(const DKFixedSizeAllocator&) = delete;
 		DKFixedSizeAllocator& operator = (const DKFixedSizeAllocator&) = delete;
 
 	private:
+		// lock should be acquired.
+		void* AllocInternal(void)
+		{
+			if (cachedChunk && cachedChunk->occupied < MaxUnitsPerChunk)
+			{
+				cacheHits++;
+				uintptr_t ptr = AllocUnit(cachedChunk);
+				DKASSERT_MEM_DEBUG(ptr);
+				return reinterpret_cast<void*>(ptr);
+			}
+			cacheMisses++;
+			// find partial chunk, fullest first.
+			if (partialClasses)
+			{
+				unsigned int c = 31 - __builtin_clz(partialClasses);
+				DKASSERT_MEM_DEBUG(partialChunks[c] != NullChunk);
+				cachedChunk = &chunkTable[partialChunks[c]];
+				uintptr_t ptr = AllocUnit(cachedChunk);
+				DKASSERT_MEM_DEBUG(ptr);
+				return reinterpret_cast<void*>(ptr);
+			}
+			// no space, create new chunk.
+			cachedChunk = NULL;
+			if (!ReserveChunkTable(numChunks + 1))
+				return NULL;	// out of memory!
+
+			ChunkInfo chunk;
+			if (!AllocChunk(&chunk))
+				return NULL;	// out of memory!
+
+			size_t chunkIndex = numChunks;
+			if (!AlignedChunk)
+			{
+				// chunk table is sorted by address.
+				uintptr_t pos = reinterpret_cast<uintptr_t>(
+															std::upper_bound(&chunkTable[0], &chunkTable[numChunks], chunk.address,
+																			 [](uintptr_t lhs, const ChunkInfo& rhs)
+																			 {
+																				 return lhs < rhs.address;
+																			 }));
+				chunkIndex = (pos - reinterpret_cast<uintptr_t>(&chunkTable[0])) / sizeof(ChunkInfo);
+
+				if (chunkIndex < numChunks)
+				{
+#if 1
+					memmove(&chunkTable[chunkIndex + 1], &chunkTable[chunkIndex], sizeof(ChunkInfo) * (numChunks - chunkIndex));
+#else
+					for (size_t i = numChunks; i > chunkIndex; --i)
+						chunkTable[i] = chunkTable[i-1];
+#endif
+				}
+			}
+			chunkTable[chunkIndex] = chunk;
+			SetChunkIndex(&chunkTable[chunkIndex], chunkIndex);
+			cachedChunk = &chunkTable[chunkIndex];
+			numChunks++;
+			if (numChunks > peakChunks)
+				peakChunks = numChunks;
+			if (chunkIndex + 1 < numChunks)
+				RebuildPartialChunks();	// table was shifted.
+			else
+				LinkPartialChunk(cachedChunk);
+
+			uintptr_t ptr = AllocUnit(cachedChunk);
+			DKASSERT_MEM_DEBUG(ptr);
+			return reinterpret_cast<void*>(ptr);
+		}
+		// grow chunk table geometrically, chunk table can be moved.
+		bool ReserveChunkTable(size_t n)
+		{
+			if (n > tableCapacity)
+			{
+				size_t capacity = std::max(n, std::max(tableCapacity * 2, (size_t)16));
+				ChunkInfo* table = (ChunkInfo*)BaseAllocator::Realloc(chunkTable, sizeof(ChunkInfo) * capacity);
+				if (table == NULL)
+					return false;
+				chunkTable = table;
+				tableCapacity = capacity;
+			}
+			return true;
+		}
+		FORCEINLINE static void* AllocChunkMemory(std::false_type)
+		{
+			return UnitAllocator::Alloc(AlignedChunkSize);
+		}
+		FORCEINLINE static void* AllocChunkMemory(std::true_type)
+		{
+			return UnitAllocator::AlignedAlloc(ChunkSize, ChunkSize);
+		}
+		FORCEINLINE static void FreeChunkMemory(void* p, std::false_type)
+		{
+			UnitAllocator::Free(p);
+		}
+		FORCEINLINE static void FreeChunkMemory(void* p, std::true_type)
+		{
+			UnitAllocator::AlignedFree(p, ChunkSize);
+		}
 		FORCEINLINE bool AllocChunk(ChunkInfo* info)
 		{
-			uintptr_t ptr = reinterpret_cast<uintptr_t>(UnitAllocator::Alloc(AlignedChunkSize));
+			uintptr_t ptr = reinterpret_cast<uintptr_t>(AllocChunkMemory(std::integral_constant<bool, AlignedChunk>()));
 			if (ptr)
 			{
-				if (ptr % Alignment)
+				if (AlignedChunk)
+				{
+					DKASSERT_MEM_DEBUG((ptr & (ChunkSize - 1)) == 0);
+					info->offset = ChunkHeaderSize;
+					info->address = ptr + ChunkHeaderSize;
+				}
+				else if (ptr % Alignment)
 				{
 					info->offset = Alignment - (ptr % Alignment);
 					info->address = ptr + info->offset;
@@ -381,11 +705,9 @@ namespace DKFoundation
 					info->address = ptr;
 				}
 				DKASSERT_MEM_DEBUG((info->address % Alignment) == 0);
-				Unit* units = reinterpret_cast<Unit*>(info->address);
-				for (unsigned int i = 0, n = MaxUnitsPerChunk - 1; i < n; ++i)
-					units[i].nextUnitIndex = i + 1;
-				units[MaxUnitsPerChunk - 1].nextUnitIndex = EndOfUnits;
-				info->freeUnitIndex = 0;
+				// units are linked lazily, large chunk is not touched until used.
+				info->freeUnitIndex = EndOfUnits;
+				info->initialized = 0;
 				info->occupied = 0;
 				emptyChunks++;
 				return true;
@@ -394,10 +716,9 @@ namespace DKFoundation
 		}
 		FORCEINLINE void FreeChunk(ChunkInfo* info)
 		{
-			DKASSERT_MEM_DEBUG(info->freeUnitIndex != EndOfUnits);
 			DKASSERT_MEM_DEBUG(info->occupied == 0);
 
-			UnitAllocator::Free(reinterpret_cast<void*>(info->address - info->offset));
+			FreeChunkMemory(reinterpret_cast<void*>(info->address - info->offset), std::integral_constant<bool, AlignedChunk>());
 			info->address = 0;
 
 			DKASSERT_MEM_DEBUG(emptyChunks > 0);
@@ -405,11 +726,20 @@ namespace DKFoundation
 		}
 		FORCEINLINE uintptr_t AllocUnit(ChunkInfo* info)
 		{
-			if (info->freeUnitIndex != EndOfUnits)
+			if (info->occupied < MaxUnitsPerChunk)
 			{
 				// chunk has one or more unoccupied units.
-				Unit* unit = &reinterpret_cast<Unit*>(info->address)[info->freeUnitIndex];
-				info->freeUnitIndex = unit->nextUnitIndex;
+				Unit* unit;
+				if (info->freeUnitIndex != EndOfUnits)
+				{
+					unit = &reinterpret_cast<Unit*>(info->address)[info->freeUnitIndex];
+					info->freeUnitIndex = unit->nextUnitIndex;
+				}
+				else
+				{
+					DKASSERT_MEM_DEBUG(info->initialized < MaxUnitsPerChunk);
+					unit = &reinterpret_cast<Unit*>(info->address)[info->initialized++];
+				}
 
 				DKASSERT_MEM_DEBUG((reinterpret_cast<uintptr_t>(unit) % Alignment) == 0);
 
@@ -418,8 +748,17 @@ namespace DKFoundation
 					DKASSERT_MEM_DEBUG(emptyChunks > 0);
 					emptyChunks--;
 				}
+				unsigned int c = OccupancyClass(info->occupied);
 				info->occupied++;
 				numAllocated++;
+				allocCount++;
+				if (numAllocated > peakAllocated)
+					peakAllocated = numAllocated;
+				if (OccupancyClass(info->occupied) != c)
+				{
+					UnlinkPartialChunk(info, c);
+					LinkPartialChunk(info);
+				}
 
 				return reinterpret_cast<uintptr_t>(unit);
 			}
@@ -427,6 +766,8 @@ namespace DKFoundation
 		}
 		bool IsUnitOccupied(ChunkInfo* info, int index) const
 		{
+			if (index >= (int)info->initialized)
+				return false;
 			const Unit* units = reinterpret_cast<const Unit*>(info->address);
 			Index i = info->freeUnitIndex;
 			while (i != EndOfUnits)
@@ -451,13 +792,65 @@ namespace DKFoundation
 			units[index].nextUnitIndex = info->freeUnitIndex;
 			info->freeUnitIndex = index;
 			DKASSERT_MEM_DEBUG(info->occupied > 0);
+			unsigned int c = OccupancyClass(info->occupied);
 			info->occupied--;
+			if (OccupancyClass(info->occupied) != c)
+			{
+				if (c < NumOccupancyClasses)
+					UnlinkPartialChunk(info, c);
+				LinkPartialChunk(info);
+			}
 
 			if (info->occupied == 0)
 				emptyChunks++;
 
 			DKASSERT_MEM_DEBUG(numAllocated > 0);
 			numAllocated--;
+			deallocCount++;
+		}
+		// NumOccupancyClasses if chunk is full.
+		FORCEINLINE static unsigned int OccupancyClass(unsigned int occupied)
+		{
+			return (unsigned int)((unsigned long long)occupied * NumOccupancyClasses / MaxUnitsPerChunk);
+		}
+		FORCEINLINE void LinkPartialChunk(ChunkInfo* info)
+		{
+			unsigned int c = OccupancyClass(info->occupied);
+			if (c < NumOccupancyClasses)
+			{
+				Index index = (Index)(info - chunkTable);
+				info->prevPartial = NullChunk;
+				info->nextPartial = partialChunks[c];
+				if (partialChunks[c] != NullChunk)
+					chunkTable[partialChunks[c]].prevPartial = index;
+				partialChunks[c] = index;
+				partialClasses |= 1U << c;
+			}
+		}
+		FORCEINLINE void UnlinkPartialChunk(ChunkInfo* info, unsigned int c)
+		{
+			if (info->prevPartial != NullChunk)
+			{
+				chunkTable[info->prevPartial].nextPartial = info->nextPartial;
+			}
+			else
+			{
+				DKASSERT_MEM_DEBUG(partialChunks[c] == (Index)(info - chunkTable));
+				partialChunks[c] = info->nextPartial;
+				if (partialChunks[c] == NullChunk)
+					partialClasses &= ~(1U << c);
+			}
+			if (info->nextPartial != NullChunk)
+				chunkTable[info->nextPartial].prevPartial = info->prevPartial;
+		}
+		// relink all chunks, chunk table was moved or reordered.
+		void RebuildPartialChunks(void)
+		{
+			for (Index& c : partialChunks)
+				c = NullChunk;
+			partialClasses = 0;
+			for (size_t i = numChunks; i > 0; --i)
+				LinkPartialChunk(&chunkTable[i - 1]);
 		}
 		FORCEINLINE void SortChunkTable(void)
 		{
@@ -470,8 +863,42 @@ namespace DKFoundation
 						  });
 			}
 		}
+		// store index of chunk to header of aligned chunk.
+		FORCEINLINE void SetChunkIndex(ChunkInfo* info, size_t index)
+		{
+			if (AlignedChunk)
+				reinterpret_cast<ChunkHeader*>(info->address - ChunkHeaderSize)->index = index;
+		}
+		// find chunk of address which was allocated from this allocator.
+		FORCEINLINE ChunkInfo* FindOwnedChunkInfo(uintptr_t addr) const
+		{
+			if (AlignedChunk)
+			{
+				uintptr_t base = addr & ~(uintptr_t)(ChunkSize - 1);
+				size_t index = reinterpret_cast<const ChunkHeader*>(base)->index;
+				DKASSERT_MEM_DEBUG(index < numChunks);
+				DKASSERT_MEM_DEBUG(chunkTable[index].address == base + ChunkHeaderSize);
+				return &chunkTable[index];
+			}
+			return FindChunkInfo(addr);
+		}
 		FORCEINLINE ChunkInfo* FindChunkInfo(uintptr_t addr) const
 		{
+			if (AlignedChunk)
+			{
+				// header can not be read, address can be allocated from other allocator.
+				uintptr_t base = addr & ~(uintptr_t)(ChunkSize - 1);
+				for (size_t i = 0; i < numChunks; ++i)
+				{
+					if (chunkTable[i].address == base + ChunkHeaderSize)
+					{
+						if (addr >= chunkTable[i].address && addr < chunkTable[i].address + MaxUnitsPerChunkSize)
+							return &chunkTable[i];
+						return NULL;
+					}
+				}
+				return NULL;
+			}
 			uintptr_t pos = reinterpret_cast<uintptr_t>(
 														std::upper_bound(&chunkTable[0], &chunkTable[numChunks], addr,
 																		 [](uintptr_t lhs, const ChunkInfo& rhs)
@@ -483,9 +910,9 @@ namespace DKFoundation
 				return &chunkTable[index];
 			return NULL;
 		}
-		FORCEINLINE bool FindChunkAndDealloc(uintptr_t addr)
+		FORCEINLINE bool FindChunkAndDealloc(uintptr_t addr, bool owned)
 		{
-			ChunkInfo* info = FindChunkInfo(addr);
+			ChunkInfo* info = owned ? FindOwnedChunkInfo(addr) : FindChunkInfo(addr);
 			if (info)
 			{
 				FreeUnit(info, addr);
@@ -527,6 +954,7 @@ namespace DKFoundation
 								if (chunkTable[i].address)
 								{
 									table[index] = chunkTable[i];
+									SetChunkIndex(&table[index], index);
 									if (table[index].occupied < MaxUnitsPerChunk)
 									{
 										if (cachedChunk == NULL || cachedChunk->occupied < table[index].occupied)
@@ -538,6 +966,8 @@ namespace DKFoundation
 							BaseAllocator::Free(chunkTable);
 							chunkTable = table;
 							numChunks = availableChunks;
+							tableCapacity = availableChunks;
+							RebuildPartialChunks();
 						}
 						else
 						{
@@ -551,10 +981,17 @@ namespace DKFoundation
 						chunkTable = NULL;
 						cachedChunk = NULL;
 						numChunks = 0;
+						tableCapacity = 0;
+						RebuildPartialChunks();
 					}
 				}
 				DKASSERT_MEM_DEBUG(emptyChunks == 0);
-				return (numChunksPrev - numChunks) * MaxUnitsPerChunkSize;
+				if (numChunksPrev > numChunks)
+				{
+					purgeCount++;
+					purgedChunks += numChunksPrev - numChunks;
+				}
+				return (numChunksPrev - numChunks) * ChunkSize;
 			}
 			return 0;
 		}
@@ -586,7 +1023,85 @@ namespace DKFoundation
 		ChunkInfo* cachedChunk;		// for fast-alloc
 		size_t numAllocated;
 		size_t numChunks;
+		size_t tableCapacity;
 		size_t emptyChunks;
+		Index partialChunks[NumOccupancyClasses];	// head of partial chunk list for each class
+		unsigned int partialClasses;			// bit mask of non-empty classes
+
+		// statistics counters (see Statistics)
+		size_t peakChunks;
+		size_t peakAllocated;
+		size_t allocCount;
+		size_t deallocCount;
+		size_t purgeCount;
+		size_t purgedChunks;
+		size_t cacheHits;
+		size_t cacheMisses;
 		Lock lock;
 	};
+
+	// allocator traits for tree node allocator.
+	//  CanFreeAll: allocator frees all nodes at once (tree-private pool),
+	//  tree with trivially destructible values releases nodes with FreeAll in Clear.
+	//  Alignment: alignment of allocated node, (Allocator::Alignment or
+	//  alignment of malloc if not provided)
+	template <typename Allocator> struct DKTreeAllocatorTraits
+	{
+		template <typename A> static std::true_type Test(decltype(std::declval<A&>().FreeAll())*);
+		template <typename A> static std::false_type Test(...);
+		template <typename A> static std::integral_constant<size_t, A::Alignment> AlignmentOf(int);
+		template <typename A> static std::integral_constant<size_t, alignof(std::max_align_t)> AlignmentOf(...);
+		enum { CanFreeAll = decltype(Test<Allocator>(NULL))::value };
+		enum : size_t { Alignment = decltype(AlignmentOf<Allocator>(0))::value };
+	};
+
+	// DKFixedSizePool
+	// tree-private node pool, used as Allocator of DKAVLTree.
+	//  each tree has own pool (not thread-safe), Free is O(1) with aligned
+	//  chunk and FreeAll releases all nodes at once. (DeallocAll)
+	//  pool is moved with tree, nodes cannot be moved to other tree.
+	template <
+		unsigned int UnitSize,					// node size (NodeSize)
+		unsigned int UnitAlignment = alignof(void*),	// node alignment (NodeAlignment)
+		unsigned int MaxUnits = 1024,			// max units per chunk
+		typename UnitAllocator = DKMemoryAlignedAllocator	// chunk allocator
+	>
+	class DKFixedSizePool
+	{
+	public:
+		using Allocator = DKFixedSizeAllocator<UnitSize, UnitAlignment, MaxUnits, DKDummyLock,
+			DKMemoryDefaultAllocator, UnitAllocator, true>;
+		enum : size_t { Alignment = UnitAlignment };
+
+		DKFixedSizePool(void) : allocator(new Allocator())
+		{
+		}
+		DKFixedSizePool(DKFixedSizePool&& p) : allocator(p.allocator)
+		{
+			p.allocator = NULL;
+		}
+		~DKFixedSizePool(void)
+		{
+			delete allocator;
+		}
+		DKFixedSizePool& operator = (DKFixedSizePool&& p)
+		{
+			std::swap(allocator, p.allocator);
+			return *this;
+		}
+
+		FORCEINLINE void* Alloc(size_t s)	{ return allocator->Alloc(s); }
+		FORCEINLINE void Free(void* p)		{ allocator->Dealloc(p); }
+		FORCEINLINE void FreeAll(void)		{ allocator->DeallocAll(); }
+		void Reserve(size_t n)				{ allocator->Reserve(n); }
+		size_t Purge(void)					{ return allocator->Purge(); }
+		size_t Size(void) const				{ return allocator->Size(); }
+		DKFixedSizeAllocatorStatistics Statistics(void) const	{ return allocator->Statistics(); }
+
+		DKFixedSizePool(const DKFixedSizePool&) = delete;
+		DKFixedSizePool& operator = (const DKFixedSizePool&) = delete;
+
+	private:
+		Allocator* allocator;
+	};
 }
@@ -0,0 +1,421 @@
+//
+//  File: DKFrozenTree.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <new>
+#include <utility>
+#include <type_traits>
+
+////////////////////////////////////////////////////////////////////////////////
+// DKFrozenTree
+// read-only snapshot of tree, items are stored in flat array.
+// snapshot can be created with DKAVLTree::Freeze().
+//
+// Layouts:
+//  Sorted: sorted array, binary search.
+//  Eytzinger: BFS order of complete binary tree. (root at index 1)
+//  VanEmdeBoas: complete binary tree split into recursive blocks, top half
+//   of tree is stored first and bottom sub-trees follow.
+//   (array can be twice of item count, slots of missing leaves are empty.)
+//
+// Searching is branchless, next cache lines are prefetched with Sorted and
+// Eytzinger layout. (van Emde Boas blocks are cache-local by itself)
+//
+// Comparator: three-way comparison function or function object.
+//   (returns negative if value < key, positive if value > key, zero if equal)
+//
+// Note:
+//  items must be supplied in ascending order without duplication.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace DKFoundation
+{
+	enum class DKFrozenTreeLayout
+	{
+		Sorted,
+		Eytzinger,
+		VanEmdeBoas,
+	};
+
+	template <
+		typename Value,
+		typename Allocator = DKMemoryDefaultAllocator
+	>
+	class DKFrozenTree
+	{
+	public:
+		using Layout = DKFrozenTreeLayout;
+		enum { MaxDepth = sizeof(size_t) * 8 };
+		enum { CacheLineSize = 64 };
+
+		DKFrozenTree(void)
+			: buffer(NULL), data(NULL), count(0), layout(Layout::Sorted), height(0)
+		{
+		}
+		// create from sorted items. [first, last)
+		template <typename Iterator>
+		DKFrozenTree(Iterator first, Iterator last, Layout l)
+			: buffer(NULL), data(NULL), count(0), layout(l), height(0)
+		{
+			size_t n = 0;
+			for (Iterator it = first; it != last; ++it)
+				n++;
+			Build(n, [&first]() -> const Value& { return *first++; });
+		}
+		// create with generator, generator() returns item in ascending order.
+		template <typename T>
+		DKFrozenTree(size_t n, Layout l, T&& generator)
+			: buffer(NULL), data(NULL), count(0), layout(l), height(0)
+		{
+			Build(n, std::forward<T>(generator));
+		}
+		DKFrozenTree(DKFrozenTree&& s)
+			: buffer(NULL), data(NULL), count(0), layout(Layout::Sorted), height(0)
+		{
+			MoveFrom(s);
+		}
+		DKFrozenTree(const DKFrozenTree& s)
+			: buffer(NULL), data(NULL), count(0), layout(s.layout), height(0)
+		{
+			InOrder it(s);
+			it.First();
+			Build(s.count, [&s, &it]() -> const Value& { const Value& v = s.data[it.Slot()]; it.Next(); return v; });
+		}
+		~DKFrozenTree(void)
+		{
+			Clear();
+		}
+		DKFrozenTree& operator = (DKFrozenTree&& s)
+		{
+			if (this != &s)
+			{
+				Clear();
+				MoveFrom(s);
+			}
+			return *this;
+		}
+		DKFrozenTree& operator = (const DKFrozenTree& s)
+		{
+			if (this != &s)
+			{
+				DKFrozenTree tmp(s);
+				Clear();
+				MoveFrom(tmp);
+			}
+			return *this;
+		}
+		void Clear(void)
+		{
+			if (!std::is_trivially_destructible<Value>::value)
+			{
+				InOrder it(*this);
+				for (it.First(); it.IsValid(); it.Next())
+					data[it.Slot()].~Value();
+			}
+			if (buffer)
+				Allocator::Free(buffer);
+			buffer = NULL;
+			data = NULL;
+			count = 0;
+			height = 0;
+		}
+		FORCEINLINE size_t Count(void) const			{ return count; }
+		FORCEINLINE Layout GetLayout(void) const		{ return layout; }
+		// bytes of array. (including empty slots)
+		FORCEINLINE size_t Size(void) const			{ return NumberOfSlots(count, layout) * sizeof(Value); }
+
+		template <typename Key, typename KeyValueComparator>
+		FORCEINLINE const Value* Find(const Key& k, KeyValueComparator&& comp) const
+		{
+			const Value* p = LowerBound(k, comp);
+			if (p && comp(*p, k) == 0)
+				return p;
+			return NULL;
+		}
+		// LowerBound: returns first item which is not less than 'k'.
+		//  returns NULL if not exists.
+		template <typename Key, typename KeyValueComparator>
+		const Value* LowerBound(const Key& k, KeyValueComparator&& comp) const
+		{
+			if (count == 0)
+				return NULL;
+			switch (layout)
+			{
+			case Layout::Sorted:
+				{
+					const Value* base = data;
+					size_t n = count;
+					while (n > 1)
+					{
+						size_t half = n / 2;
+						__builtin_prefetch(base + half / 2);
+						__builtin_prefetch(base + half + half / 2);
+						base = (comp(base[half], k) < 0) ? base + half : base;
+						n -= half;
+					}
+					base += (comp(*base, k) < 0);
+					return base < data + count ? base : NULL;
+				}
+			case Layout::Eytzinger:
+				{
+					size_t i = 1;
+					while (i <= count)
+					{
+						__builtin_prefetch(data + i * PrefetchStride());
+						i = 2 * i + (comp(data[i], k) < 0);
+					}
+					// remove right-turns and last left-turn.
+					i >>= CountTrailingOnes(i) + 1;
+					return i ? &data[i] : NULL;
+				}
+			case Layout::VanEmdeBoas:
+				{
+					const Value* bound = NULL;
+					size_t pos[MaxDepth];
+					size_t i = 1;
+					int depth = 0;
+					pos[0] = 0;
+					while (true)
+					{
+						const Value* v = &data[pos[depth]];
+						bool less = comp(*v, k) < 0;
+						bound = less ? bound : v;
+						i = 2 * i + less;
+						if (i > count)
+							break;
+						depth++;
+						pos[depth] = ChildSlot(pos, depth, i);
+					}
+					return bound;
+				}
+			}
+			return NULL;
+		}
+		// lambda enumerator (const VALUE&, bool*)
+		template <typename T> void EnumerateForward(T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			bool stop = false;
+			InOrder it(*this);
+			for (it.First(); it.IsValid() && !stop; it.Next())
+				enumerator(static_cast<const Value&>(data[it.Slot()]), &stop);
+		}
+		// range enumerator (const VALUE&, bool*) for items in range [lo, hi)
+		template <typename Key, typename KeyValueComparator, typename T>
+		void EnumerateRange(const Key& lo, const Key& hi, KeyValueComparator&& comp, T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			bool stop = false;
+			InOrder it(*this);
+			for (it.Seek(lo, comp); it.IsValid() && !stop; it.Next())
+			{
+				const Value& v = data[it.Slot()];
+				if (comp(v, hi) >= 0)
+					break;
+				enumerator(v, &stop);
+			}
+		}
+
+	private:
+		// largest power of two not greater than n (at least 1)
+		constexpr static size_t PowerOfTwoFloor(size_t n)
+		{
+			return n < 2 ? 1 : 2 * PowerOfTwoFloor(n / 2);
+		}
+		// descendants of node at (log2 stride) levels below are in one cache line.
+		constexpr static size_t PrefetchStride(void)
+		{
+			return PowerOfTwoFloor(CacheLineSize / sizeof(Value));
+		}
+
+		FORCEINLINE static int CountTrailingOnes(size_t i)
+		{
+			return __builtin_ctzll(~static_cast<unsigned long long>(i));
+		}
+		static int TreeHeight(size_t n)
+		{
+			int h = 0;
+			for (; n > 0; n >>= 1)
+				h++;
+			return h;
+		}
+		static size_t NumberOfSlots(size_t n, Layout l)
+		{
+			if (n == 0)
+				return 0;
+			switch (l)
+			{
+			case Layout::Sorted:		return n;
+			case Layout::Eytzinger:		return n + 1;		// index 0 is not used.
+			case Layout::VanEmdeBoas:	return (size_t(1) << TreeHeight(n)) - 1;
+			}
+			return 0;
+		}
+		// slot of node 'i' (BFS index) at 'depth', pos[] has slots of ancestors.
+		FORCEINLINE size_t ChildSlot(const size_t* pos, int depth, size_t i) const
+		{
+			if (layout == Layout::Eytzinger)
+				return i;
+			return pos[vebRoot[depth]] + vebTop[depth] + (i & vebTop[depth]) * vebBottom[depth];
+		}
+		// split tree (height 'h' at 'depth') into top and bottom trees.
+		// bottom trees are located after top tree, in order.
+		void PrepareVanEmdeBoas(int depth, int h)
+		{
+			if (h < 2)
+				return;
+			int top = h / 2;
+			int bottom = h - top;
+			int d = depth + top;
+			vebRoot[d] = depth;
+			vebTop[d] = (size_t(1) << top) - 1;
+			vebBottom[d] = (size_t(1) << bottom) - 1;
+			PrepareVanEmdeBoas(depth, top);
+			PrepareVanEmdeBoas(d, bottom);
+		}
+		template <typename T> void Build(size_t n, T&& generator)
+		{
+			if (n == 0)
+				return;
+			size_t slots = NumberOfSlots(n, layout);
+			buffer = Allocator::Alloc(slots * sizeof(Value) + CacheLineSize);
+			uintptr_t addr = reinterpret_cast<uintptr_t>(buffer);
+			data = reinterpret_cast<Value*>((addr + CacheLineSize - 1) & ~uintptr_t(CacheLineSize - 1));
+			count = n;
+			height = TreeHeight(n);
+			if (layout == Layout::VanEmdeBoas)
+				PrepareVanEmdeBoas(0, height);
+
+			InOrder it(*this);
+			for (it.First(); it.IsValid(); it.Next())
+				new(&data[it.Slot()]) Value(generator());
+		}
+		void MoveFrom(DKFrozenTree& s)
+		{
+			buffer = s.buffer;
+			data = s.data;
+			count = s.count;
+			layout = s.layout;
+			height = s.height;
+			for (int i = 0; layout == Layout::VanEmdeBoas && i < height; ++i)
+			{
+				vebRoot[i] = s.vebRoot[i];
+				vebTop[i] = s.vebTop[i];
+				vebBottom[i] = s.vebBottom[i];
+			}
+			s.buffer = NULL;
+			s.data = NULL;
+			s.count = 0;
+			s.height = 0;
+		}
+
+		// in-order traversal of slots.
+		class InOrder
+		{
+		public:
+			InOrder(const DKFrozenTree& t) : tree(&t), index(0), depth(0) {}
+
+			FORCEINLINE bool IsValid(void) const		{ return index != 0; }
+			FORCEINLINE size_t Slot(void) const
+			{
+				if (tree->layout == Layout::Sorted)
+					return index - 1;
+				return pos[depth];
+			}
+			void First(void)
+			{
+				index = 0;
+				if (tree->count == 0)
+					return;
+				index = 1;
+				if (tree->layout == Layout::Sorted)
+					return;
+				depth = 0;
+				pos[0] = tree->layout == Layout::Eytzinger ? 1 : 0;
+				PushLeftMost();
+			}
+			void Next(void)
+			{
+				if (tree->layout == Layout::Sorted)
+				{
+					index = index < tree->count ? index + 1 : 0;
+					return;
+				}
+				if (2 * index + 1 <= tree->count)
+				{
+					Push(2 * index + 1);
+					PushLeftMost();
+				}
+				else
+				{
+					int up = CountTrailingOnes(index) + 1;
+					index >>= up;
+					depth -= up;
+				}
+			}
+			// move to first item which is not less than 'k'.
+			template <typename Key, typename KeyValueComparator>
+			void Seek(const Key& k, KeyValueComparator& comp)
+			{
+				index = 0;
+				if (tree->count == 0)
+					return;
+				if (tree->layout == Layout::Sorted)
+				{
+					const Value* p = tree->LowerBound(k, comp);
+					index = p ? (p - tree->data) + 1 : 0;
+					return;
+				}
+				size_t i = 1;
+				depth = 0;
+				pos[0] = tree->layout == Layout::Eytzinger ? 1 : 0;
+				while (true)
+				{
+					i = 2 * i + (comp(tree->data[pos[depth]], k) < 0);
+					if (i > tree->count)
+						break;
+					depth++;
+					pos[depth] = tree->ChildSlot(pos, depth, i);
+				}
+				int up = CountTrailingOnes(i) + 1;
+				index = i >> up;
+				depth = depth + 1 - up;
+			}
+		private:
+			FORCEINLINE void Push(size_t i)
+			{
+				index = i;
+				depth++;
+				pos[depth] = tree->ChildSlot(pos, depth, i);
+			}
+			FORCEINLINE void PushLeftMost(void)
+			{
+				while (2 * index <= tree->count)
+					Push(2 * index);
+			}
+			const DKFrozenTree* tree;
+			size_t index;		// BFS index (one-based), zero if invalid.
+			int depth;
+			size_t pos[MaxDepth];
+		};
+
+		void*		buffer;
+		Value*		data;
+		size_t		count;
+		Layout		layout;
+		int			height;
+		// van Emde Boas layout: for each depth of bottom tree root,
+		// depth of top tree root, size of top tree and size of bottom tree.
+		int			vebRoot[MaxDepth];
+		size_t		vebTop[MaxDepth];
+		size_t		vebBottom[MaxDepth];
+	};
+}
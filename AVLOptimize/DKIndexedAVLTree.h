@@ -0,0 +1,608 @@
+//
+//  File: DKIndexedAVLTree.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <new>
+#include <stdint.h>
+#include "DKAVLTree.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// DKIndexedAVLTree
+// AVL tree which nodes are linked with 32bit indices into per-tree node pool.
+//
+// Node links (left, right, parent) are 32bit indices instead of pointers,
+// node of 32bit value is 20 bytes. (40 bytes with DKFoundation::DKAVLTree)
+// Pool consists of fixed size chunks, chunks are never moved. index is
+// converted to address with chunk table. (index zero is reserved for NULL)
+// Links are independent of address, pool can be relocated or serialized
+// with chunks.
+//
+// VALUE: value-type
+// KEY: key-type for searching
+// CMPV: value to value comparison function or function object.
+// CMPK: value to key comparison function or function object. (searching only)
+// COPY: copy value function or function object.
+// ALLOC: allocator for chunk and chunk table. (not fixed size)
+// ChunkBits: number of nodes per chunk (power of two)
+//
+// Note:
+//  value's pointer will not be changed after balancing process.
+//  max number of nodes is 2^32 - 1.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace DKFoundation
+{
+	template <
+		typename Value,										// value-type
+		typename Key,										// key-type (Lookup key)
+		typename ValueComparator = DKTreeComparison<Value, Value>,	// value comparison
+		typename KeyComparator = DKTreeComparison<Value, Key>,	// value, key comparison (lookup only)
+		typename CopyValue = DKTreeCopyValue<Value>,		// value copy
+		typename Allocator = DKMemoryDefaultAllocator,		// chunk allocator
+		unsigned int ChunkBits = 12							// 4096 nodes per chunk
+	>
+	class DKIndexedAVLTree
+	{
+	public:
+		using Index = uint32_t;
+		enum : Index { NullIndex = 0 };
+
+		class Node
+		{
+		public:
+			Node(const Value& v, Index parentNode)
+			: value(v), left(NullIndex), right(NullIndex), parent(parentNode), leftHeight(0), rightHeight(0)
+			{
+			}
+			Value			value;
+			Index			left;
+			Index			right;
+			Index			parent;
+			unsigned char	leftHeight;		// left-tree weights
+			unsigned char	rightHeight;	// right-tree weights
+
+			FORCEINLINE int Height(void) const	// self weights ( = max(left,right)+1)
+			{
+				return leftHeight > rightHeight ? (leftHeight + 1) : (rightHeight + 1);
+			}
+		};
+		enum : Index { NodesPerChunk = Index(1) << ChunkBits };
+		enum : Index { ChunkMask = NodesPerChunk - 1 };
+
+	public:
+		constexpr static size_t NodeSize(void)	{ return sizeof(Node); }
+
+		DKIndexedAVLTree(void)
+			: rootNode(NullIndex), count(0)
+			, chunkTable(NULL), numChunks(0), maxChunks(0), numSlots(1), freeSlot(NullIndex)
+		{
+		}
+		DKIndexedAVLTree(DKIndexedAVLTree&& tree)
+			: rootNode(NullIndex), count(0)
+			, chunkTable(NULL), numChunks(0), maxChunks(0), numSlots(1), freeSlot(NullIndex)
+		{
+			MoveFrom(tree);
+		}
+		DKIndexedAVLTree(const DKIndexedAVLTree& s)
+			: rootNode(NullIndex), count(0)
+			, chunkTable(NULL), numChunks(0), maxChunks(0), numSlots(1), freeSlot(NullIndex)
+		{
+			CopyFrom(s);
+		}
+		~DKIndexedAVLTree(void)
+		{
+			Clear();
+		}
+		// Update: insertion if not exist or overwrite if exists.
+		const Value* Update(const Value& v)
+		{
+			bool created = false;
+			Node* node = NodeAt(SetNode(v, &created));
+			if (!created)
+				copyValue(node->value, v);
+			return &node->value;
+		}
+		// Insert: insert if not exist or fail if exists.
+		//  returns NULL if function failed. (already exists)
+		const Value* Insert(const Value& v)
+		{
+			bool created = false;
+			Index index = SetNode(v, &created);
+			if (created && index)
+				return &NodeAt(index)->value;
+			return NULL;
+		}
+		void Remove(const Key& k)
+		{
+			Index index = LookupNodeForKey(k);
+			if (index == NullIndex)
+				return;
+
+			Node* node = NodeAt(index);
+			Index retrace = NullIndex;	// entry node to begin rotation.
+
+			if (node->left && node->right)
+			{
+				Index replace = NullIndex;
+
+				// find biggest from left, smallest from right, and swap, remove node.
+				// after remove, rotate again
+
+				if (node->leftHeight > node->rightHeight)
+				{
+					// finding biggest from left and swap.
+					for (replace = node->left; NodeAt(replace)->right; replace = NodeAt(replace)->right);
+					Node* rep = NodeAt(replace);
+					if (replace == node->left) // replacement node (child-node)
+					{
+						retrace = replace;
+					}
+					else
+					{
+						retrace = rep->parent;
+						// set 'retrace's right-node to 'replace's left-node
+						Node* ret = NodeAt(retrace);
+						ret->right = rep->left;
+						if (ret->right)
+							NodeAt(ret->right)->parent = retrace;
+						rep->left = node->left;
+						NodeAt(rep->left)->parent = replace;
+					}
+					rep->right = node->right;
+					NodeAt(rep->right)->parent = replace;
+				}
+				else
+				{
+					// finding smallest from right and swap.
+					for (replace = node->right; NodeAt(replace)->left; replace = NodeAt(replace)->left);
+					Node* rep = NodeAt(replace);
+					if (replace == node->right) // replacement node (child-node)
+					{
+						retrace = replace;
+					}
+					else
+					{
+						retrace = rep->parent;
+						// set 'replace's right-node to 'retrace's left-node
+						Node* ret = NodeAt(retrace);
+						ret->left = rep->right;
+						if (ret->left)
+							NodeAt(ret->left)->parent = retrace;
+						rep->right = node->right;
+						NodeAt(rep->right)->parent = replace;
+					}
+					rep->left = node->left;
+					NodeAt(rep->left)->parent = replace;
+				}
+				// set 'node's parent with 'replace' as child-node
+				if (node->parent)
+				{
+					Node* parent = NodeAt(node->parent);
+					if (parent->left == index)
+						parent->left = replace;
+					else
+						parent->right = replace;
+				}
+				NodeAt(replace)->parent = node->parent;
+			}
+			else
+			{
+				retrace = node->parent;
+				Index child = node->left ? node->left : node->right;
+				if (child)
+					NodeAt(child)->parent = retrace;
+
+				if (retrace)
+				{
+					Node* ret = NodeAt(retrace);
+					if (ret->left == index)
+						ret->left = child;
+					else
+						ret->right = child;
+				}
+				else
+				{
+					rootNode = child;
+				}
+			}
+
+			count--;
+			FreeNode(index);
+			if (retrace)
+				Balancing(retrace);
+		}
+		// remove all items, all chunks are released.
+		void Clear(void)
+		{
+			if (rootNode)
+				DeleteNode(rootNode);
+			for (size_t i = 0; i < numChunks; ++i)
+				Allocator::Free(chunkTable[i]);
+			if (chunkTable)
+				Allocator::Free(chunkTable);
+			rootNode = NullIndex;
+			count = 0;
+			chunkTable = NULL;
+			numChunks = 0;
+			maxChunks = 0;
+			numSlots = 1;
+			freeSlot = NullIndex;
+		}
+		FORCEINLINE const Value* Find(const Key& k) const
+		{
+			Index index = LookupNodeForKey(k);
+			if (index)
+				return &NodeAt(index)->value;
+			return NULL;
+		}
+		FORCEINLINE size_t Count(void) const
+		{
+			return count;
+		}
+		// bytes of node pool. (including unused slots)
+		size_t PoolSize(void) const
+		{
+			return numChunks * sizeof(Node) * NodesPerChunk + maxChunks * sizeof(Node*);
+		}
+		DKIndexedAVLTree& operator = (DKIndexedAVLTree&& tree)
+		{
+			if (this != &tree)
+			{
+				Clear();
+				MoveFrom(tree);
+			}
+			return *this;
+		}
+		DKIndexedAVLTree& operator = (const DKIndexedAVLTree& s)
+		{
+			if (this == &s)	return *this;
+
+			Clear();
+			CopyFrom(s);
+			return *this;
+		}
+		// lambda enumerator (VALUE&, bool*)
+		template <typename T> void EnumerateForward(T&& enumerator)
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (VALUE&, bool*)");
+
+			bool stop = false;
+			for (Index index = LeftMost(rootNode); index && !stop; index = Successor(index))
+				enumerator(NodeAt(index)->value, &stop);
+		}
+		template <typename T> void EnumerateBackward(T&& enumerator)
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (VALUE&, bool*)");
+
+			bool stop = false;
+			for (Index index = RightMost(rootNode); index && !stop; index = Predecessor(index))
+				enumerator(NodeAt(index)->value, &stop);
+		}
+		// lambda enumerator bool (const VALUE&, bool*)
+		template <typename T> void EnumerateForward(T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			bool stop = false;
+			for (Index index = LeftMost(rootNode); index && !stop; index = Successor(index))
+				enumerator(static_cast<const Value&>(NodeAt(index)->value), &stop);
+		}
+		template <typename T> void EnumerateBackward(T&& enumerator) const
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			bool stop = false;
+			for (Index index = RightMost(rootNode); index && !stop; index = Predecessor(index))
+				enumerator(static_cast<const Value&>(NodeAt(index)->value), &stop);
+		}
+
+		FORCEINLINE Node* NodeAt(Index index) const
+		{
+			return &chunkTable[index >> ChunkBits][index & ChunkMask];
+		}
+	private:
+		// node pool, unused slots are linked with first Index of slot.
+		Index AllocNode(const Value& v, Index parent)
+		{
+			Index index = freeSlot;
+			if (index)
+			{
+				freeSlot = *reinterpret_cast<Index*>(NodeAt(index));
+			}
+			else
+			{
+				if ((numSlots >> ChunkBits) >= numChunks)
+				{
+					if (numChunks >= maxChunks)
+					{
+						size_t n = maxChunks ? maxChunks * 2 : 16;
+						Node** table = static_cast<Node**>(Allocator::Alloc(sizeof(Node*) * n));
+						for (size_t i = 0; i < numChunks; ++i)
+							table[i] = chunkTable[i];
+						if (chunkTable)
+							Allocator::Free(chunkTable);
+						chunkTable = table;
+						maxChunks = n;
+					}
+					chunkTable[numChunks++] = static_cast<Node*>(Allocator::Alloc(sizeof(Node) * NodesPerChunk));
+				}
+				index = numSlots++;
+			}
+			new(NodeAt(index)) Node(v, parent);
+			return index;
+		}
+		FORCEINLINE void FreeNode(Index index)
+		{
+			Node* node = NodeAt(index);
+			node->~Node();
+			*reinterpret_cast<Index*>(node) = freeSlot;
+			freeSlot = index;
+		}
+		void DeleteNode(Index index)
+		{
+			Node* node = NodeAt(index);
+			if (node->right)
+				DeleteNode(node->right);
+			if (node->left)
+				DeleteNode(node->left);
+
+			count--;
+			FreeNode(index);
+		}
+		// copy pool with same indices.
+		void CopyFrom(const DKIndexedAVLTree& s)
+		{
+			if (s.numChunks == 0)
+				return;
+			chunkTable = static_cast<Node**>(Allocator::Alloc(sizeof(Node*) * s.maxChunks));
+			for (size_t i = 0; i < s.numChunks; ++i)
+				chunkTable[i] = static_cast<Node*>(Allocator::Alloc(sizeof(Node) * NodesPerChunk));
+			numChunks = s.numChunks;
+			maxChunks = s.maxChunks;
+			numSlots = s.numSlots;
+			freeSlot = s.freeSlot;
+			for (Index index = s.freeSlot; index; index = *reinterpret_cast<Index*>(s.NodeAt(index)))
+				*reinterpret_cast<Index*>(NodeAt(index)) = *reinterpret_cast<Index*>(s.NodeAt(index));
+			for (Index index = s.LeftMost(s.rootNode); index; index = s.Successor(index))
+				new(NodeAt(index)) Node(*s.NodeAt(index));
+			rootNode = s.rootNode;
+			count = s.count;
+		}
+		void MoveFrom(DKIndexedAVLTree& tree)
+		{
+			rootNode = tree.rootNode;
+			count = tree.count;
+			chunkTable = tree.chunkTable;
+			numChunks = tree.numChunks;
+			maxChunks = tree.maxChunks;
+			numSlots = tree.numSlots;
+			freeSlot = tree.freeSlot;
+			tree.rootNode = NullIndex;
+			tree.count = 0;
+			tree.chunkTable = NULL;
+			tree.numChunks = 0;
+			tree.maxChunks = 0;
+			tree.numSlots = 1;
+			tree.freeSlot = NullIndex;
+		}
+		FORCEINLINE Index LeftMost(Index index) const
+		{
+			if (index)
+				for (Index i = NodeAt(index)->left; i; i = NodeAt(i)->left)
+					index = i;
+			return index;
+		}
+		FORCEINLINE Index RightMost(Index index) const
+		{
+			if (index)
+				for (Index i = NodeAt(index)->right; i; i = NodeAt(i)->right)
+					index = i;
+			return index;
+		}
+		FORCEINLINE Index Successor(Index index) const
+		{
+			const Node* node = NodeAt(index);
+			if (node->right)
+				return LeftMost(node->right);
+			while (node->parent && NodeAt(node->parent)->right == index)
+			{
+				index = node->parent;
+				node = NodeAt(index);
+			}
+			return node->parent;
+		}
+		FORCEINLINE Index Predecessor(Index index) const
+		{
+			const Node* node = NodeAt(index);
+			if (node->left)
+				return RightMost(node->left);
+			while (node->parent && NodeAt(node->parent)->left == index)
+			{
+				index = node->parent;
+				node = NodeAt(index);
+			}
+			return node->parent;
+		}
+		void LeftRotate(Index pivot)
+		{
+			Node* p = NodeAt(pivot);
+			Index parent = p->parent;
+			Node* pa = NodeAt(parent);
+
+			if (pa->parent)
+			{
+				Node* g = NodeAt(pa->parent);
+				if (g->left == parent)
+					g->left = pivot;
+				else
+					g->right = pivot;
+			}
+			p->parent = pa->parent;
+			pa->parent = pivot;
+			pa->right = p->left;
+			if (pa->right)
+				NodeAt(pa->right)->parent = parent;
+			p->left = parent;
+		}
+		void RightRotate(Index pivot)
+		{
+			Node* p = NodeAt(pivot);
+			Index parent = p->parent;
+			Node* pa = NodeAt(parent);
+
+			if (pa->parent)
+			{
+				Node* g = NodeAt(pa->parent);
+				if (g->left == parent)
+					g->left = pivot;
+				else
+					g->right = pivot;
+			}
+			p->parent = pa->parent;
+			pa->parent = pivot;
+			pa->left = p->right;
+			if (pa->left)
+				NodeAt(pa->left)->parent = parent;
+			p->right = parent;
+		}
+		FORCEINLINE void UpdateHeight(Node* node)
+		{
+			node->leftHeight = node->left ? NodeAt(node->left)->Height() : 0;
+			node->rightHeight = node->right ? NodeAt(node->right)->Height() : 0;
+		}
+		// do balancing tree weights, from 'index' to root.
+		void Balancing(Index index)
+		{
+			while (true)
+			{
+				Node* node = NodeAt(index);
+				int left = node->left ? NodeAt(node->left)->Height() : 0;
+				int right = node->right ? NodeAt(node->right)->Height() : 0;
+
+				if (left - right > 1)
+				{
+					Node* l = NodeAt(node->left);
+					if (l->rightHeight > 0 && l->rightHeight > l->leftHeight)
+					{
+						// do left-rotate with 'node->left' and right-rotate recursively.
+						LeftRotate(l->right);
+						UpdateHeight(l);
+					}
+					// right-rotate with 'node'
+					RightRotate(node->left);
+				}
+				else if (right - left > 1)
+				{
+					Node* r = NodeAt(node->right);
+					if (r->leftHeight > 0 && r->leftHeight > r->rightHeight)
+					{
+						// right-rotate with 'node->right' and left-rotate recursively.
+						RightRotate(r->left);
+						UpdateHeight(r);
+					}
+					// left-rotate with 'node'
+					LeftRotate(node->right);
+				}
+
+				UpdateHeight(node);
+
+				if (node->parent)
+					index = node->parent;
+				else
+				{
+					rootNode = index;
+					return;
+				}
+			}
+		}
+		// find node and return. (create if not exists)
+		Index SetNode(const Value& v, bool* created)
+		{
+			if (rootNode == NullIndex)
+			{
+				*created = true;
+
+				count++;
+				rootNode = AllocNode(v, NullIndex);
+				return rootNode;
+			}
+			Index index = rootNode;
+			while (index)
+			{
+				Node* node = NodeAt(index);
+				int cmp = valueComparator(node->value, v);
+				if (cmp > 0)
+				{
+					if (node->left)
+						index = node->left;
+					else
+					{
+						*created = true;
+						count++;
+						Index ret = AllocNode(v, index);
+						node->left = ret;	// chunks are never moved, node is valid.
+						Balancing(index);
+						return ret;
+					}
+				}
+				else if (cmp < 0)
+				{
+					if (node->right)
+						index = node->right;
+					else
+					{
+						*created = true;
+						count++;
+						Index ret = AllocNode(v, index);
+						node->right = ret;
+						Balancing(index);
+						return ret;
+					}
+				}
+				else
+				{
+					*created = false;
+					return index;
+				}
+			}
+			return NullIndex;
+		}
+		// find node 'k' and return. (return NullIndex if not exists)
+		FORCEINLINE Index LookupNodeForKey(const Key& k) const
+		{
+			Index index = rootNode;
+			while (index)
+			{
+				const Node* node = NodeAt(index);
+				int cmp = keyComparator(node->value, k);
+				if (cmp > 0)
+					index = node->left;
+				else if (cmp < 0)
+					index = node->right;
+				else
+					return index;
+			}
+			return NullIndex;
+		}
+	public:
+		Index				rootNode;
+		size_t				count;
+		ValueComparator		valueComparator;
+		KeyComparator		keyComparator;
+		CopyValue			copyValue;
+	private:
+		Node**				chunkTable;
+		size_t				numChunks;
+		size_t				maxChunks;
+		Index				numSlots;	// number of slots used. (including reserved slot zero)
+		Index				freeSlot;	// first unused slot.
+	};
+}
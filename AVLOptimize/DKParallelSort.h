@@ -0,0 +1,144 @@
+//
+//  File: DKParallelSort.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <thread>
+
+////////////////////////////////////////////////////////////////////////////////
+// DKParallelSortUnique
+// sort items with multiple threads and remove duplicated items.
+//
+// each thread sorts it's own slice, slices are merged pair by pair with
+// multiple threads, and duplicated items are detected with each thread.
+// unique items are moved to front of vector and vector will be resized.
+//
+// Comparator: three-way comparison function or function object.
+//   (returns negative if lhs < rhs, positive if lhs > rhs, zero if equal)
+//   comparator should be callable from multiple threads.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace DKFoundation
+{
+	// returns number of threads to be used. (0 for hardware concurrency)
+	inline size_t DKParallelThreadCount(size_t threads)
+	{
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		return threads > 0 ? threads : 1;
+	}
+
+	// returns number of recursion levels to be forked for threads.
+	inline int DKParallelForkDepth(size_t threads)
+	{
+		int depth = 0;
+		for (size_t t = DKParallelThreadCount(threads); t > 1; t = (t + 1) / 2)
+			depth++;
+		return depth;
+	}
+
+	// run task(index) for index in [0, n) with each threads.
+	// last task runs on calling thread.
+	template <typename Task> void DKParallelFor(size_t n, Task&& task)
+	{
+		std::vector<std::thread> workers;
+		if (n > 1)
+		{
+			workers.reserve(n - 1);
+			for (size_t i = 0; i + 1 < n; ++i)
+				workers.push_back(std::thread(task, i));
+		}
+		if (n > 0)
+			task(n - 1);
+		for (std::thread& t : workers)
+			t.join();
+	}
+
+	template <typename Value, typename Comparator>
+	size_t DKParallelSortUnique(std::vector<Value>& values, Comparator& cmp, size_t threads)
+	{
+		const size_t minItemsPerThread = 0x4000;
+		const size_t n = values.size();
+		if (n == 0)
+			return 0;
+
+		threads = std::min(DKParallelThreadCount(threads), (n + minItemsPerThread - 1) / minItemsPerThread);
+		if (threads < 1)
+			threads = 1;
+
+		auto less = [&cmp](const Value& lhs, const Value& rhs) -> bool { return cmp(lhs, rhs) < 0; };
+		Value* data = values.data();
+
+		// slice boundaries, slice i = [bounds[i], bounds[i+1])
+		std::vector<size_t> bounds(threads + 1);
+		for (size_t i = 0; i <= threads; ++i)
+			bounds[i] = n * i / threads;
+
+		// sort each slices.
+		DKParallelFor(threads, [&](size_t i)
+		{
+			std::sort(data + bounds[i], data + bounds[i+1], less);
+		});
+		// merge slices pair by pair.
+		for (size_t width = 1; width < threads; width *= 2)
+		{
+			size_t numMerges = (threads + width * 2 - 1) / (width * 2);
+			DKParallelFor(numMerges, [&](size_t i)
+			{
+				size_t begin = i * width * 2;
+				size_t mid = std::min(begin + width, threads);
+				size_t end = std::min(begin + width * 2, threads);
+				if (mid < end)
+					std::inplace_merge(data + bounds[begin], data + bounds[mid], data + bounds[end], less);
+			});
+		}
+		// remove duplicated items of each slices.
+		// leading items of slice are duplicated if they equal to last item of previous slice.
+		std::vector<size_t> starts(bounds.begin(), bounds.end() - 1);
+		DKParallelFor(threads, [&](size_t i)
+		{
+			if (i > 0)
+			{
+				while (starts[i] < bounds[i+1] && cmp(data[bounds[i] - 1], data[starts[i]]) == 0)
+					starts[i]++;
+			}
+		});
+		std::vector<size_t> uniques(threads);
+		DKParallelFor(threads, [&](size_t i)
+		{
+			Value* begin = data + starts[i];
+			Value* end = data + bounds[i+1];
+			Value* pos = data + bounds[i];
+			if (begin != end)
+			{
+				if (pos != begin)
+					*pos = std::move(*begin);
+				while (++begin != end)
+				{
+					if (cmp(*pos, *begin))
+					{
+						if (++pos != begin)
+							*pos = std::move(*begin);
+					}
+				}
+				++pos;
+			}
+			uniques[i] = pos - (data + bounds[i]);
+		});
+		// gather unique items to front.
+		size_t numUniques = uniques[0];
+		for (size_t i = 1; i < threads; ++i)
+		{
+			if (bounds[i] != numUniques)
+				std::move(data + bounds[i], data + bounds[i] + uniques[i], data + numUniques);
+			numUniques += uniques[i];
+		}
+		values.erase(values.begin() + numUniques, values.end());
+		return numUniques;
+	}
+}
@@ -0,0 +1,528 @@
+//
+//  File: DKPersistentAVLTree.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <new>
+#include <atomic>
+#include "DKAVLTree2.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// DKPersistentAVLTree
+// persistent AVL tree with path-copying, nodes are shared between versions.
+//
+// Nodes are reference counted, modification copies shared nodes on the path
+// from root and all other nodes are shared. (O(log n) copies)
+// Nodes which are not shared are modified in place, path is not copied
+// until next snapshot.
+// Snapshot() returns immutable version with O(1), versions can be searched or
+// enumerated from any thread without lock.
+//
+// Note:
+//  Snapshot() and modification should be serialized. (single writer)
+//  Version can be released on any thread, Allocator should be thread-safe.
+//  value's pointer of version will not be changed until version released.
+//  value's pointer of tree is valid until tree is modified.
+//
+
+namespace DKFoundation2
+{
+	template <
+		typename Value,											// value-type
+		typename Comparator = DKTreeItemComparator<Value, Value>,	// value comparison
+		typename Replacer = DKTreeItemReplacer<Value>,				// value replacement
+		typename Allocator = DKMemoryDefaultAllocator			// memory allocator
+	>
+	class DKPersistentAVLTree
+	{
+	public:
+		struct Node
+		{
+			Node(const Value& v) : value(v), left(NULL), right(NULL), leftHeight(0), rightHeight(0), refCount(1) {}
+			// copy node, child-nodes are shared.
+			Node(const Node& n)
+			: value(n.value), left(n.left), right(n.right)
+			, leftHeight(n.leftHeight), rightHeight(n.rightHeight), refCount(1)
+			{
+				Retain(left);
+				Retain(right);
+			}
+
+			Value		value;
+			Node*		left;
+			Node*		right;
+			int			leftHeight;
+			int			rightHeight;
+			std::atomic<unsigned int> refCount;
+
+			FORCEINLINE int Height(void) const
+			{
+				return leftHeight > rightHeight ? (leftHeight + 1) : (rightHeight + 1);
+			}
+			template <typename R> bool EnumerateForward(R&& enumerator) const
+			{
+				if (left && left->EnumerateForward(std::forward<R>(enumerator)))	return true;
+				if (enumerator(value))												return true;
+				if (right && right->EnumerateForward(std::forward<R>(enumerator)))	return true;
+				return false;
+			}
+			template <typename R> bool EnumerateBackward(R&& enumerator) const
+			{
+				if (right && right->EnumerateBackward(std::forward<R>(enumerator)))	return true;
+				if (enumerator(value))												return true;
+				if (left && left->EnumerateBackward(std::forward<R>(enumerator)))	return true;
+				return false;
+			}
+		};
+
+		// immutable version of tree.
+		class Version
+		{
+		public:
+			Version(void) : rootNode(NULL), count(0) {}
+			Version(const Version& v) : rootNode(v.rootNode), count(v.count)
+			{
+				Retain(rootNode);
+			}
+			Version(Version&& v) : rootNode(v.rootNode), count(v.count)
+			{
+				v.rootNode = NULL;
+				v.count = 0;
+			}
+			~Version(void)
+			{
+				Release(rootNode);
+			}
+			Version& operator = (const Version& v)
+			{
+				Retain(v.rootNode);
+				Release(rootNode);
+				rootNode = v.rootNode;
+				count = v.count;
+				return *this;
+			}
+			Version& operator = (Version&& v)
+			{
+				if (this != &v)
+				{
+					Release(rootNode);
+					rootNode = v.rootNode;
+					count = v.count;
+					v.rootNode = NULL;
+					v.count = 0;
+				}
+				return *this;
+			}
+			template <typename Key, typename KeyValueComparator>
+			FORCEINLINE const Value* Find(const Key& k, KeyValueComparator&& comp) const
+			{
+				return FindValue(rootNode, k, comp);
+			}
+			FORCEINLINE size_t Count(void) const
+			{
+				return count;
+			}
+			template <typename T> void EnumerateForward(T&& enumerator) const
+			{
+				DKPersistentAVLTree::EnumerateForward(rootNode, std::forward<T>(enumerator));
+			}
+			template <typename T> void EnumerateBackward(T&& enumerator) const
+			{
+				DKPersistentAVLTree::EnumerateBackward(rootNode, std::forward<T>(enumerator));
+			}
+		private:
+			friend class DKPersistentAVLTree;
+			Version(Node* node, size_t c) : rootNode(node), count(c)
+			{
+				Retain(rootNode);
+			}
+			Node* rootNode;
+			size_t count;
+		};
+
+	public:
+		constexpr static size_t NodeSize(void)	{ return sizeof(Node); }
+
+		DKPersistentAVLTree(void)
+		: rootNode(NULL), count(0)
+		{
+		}
+		DKPersistentAVLTree(DKPersistentAVLTree&& tree)
+		: rootNode(tree.rootNode), count(tree.count)
+		{
+			tree.rootNode = NULL;
+			tree.count = 0;
+		}
+		// copy tree, nodes are shared. O(1)
+		DKPersistentAVLTree(const DKPersistentAVLTree& s)
+		: rootNode(s.rootNode), count(s.count)
+		{
+			Retain(rootNode);
+		}
+		// create tree from version, nodes are shared. O(1)
+		DKPersistentAVLTree(const Version& v)
+		: rootNode(v.rootNode), count(v.count)
+		{
+			Retain(rootNode);
+		}
+		~DKPersistentAVLTree(void)
+		{
+			Clear();
+		}
+		// Snapshot: returns immutable version of current tree. O(1)
+		Version Snapshot(void) const
+		{
+			return Version(rootNode, count);
+		}
+		// Update: insertion if not exist or overwrite if exists.
+		FORCEINLINE const Value* Update(const Value& v)
+		{
+			LocationContext ctxt = { &v, NULL, true, false };
+			SetRoot(InsertNode(rootNode, true, &ctxt));
+			return &(ctxt.locatedNode->value);
+		}
+		// Insert: insert if not exist or fail if exists.
+		//  returns NULL if function failed. (already exists)
+		FORCEINLINE const Value* Insert(const Value& v)
+		{
+			LocationContext ctxt = { &v, NULL, false, false };
+			SetRoot(InsertNode(rootNode, true, &ctxt));
+			if (ctxt.created)
+				return &(ctxt.locatedNode->value);
+			return NULL;
+		}
+		template <typename Key, typename KeyValueComparator>
+		FORCEINLINE void Remove(const Key& k, KeyValueComparator&& comp)
+		{
+			bool removed = false;
+			SetRoot(RemoveNode(rootNode, true, k, comp, &removed));
+			if (removed)
+				count--;
+		}
+		FORCEINLINE void Clear(void)
+		{
+			Release(rootNode);
+			rootNode = NULL;
+			count = 0;
+		}
+		template <typename Key, typename KeyValueComparator>
+		FORCEINLINE const Value* Find(const Key& k, KeyValueComparator&& comp) const
+		{
+			return FindValue(rootNode, k, comp);
+		}
+		FORCEINLINE size_t Count(void) const
+		{
+			return count;
+		}
+		DKPersistentAVLTree& operator = (DKPersistentAVLTree&& tree)
+		{
+			if (this != &tree)
+			{
+				Clear();
+
+				rootNode = tree.rootNode;
+				count = tree.count;
+				tree.rootNode = NULL;
+				tree.count = 0;
+			}
+			return *this;
+		}
+		DKPersistentAVLTree& operator = (const DKPersistentAVLTree& s)
+		{
+			Retain(s.rootNode);
+			Release(rootNode);
+			rootNode = s.rootNode;
+			count = s.count;
+			return *this;
+		}
+		// lambda enumerator bool (const VALUE&, bool*)
+		template <typename T> void EnumerateForward(T&& enumerator) const
+		{
+			EnumerateForward(rootNode, std::forward<T>(enumerator));
+		}
+		template <typename T> void EnumerateBackward(T&& enumerator) const
+		{
+			EnumerateBackward(rootNode, std::forward<T>(enumerator));
+		}
+
+	private:
+		struct LocationContext
+		{
+			const Value* value;
+			Node* locatedNode;
+			bool update;
+			bool created;
+		};
+		FORCEINLINE static void Retain(Node* node)
+		{
+			if (node)
+				node->refCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		static void Release(Node* node)
+		{
+			if (node && node->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				Release(node->left);
+				Release(node->right);
+				(*node).~Node();
+				Allocator::Free(node);
+			}
+		}
+		// node is not shared with other version if it is referenced once
+		// and all ancestors are not shared.
+		FORCEINLINE static bool IsUnique(const Node* node)
+		{
+			return node->refCount.load(std::memory_order_acquire) == 1;
+		}
+		// returns node which can be modified, shared node is copied.
+		FORCEINLINE static Node* Writable(Node* node, bool unique)
+		{
+			if (unique)
+				return node;
+			return new(Allocator::Alloc(sizeof(Node))) Node(*node);
+		}
+		// make child-node writable, parent-node should be writable.
+		FORCEINLINE static Node* WritableChild(Node*& child)
+		{
+			if (!IsUnique(child))
+			{
+				Node* node = new(Allocator::Alloc(sizeof(Node))) Node(*child);
+				Release(child);
+				child = node;
+			}
+			return child;
+		}
+		// replace child-node of writable node. old child-node is released.
+		FORCEINLINE static void SetChild(Node*& child, Node* node)
+		{
+			if (child != node)
+			{
+				Release(child);
+				child = node;
+			}
+		}
+		FORCEINLINE void SetRoot(Node* node)
+		{
+			if (rootNode != node)
+			{
+				Release(rootNode);
+				rootNode = node;
+			}
+		}
+		// returns new sub-tree root, new sub-tree root has it's own reference
+		// if it is different from 'node'. (caller should release link of 'node')
+		Node* InsertNode(Node* node, bool unique, LocationContext* ctxt)
+		{
+			if (node == NULL)
+			{
+				count++;
+				ctxt->created = true;
+				ctxt->locatedNode = new(Allocator::Alloc(sizeof(Node))) Node(*ctxt->value);
+				return ctxt->locatedNode;
+			}
+			unique = unique && IsUnique(node);
+			int cmp = comparator(node->value, *ctxt->value);
+			if (cmp == 0)
+			{
+				if (ctxt->update)
+				{
+					node = Writable(node, unique);
+					replacer(node->value, *ctxt->value);
+				}
+				ctxt->locatedNode = node;
+				return node;
+			}
+			Node* child = cmp > 0 ? node->left : node->right;
+			Node* child2 = InsertNode(child, unique, ctxt);
+			// unique sub-tree can be modified in place, (heights may be changed)
+			// shared sub-tree is not modified if pointer is not changed.
+			if (child == child2 && !unique)
+				return node;
+
+			Node* node2 = Writable(node, unique);
+			if (cmp > 0)
+				SetChild(node2->left, child2);
+			else
+				SetChild(node2->right, child2);
+			return Rebalance(node, node2);
+		}
+		template <typename Key, typename KeyValueComparator>
+		Node* RemoveNode(Node* node, bool unique, const Key& k, KeyValueComparator& comp, bool* removed)
+		{
+			if (node == NULL)
+				return NULL;
+			unique = unique && IsUnique(node);
+			int cmp = comp(node->value, k);
+			if (cmp == 0)
+			{
+				*removed = true;
+				if (node->left == NULL || node->right == NULL)
+				{
+					Node* child = node->left ? node->left : node->right;
+					Retain(child);
+					return child;
+				}
+				// replace with left-most node of right sub-tree.
+				Node* leftMost = NULL;
+				Node* right = TakeOutLeftMostNode(node->right, unique, &leftMost);
+				leftMost->left = node->left;
+				Retain(leftMost->left);
+				leftMost->right = right;
+				if (right == node->right)
+					Retain(right);
+				return Balance(leftMost);
+			}
+			Node* child = cmp > 0 ? node->left : node->right;
+			Node* child2 = RemoveNode(child, unique, k, comp, removed);
+			// unique sub-tree can be modified in place, (heights may be changed)
+			// shared sub-tree is not modified if pointer is not changed.
+			if (child == child2 && !unique)
+				return node;
+
+			Node* node2 = Writable(node, unique);
+			if (cmp > 0)
+				SetChild(node2->left, child2);
+			else
+				SetChild(node2->right, child2);
+			return Rebalance(node, node2);
+		}
+		// take out left-most node, taken node is writable and detached.
+		Node* TakeOutLeftMostNode(Node* node, bool unique, Node** leftMost)
+		{
+			unique = unique && IsUnique(node);
+			if (node->left == NULL)
+			{
+				Node* right = node->right;
+				if (unique)
+				{
+					// detach node, reference of 'right' moves to caller.
+					node->right = NULL;
+					Retain(node);		// reference of caller's link
+				}
+				else
+				{
+					node = new(Allocator::Alloc(sizeof(Node))) Node(*node);
+					node->right = NULL;		// reference of 'right' moves to caller.
+				}
+				*leftMost = node;
+				return right;
+			}
+			Node* child2 = TakeOutLeftMostNode(node->left, unique, leftMost);
+			Node* node2 = Writable(node, unique);
+			SetChild(node2->left, child2);
+			return Rebalance(node, node2);
+		}
+		// balance 'node2' which is writable node of 'node'.
+		FORCEINLINE Node* Rebalance(Node* node, Node* node2)
+		{
+			Node* node3 = Balance(node2);
+			// node rotated in place, caller will release link of 'node'.
+			if (node3 != node2 && node2 == node)
+				Retain(node2);
+			return node3;
+		}
+		FORCEINLINE Node* LeftRotate(Node* node)
+		{
+			Node* right = WritableChild(node->right);
+			node->right = right->left;
+			right->left = node;
+			return right;
+		}
+		FORCEINLINE Node* RightRotate(Node* node)
+		{
+			Node* left = WritableChild(node->left);
+			node->left = left->right;
+			left->right = node;
+			return left;
+		}
+		FORCEINLINE void UpdateHeight(Node* node)
+		{
+			node->leftHeight = node->left ? node->left->Height() : 0;
+			node->rightHeight = node->right ? node->right->Height() : 0;
+		}
+		// balance tree weights, 'node' should be writable.
+		FORCEINLINE Node* Balance(Node* node)
+		{
+			Node* node2 = node;
+			int left = node->left ? node->left->Height() : 0;
+			int right = node->right ? node->right->Height() : 0;
+
+			int d = left - right;
+			if (d > 1)
+			{
+				if (node->left->rightHeight > 0 && node->left->rightHeight > node->left->leftHeight)
+				{
+					// do left-rotate with 'node->left' and right-rotate recursively.
+					WritableChild(node->left);
+					node->left = LeftRotate(node->left);
+					UpdateHeight(node->left->left);
+				}
+				// right-rotate with 'node' and 'node->left'
+				node2 = RightRotate(node);
+			}
+			else if (d < -1)
+			{
+				if (node->right->leftHeight > 0 && node->right->leftHeight > node->right->rightHeight)
+				{
+					// right-rotate with 'node->right' and left-rotate recursively.
+					WritableChild(node->right);
+					node->right = RightRotate(node->right);
+					UpdateHeight(node->right->right);
+				}
+				// left-rotate with 'node' and 'node->right'
+				node2 = LeftRotate(node);
+			}
+			UpdateHeight(node);
+			if (node != node2)
+				UpdateHeight(node2);
+			return node2;
+		}
+		template <typename Key, typename KeyValueComparator>
+		FORCEINLINE static const Value* FindValue(const Node* node, const Key& k, KeyValueComparator& comp)
+		{
+			while (node)
+			{
+				int cmp = comp(node->value, k);
+				if (cmp > 0)
+					node = node->left;
+				else if (cmp < 0)
+					node = node->right;
+				else
+					return &node->value;
+			}
+			return NULL;
+		}
+		template <typename T> static void EnumerateForward(const Node* node, T&& enumerator)
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			if (node)
+			{
+				bool stop = false;
+				auto func = [=, &enumerator](const Value& v) mutable -> bool {enumerator(v, &stop); return stop;};
+				node->EnumerateForward(func);
+			}
+		}
+		template <typename T> static void EnumerateBackward(const Node* node, T&& enumerator)
+		{
+			static_assert(DKFunctionType<T&&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			if (node)
+			{
+				bool stop = false;
+				auto func = [=, &enumerator](const Value& v) mutable -> bool {enumerator(v, &stop); return stop;};
+				node->EnumerateBackward(func);
+			}
+		}
+
+		Node*			rootNode;
+		size_t			count;
+		Comparator		comparator;
+		Replacer		replacer;
+	};
+}
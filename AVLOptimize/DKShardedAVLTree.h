@@ -0,0 +1,256 @@
+//
+//  File: DKShardedAVLTree.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <new>
+#include <mutex>
+#include <functional>
+#include "DKAVLTree2.h"
+#include "DKFixedSizeAllocator.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// DKShardedAVLTree
+// thread-safe tree, values are partitioned into independently locked shards.
+//
+// Each shard has own DKAVLTree and own node pool (DKFixedSizeAllocator),
+// threads working on different shards are not blocked by each other.
+//
+// Partitioner: maps value or key to shard index.
+//  DKTreeRangePartitioner<T>: splits key range [lo, hi] into equal ranges,
+//   shards are ordered, enables EnumerateForward, EnumerateBackward.
+//  DKTreeHashPartitioner<T>: distributes by hash, hot key ranges are spread
+//   to all shards, but shards are not ordered.
+//  Partitioner should provide:
+//   enum { Ordered }
+//   size_t operator () (const Key&, size_t numShards) const
+//   (for Value and all Key types used with Find, Remove)
+//
+// Note:
+//  Lock should be BasicLockable. (lock, unlock)
+//  values are copied out from tree, pointer of value is not exposed because
+//  it can be removed by other thread.
+//  Count and enumeration visit shards in order, they are not atomic over
+//  all shards.
+//
+
+namespace DKFoundation2
+{
+	template <typename T> struct DKTreeRangePartitioner
+	{
+		enum { Ordered = true };
+
+		DKTreeRangePartitioner(const T& l, const T& h) : lo(l), hi(h) {}
+
+		FORCEINLINE size_t operator () (const T& k, size_t numShards) const
+		{
+			if (k <= lo)	return 0;
+			if (k >= hi)	return numShards - 1;
+			unsigned long long width = (unsigned long long)(hi - lo) / numShards + 1;
+			return (size_t)((unsigned long long)(k - lo) / width);
+		}
+		T lo;
+		T hi;
+	};
+	template <typename T, typename Hash = std::hash<T>> struct DKTreeHashPartitioner
+	{
+		enum { Ordered = false };
+
+		FORCEINLINE size_t operator () (const T& k, size_t numShards) const
+		{
+			// std::hash of integer is identity, mix bits before modulo.
+			unsigned long long h = (unsigned long long)Hash()(k) * 0x9e3779b97f4a7c15ULL;
+			return (size_t)((h >> 32) % numShards);
+		}
+	};
+
+	template <
+		typename Value,											// value-type
+		typename Partitioner,									// shard partitioner
+		typename Comparator = DKTreeItemComparator<Value, Value>,	// value comparison
+		typename Replacer = DKTreeItemReplacer<Value>,				// value replacement
+		typename Lock = std::mutex								// shard lock
+	>
+	class DKShardedAVLTree
+	{
+		using Pool = DKFoundation::DKFixedSizeAllocator<
+			DKAVLTree<Value, Comparator, Replacer>::NodeSize(),
+			alignof(typename DKAVLTree<Value, Comparator, Replacer>::Node),
+			1024,
+			DKDummyLock>;	// pool is used with shard locked.
+
+		// node allocator of shard tree, pool of shard is selected while
+		// shard is locked by current thread.
+		struct ShardAllocator
+		{
+			static Pool*& CurrentPool(void)
+			{
+				static thread_local Pool* pool = NULL;
+				return pool;
+			}
+			static void* Alloc(size_t s)	{ return CurrentPool()->Alloc(s); }
+			static void Free(void* p)		{ CurrentPool()->Dealloc(p); }
+		};
+
+	public:
+		using Tree = DKAVLTree<Value, Comparator, Replacer, ShardAllocator>;
+
+		constexpr static size_t NodeSize(void)	{ return Tree::NodeSize(); }
+
+		DKShardedAVLTree(size_t n, const Partitioner& p = Partitioner())
+		: shards(NULL), numShards(n > 0 ? n : 1), partitioner(p)
+		{
+			shards = new Shard[numShards];
+		}
+		~DKShardedAVLTree(void)
+		{
+			delete[] shards;
+		}
+		// Update: insertion if not exist or overwrite if exists.
+		//  returns true if value inserted.
+		bool Update(const Value& v)
+		{
+			Shard& shard = shards[partitioner(v, numShards)];
+			ShardGuard guard(shard);
+			size_t count = shard.tree.Count();
+			shard.tree.Update(v);
+			return shard.tree.Count() > count;
+		}
+		// Insert: insert if not exist or fail if exists.
+		//  returns false if function failed. (already exists)
+		bool Insert(const Value& v)
+		{
+			Shard& shard = shards[partitioner(v, numShards)];
+			ShardGuard guard(shard);
+			return shard.tree.Insert(v) != NULL;
+		}
+		// Remove: returns true if value removed.
+		template <typename Key, typename KeyValueComparator>
+		bool Remove(const Key& k, KeyValueComparator&& comp)
+		{
+			Shard& shard = shards[partitioner(k, numShards)];
+			ShardGuard guard(shard);
+			size_t count = shard.tree.Count();
+			shard.tree.Remove(k, std::forward<KeyValueComparator>(comp));
+			return shard.tree.Count() < count;
+		}
+		// Find: value is copied to 'value' if found and 'value' is not NULL.
+		template <typename Key, typename KeyValueComparator>
+		bool Find(const Key& k, KeyValueComparator&& comp, Value* value = NULL) const
+		{
+			Shard& shard = shards[partitioner(k, numShards)];
+			std::lock_guard<Lock> guard(shard.lock);
+			const Value* p = shard.tree.Find(k, std::forward<KeyValueComparator>(comp));
+			if (p && value)
+				*value = *p;
+			return p != NULL;
+		}
+		void Clear(void)
+		{
+			for (size_t i = 0; i < numShards; ++i)
+			{
+				ShardGuard guard(shards[i]);
+				shards[i].tree.Clear();
+			}
+		}
+		size_t Count(void) const
+		{
+			size_t count = 0;
+			for (size_t i = 0; i < numShards; ++i)
+			{
+				std::lock_guard<Lock> guard(shards[i].lock);
+				count += shards[i].tree.Count();
+			}
+			return count;
+		}
+		// memory size of all node pools.
+		size_t PoolSize(void) const
+		{
+			size_t size = 0;
+			for (size_t i = 0; i < numShards; ++i)
+			{
+				std::lock_guard<Lock> guard(shards[i].lock);
+				size += shards[i].pool.Size();
+			}
+			return size;
+		}
+		FORCEINLINE size_t NumberOfShards(void) const
+		{
+			return numShards;
+		}
+		// lambda enumerator (const VALUE&, bool*), shard by shard, not ordered.
+		template <typename T> void Enumerate(T&& enumerator) const
+		{
+			EnumerateShards(enumerator, std::true_type());
+		}
+		// ordered enumeration, each shard is locked while it is enumerated.
+		template <typename T> void EnumerateForward(T&& enumerator) const
+		{
+			static_assert(Partitioner::Ordered, "Partitioner is not ordered.");
+			EnumerateShards(enumerator, std::true_type());
+		}
+		template <typename T> void EnumerateBackward(T&& enumerator) const
+		{
+			static_assert(Partitioner::Ordered, "Partitioner is not ordered.");
+			EnumerateShards(enumerator, std::false_type());
+		}
+
+		DKShardedAVLTree(const DKShardedAVLTree&) = delete;
+		DKShardedAVLTree& operator = (const DKShardedAVLTree&) = delete;
+
+	private:
+		struct Shard
+		{
+			~Shard(void)
+			{
+				ShardAllocator::CurrentPool() = &pool;
+				tree.Clear();
+				ShardAllocator::CurrentPool() = NULL;
+			}
+			Lock lock;
+			Pool pool;
+			Tree tree;
+			unsigned char padding[64];	// prevent false-sharing with next shard.
+		};
+		// lock shard and select pool of shard.
+		struct ShardGuard
+		{
+			ShardGuard(Shard& s) : shard(s)
+			{
+				shard.lock.lock();
+				ShardAllocator::CurrentPool() = &shard.pool;
+			}
+			~ShardGuard(void)
+			{
+				ShardAllocator::CurrentPool() = NULL;
+				shard.lock.unlock();
+			}
+			Shard& shard;
+		};
+		template <typename T, bool Forward>
+		void EnumerateShards(T& enumerator, std::integral_constant<bool, Forward>) const
+		{
+			static_assert(DKFunctionType<T&>::Signature::template CanInvokeWithParameterTypes<const Value&, bool*>(),
+						  "enumerator's parameter is not compatible with (const VALUE&, bool*)");
+
+			bool stop = false;
+			auto func = [&enumerator, &stop](const Value& v, bool* s) {enumerator(v, s); stop = *s;};
+			for (size_t i = 0; i < numShards && !stop; ++i)
+			{
+				Shard& shard = shards[Forward ? i : numShards - i - 1];
+				std::lock_guard<Lock> guard(shard.lock);
+				if (Forward)
+					shard.tree.EnumerateForward(func);
+				else
+					shard.tree.EnumerateBackward(func);
+			}
+		}
+
+		Shard*		shards;
+		size_t		numShards;
+		Partitioner	partitioner;
+	};
+}
@@ -0,0 +1,212 @@
+//
+//  File: DKThreadCachedAllocator.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <atomic>
+#include "DKFixedSizeAllocator.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// DKThreadCachedAllocator
+// fixed size allocator with per-thread magazine cache.
+//
+// Each thread has own magazine (stack of free units), Alloc and Dealloc use
+// magazine of current thread without lock. Shared allocator (locked) is used
+// only when magazine is empty (refill half) or full (flush half).
+//
+// Units are owned by allocator, not by thread. unit allocated by one thread
+// can be freed by any other thread (remote free), it goes to magazine of
+// freeing thread and returned to shared allocator when magazine flushed.
+//
+// Note:
+//  Magazines are indexed by process-wide thread slot, slot is reused by
+//  next thread after thread exited, units cached by exited thread are
+//  reused by next thread of same slot. (or released on Purge, destructor)
+//  Threads out of MaxThreads slots use shared allocator directly.
+//  NumberOfAllocatedUnits includes cached units.
+//  Should not be used in destructor of other thread_local object.
+//  Purge should not be called while other threads use allocator.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace DKFoundation
+{
+	// process-wide thread slot index, acquired at first use, released at thread exit.
+	struct DKThreadSlot
+	{
+		enum : size_t { MaxSlots = 256 };
+		enum : size_t { Invalid = (size_t)-1 };
+
+		static size_t Index(void)
+		{
+			static thread_local Owner owner;
+			return owner.index;
+		}
+
+	private:
+		struct Owner
+		{
+			Owner(void) : index(Acquire()) {}
+			~Owner(void) { Release(index); }
+			size_t index;
+		};
+		using Bits = std::atomic<unsigned long long>;
+		enum : size_t { BitsPerWord = sizeof(unsigned long long) * 8 };
+
+		static Bits* Bitmap(void)
+		{
+			static Bits bitmap[MaxSlots / BitsPerWord];	// zero-initialized
+			return bitmap;
+		}
+		static size_t Acquire(void)
+		{
+			Bits* bitmap = Bitmap();
+			for (size_t i = 0; i < MaxSlots / BitsPerWord; ++i)
+			{
+				unsigned long long bits = bitmap[i].load(std::memory_order_relaxed);
+				while (~bits)
+				{
+					unsigned long long bit = ~bits & (bits + 1);	// lowest zero bit
+					if (bitmap[i].compare_exchange_weak(bits, bits | bit, std::memory_order_acquire, std::memory_order_relaxed))
+						return i * BitsPerWord + __builtin_ctzll(bit);
+				}
+			}
+			return Invalid;
+		}
+		static void Release(size_t index)
+		{
+			if (index != Invalid)
+			{
+				unsigned long long bit = 1ULL << (index % BitsPerWord);
+				Bitmap()[index / BitsPerWord].fetch_and(~bit, std::memory_order_release);
+			}
+		}
+	};
+
+	template <
+		typename FixedSizeAllocator,			// shared allocator (should be thread-safe)
+		unsigned int MagazineSize = 64,			// max units cached per thread
+		unsigned int MaxThreads = 64			// number of thread slots
+	>
+	class DKThreadCachedAllocator
+	{
+		static_assert(MagazineSize > 1, "MagazineSize must be greater than one.");
+		static_assert(MaxThreads <= DKThreadSlot::MaxSlots, "MaxThreads exceeds number of thread slots.");
+
+		enum : size_t { BatchSize = MagazineSize / 2 };
+
+	public:
+		enum { FixedLength = FixedSizeAllocator::FixedLength };
+
+		DKThreadCachedAllocator(void)
+		{
+			for (Magazine& m : magazines)
+				m.count = 0;
+		}
+		~DKThreadCachedAllocator(void)
+		{
+			FlushAll();
+		}
+
+		void* Alloc(size_t s)
+		{
+			if (s > FixedLength)
+				return NULL;
+
+			Magazine* m = CurrentMagazine();
+			if (m)
+			{
+				if (m->count == 0)
+					m->count = allocator.AllocBatch(m->units, BatchSize);
+				if (m->count > 0)
+					return m->units[--m->count];
+				return NULL;	// out of memory!
+			}
+			return allocator.Alloc(s);
+		}
+		void Dealloc(void* p)
+		{
+			if (p)
+			{
+				Magazine* m = CurrentMagazine();
+				if (m)
+				{
+					if (m->count == MagazineSize)
+					{
+						m->count -= BatchSize;
+						allocator.DeallocBatch(&m->units[m->count], BatchSize);
+					}
+					m->units[m->count++] = p;
+				}
+				else
+				{
+					allocator.Dealloc(p);
+				}
+			}
+		}
+		void Reserve(size_t n)
+		{
+			allocator.Reserve(n);
+		}
+		// return units cached by current thread to shared allocator.
+		void FlushCurrentThread(void)
+		{
+			Magazine* m = CurrentMagazine();
+			if (m)
+				Flush(m);
+		}
+		// return all cached units and delete unoccupied chunks.
+		size_t Purge(void)
+		{
+			FlushAll();
+			return allocator.Purge();
+		}
+		size_t Size(void) const
+		{
+			return allocator.Size();
+		}
+		size_t NumberOfAllocatedUnits(void) const
+		{
+			return allocator.NumberOfAllocatedUnits();
+		}
+		// statistics of shared allocator, units cached by threads are counted as allocated.
+		DKFixedSizeAllocatorStatistics Statistics(void) const
+		{
+			return allocator.Statistics();
+		}
+
+		DKThreadCachedAllocator(const DKThreadCachedAllocator&) = delete;
+		DKThreadCachedAllocator& operator = (const DKThreadCachedAllocator&) = delete;
+
+	private:
+		struct Magazine
+		{
+			void* units[MagazineSize];
+			size_t count;
+			unsigned char padding[64];	// prevent false-sharing with next magazine.
+		};
+		FORCEINLINE Magazine* CurrentMagazine(void)
+		{
+			size_t index = DKThreadSlot::Index();
+			return index < MaxThreads ? &magazines[index] : NULL;
+		}
+		void Flush(Magazine* m)
+		{
+			if (m->count > 0)
+			{
+				allocator.DeallocBatch(m->units, m->count);
+				m->count = 0;
+			}
+		}
+		void FlushAll(void)
+		{
+			for (Magazine& m : magazines)
+				Flush(&m);
+		}
+
+		FixedSizeAllocator allocator;
+		Magazine magazines[MaxThreads];
+	};
+}
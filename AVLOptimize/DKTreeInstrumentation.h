@@ -0,0 +1,141 @@
+//
+//  File: DKTreeInstrumentation.h
+//  Author: Hongtae Kim (tiff2766@gmail.com)
+//
+//  Copyright (c) 2004-2015 Hongtae Kim. All rights reserved.
+//
+
+#pragma once
+#include <cstring>
+
+////////////////////////////////////////////////////////////////////////////////
+// DKTreeInstrumentation
+// instrumentation policy of DKAVLTree, counts operations of tree.
+//
+// DKTreeNoInstrumentation (default): all functions are empty, compiled away.
+// DKTreeOperationCounter: counts comparator calls on search path, rotations,
+//  balancing steps and search path length (depth histogram).
+//
+// Policy should provide:
+//  void Compare(void)		comparator called on search path of Insert,
+//							Update, Remove, Find
+//  void LeftRotate(void)	LeftRotate called
+//  void RightRotate(void)	RightRotate called
+//  void Balance(void)		Balance, Balancing called (one retracing step)
+//  void EndSearch(void)	search of Insert, Update, Remove, Find finished
+//
+// Note:
+//  instrumentation object is not thread-safe, it is modified by const
+//  functions (Find). parallel operations (threads > 1) of instrumented tree
+//  should not be used.
+//
+// DKTreeShapeProfile: depth of all nodes, can be used with any instrumentation.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace DKFoundation
+{
+	struct DKTreeNoInstrumentation
+	{
+		enum { Enabled = false };
+
+		FORCEINLINE void Compare(void)		{}
+		FORCEINLINE void LeftRotate(void)	{}
+		FORCEINLINE void RightRotate(void)	{}
+		FORCEINLINE void Balance(void)		{}
+		FORCEINLINE void EndSearch(void)	{}
+	};
+
+	struct DKTreeOperationCounter
+	{
+		enum { Enabled = true };
+		enum : size_t { MaxDepth = 64 };	// deeper searches are counted in last bin.
+
+		DKTreeOperationCounter(void)
+		{
+			Reset();
+		}
+
+		FORCEINLINE void Compare(void)
+		{
+			comparisons++;
+			pathLength++;
+		}
+		FORCEINLINE void LeftRotate(void)	{ leftRotations++; }
+		FORCEINLINE void RightRotate(void)	{ rightRotations++; }
+		FORCEINLINE void Balance(void)		{ balances++; }
+		FORCEINLINE void EndSearch(void)
+		{
+			searches++;
+			totalDepth += pathLength;
+			depthHistogram[pathLength < MaxDepth ? pathLength : MaxDepth - 1]++;
+			pathLength = 0;
+		}
+
+		void Reset(void)
+		{
+			comparisons = 0;
+			leftRotations = 0;
+			rightRotations = 0;
+			balances = 0;
+			searches = 0;
+			totalDepth = 0;
+			pathLength = 0;
+			memset(depthHistogram, 0, sizeof(depthHistogram));
+		}
+		// average number of nodes visited by search.
+		double AverageDepth(void) const
+		{
+			return searches ? double(totalDepth) / double(searches) : 0.0;
+		}
+
+		size_t comparisons;
+		size_t leftRotations;
+		size_t rightRotations;
+		size_t balances;
+		size_t searches;
+		size_t totalDepth;					// sum of search path length
+		size_t depthHistogram[MaxDepth];	// number of searches by path length
+
+	private:
+		size_t pathLength;					// path length of current search
+	};
+
+	// depth of all nodes (tree shape), depth of root node is 1.
+	struct DKTreeShapeProfile
+	{
+		enum : size_t { MaxDepth = 64 };
+
+		size_t count;
+		size_t height;
+		size_t totalDepth;
+		size_t depthHistogram[MaxDepth];	// number of nodes by depth
+
+		double AverageDepth(void) const
+		{
+			return count ? double(totalDepth) / double(count) : 0.0;
+		}
+
+		template <typename Node> static DKTreeShapeProfile Profile(const Node* rootNode)
+		{
+			DKTreeShapeProfile profile;
+			memset(&profile, 0, sizeof(profile));
+			if (rootNode)
+				profile.Visit(rootNode, 1);
+			return profile;
+		}
+
+	private:
+		template <typename Node> void Visit(const Node* node, size_t depth)
+		{
+			count++;
+			totalDepth += depth;
+			if (depth > height)
+				height = depth;
+			depthHistogram[depth < MaxDepth ? depth : MaxDepth - 1]++;
+			if (node->left)
+				Visit(node->left, depth + 1);
+			if (node->right)
+				Visit(node->right, depth + 1);
+		}
+	};
+}
@@ -8,6 +8,13 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include <string>
+#include <cmath>
+#include <cerrno>
+#include <limits>
 
 struct DKMemoryDefaultAllocator
 {
@@ -43,16 +50,46 @@ const int debugMode = false;
 
 #include "DKAVLTree.h"
 #include "DKAVLTree2.h"
+#include "DKCompactAVLTree.h"
+#include "DKIndexedAVLTree.h"
+#include "DKBlockAVLTree.h"
+#include "DKPersistentAVLTree.h"
+#include "DKShardedAVLTree.h"
+#include "DKConcurrentAVLTree.h"
 
 #include "DKTimer.h"
 #include "DKFixedSizeAllocator.h"
+#include "DKThreadCachedAllocator.h"
 
 
 using Tree1Alloc = DKFoundation::DKFixedSizeAllocator<DKFoundation::DKAVLTree<u_int32_t, u_int32_t>::NodeSize()>;
 using Tree2Alloc = DKFoundation::DKFixedSizeAllocator<DKFoundation2::DKAVLTree<u_int32_t>::NodeSize()>;
+using Tree2SAlloc = DKFoundation::DKFixedSizeAllocator<DKFoundation2::DKAVLTree<u_int32_t,
+	DKFoundation2::DKTreeItemComparator<u_int32_t, u_int32_t>,
+	DKFoundation2::DKTreeItemReplacer<u_int32_t>,
+	DKMemoryDefaultAllocator,
+	DKFoundation2::DKTreeSizeAugmentation>::NodeSize()>;
+using Tree3Alloc = DKFoundation::DKFixedSizeAllocator<DKFoundation2::DKCompactAVLTree<u_int32_t>::NodeSize(),
+	alignof(DKFoundation2::DKCompactAVLTree<u_int32_t>::Node)>;
+using Tree5Alloc = DKFoundation::DKFixedSizeAllocator<DKFoundation2::DKBlockAVLTree<u_int32_t>::NodeSize(),
+	alignof(DKFoundation2::DKBlockAVLTree<u_int32_t>::Node)>;
+// aligned chunk, O(1) Dealloc
+using Tree1AAlloc = DKFoundation::DKFixedSizeAllocator<DKFoundation::DKAVLTree<u_int32_t, u_int32_t>::NodeSize(),
+	1, 1024, DKSpinLock, DKMemoryDefaultAllocator, DKFoundation::DKMemoryAlignedAllocator, true>;
+using Tree2AAlloc = DKFoundation::DKFixedSizeAllocator<DKFoundation2::DKAVLTree<u_int32_t>::NodeSize(),
+	1, 1024, DKSpinLock, DKMemoryDefaultAllocator, DKFoundation::DKMemoryAlignedAllocator, true>;
+// large aligned chunk (multi-megabytes) mapped with huge pages
+using Tree1HAlloc = DKFoundation::DKFixedSizeAllocator<DKFoundation::DKAVLTree<u_int32_t, u_int32_t>::NodeSize(),
+	1, 0x10000, DKSpinLock, DKMemoryDefaultAllocator, DKFoundation::DKMemoryMappedAllocator, true>;
 
 Tree1Alloc t1alloc;
 Tree2Alloc t2alloc;
+Tree2SAlloc t2salloc;
+Tree3Alloc t3alloc;
+Tree5Alloc t5alloc;
+Tree1AAlloc t1aalloc;
+Tree2AAlloc t2aalloc;
+Tree1HAlloc t1halloc;
 
 
 struct Tree1Allocator
@@ -67,6 +104,42 @@ struct Tree2Allocator
 	static void Free(void* p)		{ t2alloc.Dealloc(p); }
 };
 
+struct Tree3Allocator
+{
+	static void* Alloc(size_t s) { return t3alloc.Alloc(s); }
+	static void Free(void* p)		{ t3alloc.Dealloc(p); }
+};
+
+struct Tree5Allocator
+{
+	static void* Alloc(size_t s) { return t5alloc.Alloc(s); }
+	static void Free(void* p)		{ t5alloc.Dealloc(p); }
+};
+
+struct Tree1AAllocator
+{
+	static void* Alloc(size_t s) { return t1aalloc.Alloc(s); }
+	static void Free(void* p)		{ t1aalloc.Dealloc(p); }
+};
+
+struct Tree2AAllocator
+{
+	static void* Alloc(size_t s) { return t2aalloc.Alloc(s); }
+	static void Free(void* p)		{ t2aalloc.Dealloc(p); }
+};
+
+struct Tree1HAllocator
+{
+	static void* Alloc(size_t s) { return t1halloc.Alloc(s); }
+	static void Free(void* p)		{ t1halloc.Dealloc(p); }
+};
+
+struct Tree2SAllocator
+{
+	static void* Alloc(size_t s) { return t2salloc.Alloc(s); }
+	static void Free(void* p)		{ t2salloc.Dealloc(p); }
+};
+
 using Tree1 = DKFoundation::DKAVLTree<u_int32_t, u_int32_t,
 	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
 	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
@@ -78,103 +151,1834 @@ using Tree2 = DKFoundation2::DKAVLTree<u_int32_t,
 	DKFoundation::DKTreeCopyValue<u_int32_t>,
 	Tree2Allocator>;
 
-using Timer = DKFoundation::DKTimer;
+// Tree1, Tree2 with aligned chunk allocator
+using Tree1A = DKFoundation::DKAVLTree<u_int32_t, u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	Tree1AAllocator>;
+
+using Tree2A = DKFoundation2::DKAVLTree<u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	Tree2AAllocator>;
+
+// Tree1 with large chunk allocator (huge pages)
+using Tree1H = DKFoundation::DKAVLTree<u_int32_t, u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	Tree1HAllocator>;
+
+// Tree1, Tree2 with tree-private pool (Clear releases all nodes at once)
+using Tree1F = DKFoundation::DKAVLTree<u_int32_t, u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	DKFoundation::DKFixedSizePool<DKFoundation::DKAVLTree<u_int32_t, u_int32_t>::NodeSize(),
+		DKFoundation::DKAVLTree<u_int32_t, u_int32_t>::NodeAlignment()>>;
+
+using Tree2F = DKFoundation2::DKAVLTree<u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	DKFoundation::DKFixedSizePool<DKFoundation2::DKAVLTree<u_int32_t>::NodeSize(),
+		DKFoundation2::DKAVLTree<u_int32_t>::NodeAlignment()>>;
+
+// Tree1, Tree2 with operation counter (instrumentation)
+using Tree1I = DKFoundation::DKAVLTree<u_int32_t, u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	Tree1Allocator,
+	DKFoundation::DKTreeOperationCounter>;
+
+using Tree2I = DKFoundation2::DKAVLTree<u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	Tree2Allocator,
+	DKFoundation2::DKTreeNoAugmentation,
+	DKFoundation::DKTreeOperationCounter>;
+
+// Tree2 with sub-tree size (order-statistics)
+using Tree2S = DKFoundation2::DKAVLTree<u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	Tree2SAllocator,
+	DKFoundation2::DKTreeSizeAugmentation>;
+
+// Tree2 with compact node (balance factor in left-node pointer)
+using Tree3 = DKFoundation2::DKCompactAVLTree<u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	Tree3Allocator>;
+
+// Tree1 with 32bit index links (per-tree node pool)
+using Tree4 = DKFoundation::DKIndexedAVLTree<u_int32_t, u_int32_t>;
+
+// Tree2 with path-copying (snapshot), versions can be released on other thread.
+using TreeP = DKFoundation2::DKPersistentAVLTree<u_int32_t,
+	DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	DKMemoryDefaultAllocator>;
+
+// Tree1 with fine-grained locking, lookups are lock-free.
+using TreeC = DKFoundation::DKConcurrentAVLTree<u_int32_t, u_int32_t>;
+
+// Tree2 with fat node (sorted block of values)
+using Tree5 = DKFoundation2::DKBlockAVLTree<u_int32_t,
+	DKFoundation2::DKTreeItemComparator<u_int32_t, u_int32_t>,
+	DKFoundation::DKTreeCopyValue<u_int32_t>,
+	Tree5Allocator>;
+
+using Timer = DKFoundation::DKTimer;
+
+template <typename T, size_t Num> size_t NumArrayItems(T(&)[Num])
+{
+	return Num;
+}
+
+template <typename Node>
+void EnumerateTreeNode(Node* node, std::vector<Node*>& vec)
+{
+	if (node->left)
+		EnumerateTreeNode(node->left, vec);
+	vec.push_back(node);
+	if (node->right)
+		EnumerateTreeNode(node->right, vec);
+}
+
+// mixed workload from all threads, insert:find:remove = 2:1:1
+template <typename Tree, typename Comparator>
+void ShardedWorkload(Tree& tree, const std::vector<u_int32_t>& samples, size_t numThreads, Comparator& comp)
+{
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([&, t]()
+		{
+			for (size_t i = t; i < samples.size(); i += numThreads)
+			{
+				switch (i % 4)
+				{
+				case 0:
+				case 1:
+					tree.Insert(samples[i]);
+					break;
+				case 2:
+					tree.Find(samples[i], comp);
+					break;
+				default:
+					tree.Remove(samples[i - 3], comp);
+					break;
+				}
+			}
+		});
+	}
+	for (std::thread& t : threads)
+		t.join();
+}
+
+// Tree1 locked by single mutex, baseline of concurrent tree.
+struct LockedTree1
+{
+	bool Insert(u_int32_t v)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return tree.Insert(v) != NULL;
+	}
+	bool Remove(u_int32_t k)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		size_t count = tree.Count();
+		tree.Remove(k);
+		return tree.Count() < count;
+	}
+	bool Find(u_int32_t k)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return tree.Find(k) != NULL;
+	}
+	size_t Count(void)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return tree.Count();
+	}
+	std::mutex lock;
+	Tree1 tree;
+};
+
+// mixed workload from all threads, numFinds out of 10 ops are find,
+// others are insert and remove alternately.
+template <typename Tree>
+void ConcurrentWorkload(Tree& tree, const std::vector<u_int32_t>& samples, size_t numThreads, size_t numFinds)
+{
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([&, t]()
+		{
+			size_t writes = 0;
+			for (size_t i = t; i < samples.size(); i += numThreads)
+			{
+				if (i % 10 < numFinds)
+					tree.Find(samples[i]);
+				else if (writes++ % 2)
+					tree.Remove(samples[i]);
+				else
+					tree.Insert(samples[i]);
+			}
+		});
+	}
+	for (std::thread& t : threads)
+		t.join();
+}
+
+struct MallocAllocator
+{
+	void* Alloc(size_t s)	{ return ::malloc(s); }
+	void Dealloc(void* p)	{ ::free(p); }
+};
+
+// alloc/free from all threads, each thread allocates numUnits / numThreads units.
+// local: units are freed by allocating thread in small batches.
+// remote: units are freed by next thread after all threads allocated.
+template <typename Allocator>
+double AllocatorWorkload(Allocator& allocator, size_t size, size_t numUnits, size_t numThreads, bool remote)
+{
+	const size_t batch = 256;
+	std::vector<std::vector<void*>> units(numThreads);
+	std::vector<std::thread> threads;
+	DKFoundation::DKTimer timer;
+	timer.Reset();
+	for (size_t t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([&, t]()
+		{
+			std::vector<void*>& vec = units[t];
+			vec.reserve(remote ? numUnits / numThreads : batch);
+			for (size_t i = 0; i < numUnits / numThreads; ++i)
+			{
+				vec.push_back(allocator.Alloc(size));
+				if (!remote && vec.size() == batch)
+				{
+					for (void* p : vec)
+						allocator.Dealloc(p);
+					vec.clear();
+				}
+			}
+		});
+	}
+	for (std::thread& t : threads)
+		t.join();
+	threads.clear();
+	for (size_t t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([&, t]()
+		{
+			for (void* p : units[(t + 1) % numThreads])
+				allocator.Dealloc(p);
+		});
+	}
+	for (std::thread& t : threads)
+		t.join();
+	return timer.Elapsed();
+}
+
+// baseline of fragmented allocator test, chunk table is scanned (first-fit)
+// when cached chunk is full, as DKFixedSizeAllocator without partial chunk lists.
+class FirstFitPool
+{
+public:
+	FirstFitPool(size_t unitSize, size_t unitsPerChunk)
+		: unitSize(std::max(unitSize, sizeof(u_int32_t))), unitsPerChunk(unitsPerChunk), cachedChunk(NULL)
+	{
+	}
+	~FirstFitPool(void)
+	{
+		for (Chunk& c : chunks)
+			free(c.units);
+	}
+	void Reserve(size_t n)
+	{
+		while (chunks.size() * unitsPerChunk < n)
+			AddChunk();
+	}
+	void* Alloc(size_t)
+	{
+		if (cachedChunk && cachedChunk->occupied < unitsPerChunk)
+			return AllocUnit(cachedChunk);
+		for (Chunk& c : chunks)
+		{
+			if (c.occupied < unitsPerChunk)
+			{
+				cachedChunk = &c;
+				return AllocUnit(cachedChunk);
+			}
+		}
+		cachedChunk = AddChunk();
+		return AllocUnit(cachedChunk);
+	}
+	void Dealloc(void* p)
+	{
+		char* unit = reinterpret_cast<char*>(p);
+		auto it = std::upper_bound(chunks.begin(), chunks.end(), unit,
+								   [](char* u, const Chunk& c) { return u < c.units; });
+		Chunk& c = *(--it);
+		u_int32_t index = (u_int32_t)((unit - c.units) / unitSize);
+		*reinterpret_cast<u_int32_t*>(unit) = c.freeUnitIndex;
+		c.freeUnitIndex = index;
+		c.occupied--;
+	}
+private:
+	struct Chunk
+	{
+		char* units;
+		u_int32_t freeUnitIndex;
+		size_t occupied;
+	};
+	// chunk table is sorted by address.
+	Chunk* AddChunk(void)
+	{
+		Chunk chunk = { reinterpret_cast<char*>(malloc(unitSize * unitsPerChunk)), 0, 0 };
+		for (size_t i = 0; i < unitsPerChunk; ++i)
+			*reinterpret_cast<u_int32_t*>(chunk.units + i * unitSize) = (u_int32_t)(i + 1);
+		char* cachedUnits = cachedChunk ? cachedChunk->units : NULL;
+		auto it = chunks.insert(std::upper_bound(chunks.begin(), chunks.end(), chunk.units,
+												 [](char* u, const Chunk& c) { return u < c.units; }), chunk);
+		Chunk* added = &(*it);
+		cachedChunk = NULL;
+		for (Chunk& c : chunks)
+		{
+			if (c.units == cachedUnits)
+				cachedChunk = &c;
+		}
+		return added;
+	}
+	FORCEINLINE void* AllocUnit(Chunk* c)
+	{
+		char* unit = c->units + c->freeUnitIndex * unitSize;
+		c->freeUnitIndex = *reinterpret_cast<u_int32_t*>(unit);
+		c->occupied++;
+		return unit;
+	}
+
+	const size_t unitSize;
+	const size_t unitsPerChunk;
+	std::vector<Chunk> chunks;
+	Chunk* cachedChunk;
+};
+
+// random units are freed from full pool, then each alloc is followed by random free.
+// returns sorted alloc latency, allocated units are left in units.
+template <typename Allocator>
+std::vector<double> FragmentedAllocLatency(Allocator& allocator, size_t size, const std::vector<u_int32_t>& samples,
+										   size_t numUnits, size_t numOps, std::vector<void*>& units)
+{
+	DKFoundation::DKTimer timer;
+	units.clear();
+	units.reserve(numUnits);
+	allocator.Reserve(numUnits);
+	for (size_t i = 0; i < numUnits; ++i)
+		units.push_back(allocator.Alloc(size));
+	for (size_t i = 0; i < numUnits / 10; ++i)
+	{
+		size_t k = samples[i] % units.size();
+		allocator.Dealloc(units[k]);
+		units[k] = units.back();
+		units.pop_back();
+	}
+	std::vector<double> latency;
+	latency.reserve(numOps);
+	for (size_t i = 0; i < numOps; ++i)
+	{
+		timer.Reset();
+		void* p = allocator.Alloc(size);
+		latency.push_back(timer.Elapsed());
+
+		size_t k = samples[numUnits / 10 + i] % units.size();
+		allocator.Dealloc(units[k]);
+		units[k] = p;
+	}
+	std::sort(latency.begin(), latency.end());
+	return latency;
+}
+
+void PrintAllocatorStatistics(const char* name, const DKFoundation::DKFixedSizeAllocatorStatistics& st)
+{
+	printf("%s: unit: %zu bytes, chunk: %zu bytes (%zu units)\n", name, st.unitSize, st.chunkSize, st.unitsPerChunk);
+	printf("  chunks: %zu (empty: %zu, partial: %zu, full: %zu, peak: %zu)\n",
+		   st.numChunks, st.emptyChunks, st.partialChunks, st.fullChunks, st.peakChunks);
+	printf("  occupancy:");
+	for (size_t i = 0; i < st.NumOccupancyBins; ++i)
+		printf(" %zu", st.occupancy[i]);
+	printf("\n");
+	printf("  units: %zu (peak: %zu), bytes in use: %zu, reserved: %zu (peak: %zu)\n",
+		   st.numAllocated, st.peakAllocated, st.bytesInUse, st.bytesReserved, st.peakBytesReserved);
+	printf("  alloc: %zu, dealloc: %zu, purge: %zu (%zu chunks), cached chunk hit: %zu, miss: %zu (%.2f%%)\n",
+		   st.allocCount, st.deallocCount, st.purgeCount, st.purgedChunks, st.cacheHits, st.cacheMisses,
+		   st.allocCount ? st.cacheHits * 100.0 / st.allocCount : 0.0);
+}
+
+void PrintOperationCounter(const char* name, const DKFoundation::DKTreeOperationCounter& c)
+{
+	printf("%s: searches: %zu, comparisons: %zu, rotations: %zu (left: %zu, right: %zu), balancing: %zu, average depth: %.2f\n",
+		   name, c.searches, c.comparisons, c.leftRotations + c.rightRotations, c.leftRotations, c.rightRotations,
+		   c.balances, c.AverageDepth());
+	printf("  search depth:");
+	for (size_t i = 0; i < c.MaxDepth; ++i)
+	{
+		if (c.depthHistogram[i])
+			printf(" %zu:%zu", i, c.depthHistogram[i]);
+	}
+	printf("\n");
+}
+
+void PrintTreeShape(const char* name, const DKFoundation::DKTreeShapeProfile& p)
+{
+	printf("%s shape: nodes: %zu, height: %zu, average depth: %.2f\n  node depth:", name, p.count, p.height, p.AverageDepth());
+	for (size_t i = 0; i < p.MaxDepth; ++i)
+	{
+		if (p.depthHistogram[i])
+			printf(" %zu:%zu", i, p.depthHistogram[i]);
+	}
+	printf("\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark driver (--bench)
+// workload is generated from seed before measurement, same seed reproduces
+// same keys and operations for all trees.
+//
+// tree is pre-filled with 'size' keys (even keys 0, 2, 4, ... in distribution
+// order), then 'ops' operations are measured. keys of operations are drawn
+// from distribution in range [0, range), (range = size * 2 by default)
+// repetitions (and warmup runs) are interleaved across trees.
+////////////////////////////////////////////////////////////////////////////////
+enum class KeyDistribution
+{
+	Uniform,
+	Zipfian,		// scrambled, hot keys are spread over range.
+	Sequential,
+	Reverse,
+	Clustered,		// runs of keys near random position.
+};
+
+enum class BenchmarkOutput
+{
+	Text,
+	CSV,
+	JSON,
+};
+
+struct BenchmarkConfig
+{
+	bool enabled = false;
+	KeyDistribution distribution = KeyDistribution::Uniform;
+	double zipfTheta = 0.99;
+	size_t clusterSize = 1024;		// width of cluster
+	size_t clusterRun = 64;			// keys per cluster
+	size_t size = 0x100000;			// pre-filled items
+	size_t range = 0;				// key range (0: size * 2)
+	size_t ops = 0x100000;			// measured operations
+	unsigned int mix[4] = { 80, 10, 10, 0 };	// read, insert, remove, update (ratio)
+	size_t warmup = 1;
+	size_t repeat = 5;
+	u_int64_t seed = 1;
+	BenchmarkOutput output = BenchmarkOutput::Text;
+	std::vector<std::string> trees = { "Tree1", "Tree2" };
+};
+
+const char* KeyDistributionName(KeyDistribution d)
+{
+	switch (d)
+	{
+		case KeyDistribution::Uniform:		return "uniform";
+		case KeyDistribution::Zipfian:		return "zipfian";
+		case KeyDistribution::Sequential:	return "sequential";
+		case KeyDistribution::Reverse:		return "reverse";
+		case KeyDistribution::Clustered:	return "clustered";
+	}
+	return "";
+}
+
+// seeded key generator, keys are in range [0, range).
+class KeyGenerator
+{
+public:
+	KeyGenerator(const BenchmarkConfig& config, size_t range, u_int64_t seed)
+		: distribution(config.distribution), range(range ? range : 1), rng(seed), counter(0)
+		, clusterSize(std::max(config.clusterSize, (size_t)1)), clusterRun(std::max(config.clusterRun, (size_t)1)), clusterBase(0)
+		, theta(config.zipfTheta), zetan(0), alpha(0), eta(0)
+	{
+		if (distribution == KeyDistribution::Zipfian)
+		{
+			// Gray et al. "Quickly generating billion-record synthetic databases"
+			for (size_t i = 1; i <= this->range; ++i)
+				zetan += 1.0 / pow(double(i), theta);
+			double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+			alpha = 1.0 / (1.0 - theta);
+			eta = (1.0 - pow(2.0 / double(this->range), 1.0 - theta)) / (1.0 - zeta2 / zetan);
+		}
+	}
+	u_int32_t Next(void)
+	{
+		switch (distribution)
+		{
+			case KeyDistribution::Uniform:
+				return (u_int32_t)(rng() % range);
+			case KeyDistribution::Zipfian:
+				return (u_int32_t)(Scramble(ZipfianRank()) % range);
+			case KeyDistribution::Sequential:
+				return (u_int32_t)(counter++ % range);
+			case KeyDistribution::Reverse:
+				return (u_int32_t)(range - 1 - (counter++ % range));
+			case KeyDistribution::Clustered:
+				if (counter++ % clusterRun == 0)
+					clusterBase = rng() % range;
+				return (u_int32_t)((clusterBase + rng() % clusterSize) % range);
+		}
+		return 0;
+	}
+	u_int64_t Random(void)	{ return rng(); }
+
+private:
+	size_t ZipfianRank(void)
+	{
+		double u = double(rng() >> 11) * (1.0 / 9007199254740992.0);	// [0, 1)
+		double uz = u * zetan;
+		if (uz < 1.0)
+			return 0;
+		if (uz < 1.0 + pow(0.5, theta))
+			return 1;
+		size_t rank = (size_t)(double(range) * pow(eta * u - eta + 1.0, alpha));
+		return rank < range ? rank : range - 1;
+	}
+	static u_int64_t Scramble(u_int64_t x)	// splitmix64 finalizer
+	{
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	KeyDistribution distribution;
+	size_t range;
+	std::mt19937_64 rng;
+	size_t counter;
+	size_t clusterSize;
+	size_t clusterRun;
+	size_t clusterBase;
+	double theta;
+	double zetan;
+	double alpha;
+	double eta;
+};
+
+enum class BenchmarkOperationType : u_int8_t
+{
+	Read,
+	Insert,
+	Remove,
+	Update,
+};
+
+struct BenchmarkWorkload
+{
+	std::vector<u_int32_t> prefill;
+	std::vector<u_int32_t> keys;
+	std::vector<BenchmarkOperationType> types;
+
+	BenchmarkWorkload(const BenchmarkConfig& config)
+	{
+		size_t range = config.range ? config.range : std::max(config.size * 2, (size_t)1);
+		KeyGenerator gen(config, range, config.seed);
+
+		// pre-fill with even keys, in order of distribution.
+		prefill.reserve(config.size);
+		for (size_t i = 0; i < config.size; ++i)
+			prefill.push_back((u_int32_t)((i * 2) % range));
+		if (config.distribution == KeyDistribution::Reverse)
+			std::reverse(prefill.begin(), prefill.end());
+		else if (config.distribution != KeyDistribution::Sequential)
+		{
+			for (size_t i = prefill.size(); i > 1; --i)
+				std::swap(prefill[i - 1], prefill[gen.Random() % i]);
+		}
+
+		unsigned int total = config.mix[0] + config.mix[1] + config.mix[2] + config.mix[3];
+		keys.reserve(config.ops);
+		types.reserve(config.ops);
+		for (size_t i = 0; i < config.ops; ++i)
+		{
+			unsigned int r = total ? (unsigned int)(gen.Random() % total) : 0;
+			unsigned int t = 0;
+			while (t < 3 && r >= config.mix[t])
+				r -= config.mix[t++];
+			types.push_back((BenchmarkOperationType)t);
+			keys.push_back(gen.Next());
+		}
+	}
+};
+
+// tree operations for benchmark, Tree1 style (key lookup)
+struct KeyLookupOps
+{
+	template <typename Tree> static bool Find(const Tree& tree, u_int32_t k)	{ return tree.Find(k) ? true : false; }
+	template <typename Tree> static void Remove(Tree& tree, u_int32_t k)		{ tree.Remove(k); }
+};
+// tree operations for benchmark, Tree2 style (lookup with comparator)
+struct ComparatorLookupOps
+{
+	using Comparator = DKFoundation2::DKTreeItemComparator<u_int32_t, u_int32_t>;
+	template <typename Tree> static bool Find(const Tree& tree, u_int32_t k)	{ return tree.Find(k, Comparator()) ? true : false; }
+	template <typename Tree> static void Remove(Tree& tree, u_int32_t k)		{ tree.Remove(k, Comparator()); }
+};
+
+struct BenchmarkRun
+{
+	double elapsed;
+	size_t found;
+	size_t count;
+};
+
+// build tree with pre-filled items and run operations, only operations are measured.
+template <typename Tree, typename Ops> BenchmarkRun RunWorkload(const BenchmarkWorkload& w)
+{
+	BenchmarkRun run = { 0, 0, 0 };
+	Tree tree;
+	for (u_int32_t k : w.prefill)
+		tree.Insert(k);
+
+	const u_int32_t* keys = w.keys.data();
+	const BenchmarkOperationType* types = w.types.data();
+	const size_t n = w.keys.size();
+
+	DKFoundation::DKTimer timer;
+	timer.Reset();
+	for (size_t i = 0; i < n; ++i)
+	{
+		switch (types[i])
+		{
+			case BenchmarkOperationType::Read:
+				if (Ops::Find(tree, keys[i]))
+					run.found++;
+				break;
+			case BenchmarkOperationType::Insert:
+				tree.Insert(keys[i]);
+				break;
+			case BenchmarkOperationType::Remove:
+				Ops::Remove(tree, keys[i]);
+				break;
+			case BenchmarkOperationType::Update:
+				tree.Update(keys[i]);
+				break;
+		}
+	}
+	run.elapsed = timer.Elapsed();
+	run.count = tree.Count();
+	return run;
+}
+
+struct BenchmarkTree
+{
+	const char* name;
+	BenchmarkRun (*run)(const BenchmarkWorkload&);
+};
+
+const BenchmarkTree benchmarkTrees[] =
+{
+	{ "Tree1", RunWorkload<Tree1, KeyLookupOps> },
+	{ "Tree1A", RunWorkload<Tree1A, KeyLookupOps> },		// aligned chunk pool
+	{ "Tree1F", RunWorkload<Tree1F, KeyLookupOps> },		// tree-private pool
+	{ "Tree1H", RunWorkload<Tree1H, KeyLookupOps> },		// large chunk pool (huge pages)
+	{ "Tree1M", RunWorkload<DKFoundation::DKAVLTree<u_int32_t, u_int32_t>, KeyLookupOps> },	// malloc
+	{ "Tree2", RunWorkload<Tree2, ComparatorLookupOps> },
+	{ "Tree2A", RunWorkload<Tree2A, ComparatorLookupOps> },
+	{ "Tree2F", RunWorkload<Tree2F, ComparatorLookupOps> },
+	{ "Tree2M", RunWorkload<DKFoundation2::DKAVLTree<u_int32_t>, ComparatorLookupOps> },
+	{ "Tree3", RunWorkload<Tree3, ComparatorLookupOps> },
+	{ "Tree4", RunWorkload<Tree4, KeyLookupOps> },
+	{ "Tree5", RunWorkload<Tree5, ComparatorLookupOps> },
+	{ "TreeC", RunWorkload<TreeC, KeyLookupOps> },
+};
+
+struct BenchmarkResult
+{
+	const BenchmarkTree* tree;
+	std::vector<double> times;
+	BenchmarkRun last;
+
+	double Median(void) const
+	{
+		std::vector<double> t(times);
+		std::sort(t.begin(), t.end());
+		size_t n = t.size();
+		return n ? (n % 2 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) * 0.5) : 0.0;
+	}
+	double Mean(void) const
+	{
+		double sum = 0;
+		for (double d : times)
+			sum += d;
+		return times.size() ? sum / times.size() : 0.0;
+	}
+	double StdDev(void) const	// sample standard deviation
+	{
+		if (times.size() < 2)
+			return 0.0;
+		double mean = Mean();
+		double sum = 0;
+		for (double d : times)
+			sum += (d - mean) * (d - mean);
+		return sqrt(sum / (times.size() - 1));
+	}
+	double Min(void) const	{ return times.empty() ? 0.0 : *std::min_element(times.begin(), times.end()); }
+	double Max(void) const	{ return times.empty() ? 0.0 : *std::max_element(times.begin(), times.end()); }
+};
+
+void PrintBenchmarkUsage(void)
+{
+	fprintf(stderr,
+			"usage: AVLOptimize [--bench [options]]\n"
+			"  without --bench, fixed test suite is run. (--seed is applied)\n"
+			"  --dist=uniform|zipfian|sequential|reverse|clustered  key distribution (uniform)\n"
+			"  --theta=T            zipfian exponent, 0 < T < 1 (0.99)\n"
+			"                       (zipfian setup is O(range))\n"
+			"  --cluster=W,R        cluster width, keys per cluster (1024,64)\n"
+			"  --size=N             pre-filled items (1048576)\n"
+			"  --range=N            key range (size*2)\n"
+			"  --ops=N              measured operations (1048576)\n"
+			"  --mix=R:I:D:U        read, insert, remove, update ratio (80:10:10:0)\n"
+			"  --warmup=N           warmup runs (1)\n"
+			"  --repeat=N           measured runs (5)\n"
+			"  --seed=N             random seed (1)\n"
+			"  --format=text|csv|json  output format (text)\n"
+			"  --trees=A,B,...      trees to compare (Tree1,Tree2)\n"
+			"  trees:");
+	for (const BenchmarkTree& t : benchmarkTrees)
+		fprintf(stderr, " %s", t.name);
+	fprintf(stderr, "\n");
+}
+
+// returns false if value is not a number or out of range.
+template <typename T> bool ParseBenchmarkNumber(const std::string& value, T& result)
+{
+	if (value.empty() || value[0] == '-')
+		return false;
+	char* end = NULL;
+	errno = 0;
+	unsigned long long n = strtoull(value.c_str(), &end, 0);
+	if (errno != 0 || end == value.c_str() || *end != '\0')
+		return false;
+	if (n > (unsigned long long)std::numeric_limits<T>::max())
+		return false;
+	result = (T)n;
+	return true;
+}
+
+// returns false if arguments are invalid.
+bool ParseBenchmarkConfig(int argc, const char* argv[], BenchmarkConfig& config)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		std::string name = arg.substr(0, arg.find('='));
+		std::string value = arg.find('=') == std::string::npos ? "" : arg.substr(arg.find('=') + 1);
+		if (name == "--bench")
+			config.enabled = true;
+		else if (name == "--dist")
+		{
+			if (value == "uniform")				config.distribution = KeyDistribution::Uniform;
+			else if (value == "zipfian")		config.distribution = KeyDistribution::Zipfian;
+			else if (value == "sequential")		config.distribution = KeyDistribution::Sequential;
+			else if (value == "reverse")		config.distribution = KeyDistribution::Reverse;
+			else if (value == "clustered")		config.distribution = KeyDistribution::Clustered;
+			else return false;
+		}
+		else if (name == "--theta")
+		{
+			// Gray's formula requires 0 < theta < 1.
+			char* end = NULL;
+			errno = 0;
+			config.zipfTheta = strtod(value.c_str(), &end);
+			if (errno != 0 || end == value.c_str() || *end != '\0')
+				return false;
+			if (!(config.zipfTheta > 0.0 && config.zipfTheta < 1.0))
+				return false;
+		}
+		else if (name == "--cluster")
+		{
+			if (sscanf(value.c_str(), "%zu,%zu", &config.clusterSize, &config.clusterRun) != 2)
+				return false;
+		}
+		else if (name == "--size")
+		{
+			if (!ParseBenchmarkNumber(value, config.size))
+				return false;
+		}
+		else if (name == "--range")
+		{
+			if (!ParseBenchmarkNumber(value, config.range))
+				return false;
+		}
+		else if (name == "--ops")
+		{
+			if (!ParseBenchmarkNumber(value, config.ops))
+				return false;
+		}
+		else if (name == "--warmup")
+		{
+			if (!ParseBenchmarkNumber(value, config.warmup))
+				return false;
+		}
+		else if (name == "--repeat")
+		{
+			if (!ParseBenchmarkNumber(value, config.repeat))
+				return false;
+			config.repeat = std::max(config.repeat, (size_t)1);
+		}
+		else if (name == "--seed")
+		{
+			if (!ParseBenchmarkNumber(value, config.seed))
+				return false;
+		}
+		else if (name == "--mix")
+		{
+			unsigned int* m = config.mix;
+			if (sscanf(value.c_str(), "%u:%u:%u:%u", &m[0], &m[1], &m[2], &m[3]) != 4)
+				return false;
+		}
+		else if (name == "--format")
+		{
+			if (value == "text")		config.output = BenchmarkOutput::Text;
+			else if (value == "csv")	config.output = BenchmarkOutput::CSV;
+			else if (value == "json")	config.output = BenchmarkOutput::JSON;
+			else return false;
+		}
+		else if (name == "--trees")
+		{
+			config.trees.clear();
+			for (size_t pos = 0; pos <= value.size(); )
+			{
+				size_t end = std::min(value.find(',', pos), value.size());
+				config.trees.push_back(value.substr(pos, end - pos));
+				pos = end + 1;
+			}
+		}
+		else
+			return false;
+	}
+	if (config.range > 0 && config.range > 0xffffffffULL)
+		return false;
+	return true;
+}
+
+int RunBenchmark(const BenchmarkConfig& config)
+{
+	std::vector<BenchmarkResult> results;
+	for (const std::string& name : config.trees)
+	{
+		const BenchmarkTree* tree = NULL;
+		for (const BenchmarkTree& t : benchmarkTrees)
+		{
+			if (name == t.name)
+				tree = &t;
+		}
+		if (tree == NULL)
+		{
+			fprintf(stderr, "Unknown tree: %s\n", name.c_str());
+			PrintBenchmarkUsage();
+			return 1;
+		}
+		BenchmarkResult r = { tree, {}, { 0, 0, 0 } };
+		results.push_back(r);
+	}
+
+	fprintf(stderr, "Generating workload... (%s, size: %zu, ops: %zu, seed: %llu)\n",
+			KeyDistributionName(config.distribution), config.size, config.ops, (unsigned long long)config.seed);
+	BenchmarkWorkload workload(config);
+
+	for (size_t i = 0; i < config.warmup + config.repeat; ++i)
+	{
+		for (BenchmarkResult& r : results)
+		{
+			BenchmarkRun run = r.tree->run(workload);
+			if (i >= config.warmup)
+			{
+				r.times.push_back(run.elapsed);
+				r.last = run;
+			}
+		}
+	}
+
+	const size_t range = config.range ? config.range : std::max(config.size * 2, (size_t)1);
+	const unsigned int* m = config.mix;
+	if (config.output == BenchmarkOutput::CSV)
+		printf("tree,distribution,size,range,ops,read,insert,remove,update,seed,warmup,repeat,median,mean,stddev,min,max,mops,found,count\n");
+	else if (config.output == BenchmarkOutput::JSON)
+		printf("[\n");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkResult& r = results[i];
+		double median = r.Median();
+		double mops = median > 0 ? double(config.ops) / median / 1000000.0 : 0.0;
+		switch (config.output)
+		{
+			case BenchmarkOutput::Text:
+				printf("%s %s (size: %zu, range: %zu, ops: %zu, mix: %u:%u:%u:%u) median: %f (%.2f Mops/s), mean: %f, stddev: %f, min: %f, max: %f (found: %zu, count: %zu)\n",
+					   r.tree->name, KeyDistributionName(config.distribution), config.size, range, config.ops, m[0], m[1], m[2], m[3],
+					   median, mops, r.Mean(), r.StdDev(), r.Min(), r.Max(), r.last.found, r.last.count);
+				break;
+			case BenchmarkOutput::CSV:
+				printf("%s,%s,%zu,%zu,%zu,%u,%u,%u,%u,%llu,%zu,%zu,%f,%f,%f,%f,%f,%f,%zu,%zu\n",
+					   r.tree->name, KeyDistributionName(config.distribution), config.size, range, config.ops, m[0], m[1], m[2], m[3],
+					   (unsigned long long)config.seed, config.warmup, config.repeat,
+					   median, r.Mean(), r.StdDev(), r.Min(), r.Max(), mops, r.last.found, r.last.count);
+				break;
+			case BenchmarkOutput::JSON:
+				printf("  {\"tree\": \"%s\", \"distribution\": \"%s\", \"size\": %zu, \"range\": %zu, \"ops\": %zu, "
+					   "\"mix\": [%u, %u, %u, %u], \"seed\": %llu, \"warmup\": %zu, \"repeat\": %zu, "
+					   "\"median\": %f, \"mean\": %f, \"stddev\": %f, \"min\": %f, \"max\": %f, \"mops\": %f, "
+					   "\"found\": %zu, \"count\": %zu, \"times\": [",
+					   r.tree->name, KeyDistributionName(config.distribution), config.size, range, config.ops, m[0], m[1], m[2], m[3],
+					   (unsigned long long)config.seed, config.warmup, config.repeat,
+					   median, r.Mean(), r.StdDev(), r.Min(), r.Max(), mops, r.last.found, r.last.count);
+				for (size_t k = 0; k < r.times.size(); ++k)
+					printf(k ? ", %f" : "%f", r.times[k]);
+				printf("]}%s\n", i + 1 < results.size() ? "," : "");
+				break;
+		}
+	}
+	if (config.output == BenchmarkOutput::JSON)
+		printf("]\n");
+	return 0;
+}
+
+int main(int argc, const char * argv[])
+{
+	BenchmarkConfig config;
+	if (!ParseBenchmarkConfig(argc, argv, config))
+	{
+		PrintBenchmarkUsage();
+		return 1;
+	}
+	if (config.enabled)
+		return RunBenchmark(config);
+
+	printf("Debug Mode: %d\n", debugMode);
+
+	// seeded samples, (uniform in range [0, numSamples/2))
+	size_t numSamples = 0xffffff;
+	std::vector<u_int32_t> samples;
+	samples.reserve(numSamples);
+	// --dist is for --bench only, samples are always uniform.
+	BenchmarkConfig sampleConfig = config;
+	sampleConfig.distribution = KeyDistribution::Uniform;
+	KeyGenerator sampleGenerator(sampleConfig, numSamples/2, config.seed);
+	for (size_t i = 0; i < numSamples; ++i)
+		samples.push_back(sampleGenerator.Next());
+
+	// random number for tests (seeded)
+	std::mt19937 rng((u_int32_t)config.seed);
+	auto randomUniform = [&rng](size_t n) -> u_int32_t { return (u_int32_t)(rng() % n); };
+
+	printf("Reserving memory...\n");
+	t1alloc.Reserve(numSamples);
+	t2alloc.Reserve(numSamples);
+	t1aalloc.Reserve(numSamples);
+	t2aalloc.Reserve(numSamples);
+	printf("Done!\n");
+
+	Tree1 t1;
+	Tree2 t2;
+
+	const int numLoops = 1;
+
+	auto ir_test1 = [&]()
+	{
+		Timer timer;
+		size_t numInsert = 0;
+		size_t numRemove = 0;
+
+		t1.Update(1);	// warm up.
+		t1.Clear();
+
+		printf("Testing insert/remove Tree1... (%lu items x %d)\n", samples.size(), numLoops);
+
+		timer.Reset();
+		for (int i = 0; i < numLoops; ++i)
+		{
+			for (u_int32_t v : samples)
+			{
+				if (t1.Insert(v))
+					numInsert++;
+				else
+				{
+					t1.Remove(v);
+					numRemove++;
+				}
+			}
+		}
+		double d = timer.Elapsed();
+		printf("Tree1 insert: %zu / remove: %zu elapsed: %f\n", numInsert, numRemove, d);
+
+		// same workload, node allocator with aligned chunk. (O(1) Dealloc)
+		Tree1A t1a;
+		numInsert = 0;
+		numRemove = 0;
+		timer.Reset();
+		for (int i = 0; i < numLoops; ++i)
+		{
+			for (u_int32_t v : samples)
+			{
+				if (t1a.Insert(v))
+					numInsert++;
+				else
+				{
+					t1a.Remove(v);
+					numRemove++;
+				}
+			}
+		}
+		double d2 = timer.Elapsed();
+		printf("Tree1 (aligned chunk) insert: %zu / remove: %zu elapsed: %f (x%.2f)\n", numInsert, numRemove, d2, d / d2);
+	};
+
+	auto ir_test2 = [&]()
+	{
+		Timer timer;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+		size_t numInsert = 0;
+		size_t numRemove = 0;
+
+		t2.Update(1);	// warm up.
+		t2.Clear();
+
+		printf("Testing insert/remove Tree2... (%lu items x %d)\n", samples.size(), numLoops);
+		timer.Reset();
+		for (int i = 0; i < numLoops; ++i)
+		{
+			for (u_int32_t v : samples)
+			{
+				if (t2.Insert(v))
+					numInsert++;
+				else
+				{
+					t2.Remove(v, t2Comp);
+					numRemove++;
+				}
+			}
+		}
+		double d = timer.Elapsed();
+		printf("Tree2 insert: %zu / remove: %zu elapsed: %f\n", numInsert, numRemove, d);
+
+		// same workload, node allocator with aligned chunk. (O(1) Dealloc)
+		Tree2A t2a;
+		numInsert = 0;
+		numRemove = 0;
+		timer.Reset();
+		for (int i = 0; i < numLoops; ++i)
+		{
+			for (u_int32_t v : samples)
+			{
+				if (t2a.Insert(v))
+					numInsert++;
+				else
+				{
+					t2a.Remove(v, t2Comp);
+					numRemove++;
+				}
+			}
+		}
+		double d2 = timer.Elapsed();
+		printf("Tree2 (aligned chunk) insert: %zu / remove: %zu elapsed: %f (x%.2f)\n", numInsert, numRemove, d2, d / d2);
+	};
+
+	std::vector<u_int32_t> sortedSamples(samples);
+	std::sort(sortedSamples.begin(), sortedSamples.end());
+
+	auto bb_test1 = [&]()
+	{
+		Timer timer;
+
+		printf("Testing bulk-build Tree1... (%lu sorted items)\n", sortedSamples.size());
+
+		Tree1 tree;
+		timer.Reset();
+		for (u_int32_t v : sortedSamples)
+			tree.Insert(v);
+		double d1 = timer.Elapsed();
+		tree.Clear();
+
+		timer.Reset();
+		tree.Assign(sortedSamples.begin(), sortedSamples.end());
+		double d2 = timer.Elapsed();
+		printf("Tree1 bulk-build (count: %zu) insert elapsed: %f, assign elapsed: %f\n", tree.Count(), d1, d2);
+	};
+
+	auto bb_test2 = [&]()
+	{
+		Timer timer;
+
+		printf("Testing bulk-build Tree2... (%lu sorted items)\n", sortedSamples.size());
+
+		Tree2 tree;
+		timer.Reset();
+		for (u_int32_t v : sortedSamples)
+			tree.Insert(v);
+		double d1 = timer.Elapsed();
+		tree.Clear();
+
+		timer.Reset();
+		tree.Assign(sortedSamples.begin(), sortedSamples.end());
+		double d2 = timer.Elapsed();
+		printf("Tree2 bulk-build (count: %zu) insert elapsed: %f, assign elapsed: %f\n", tree.Count(), d1, d2);
+	};
+
+	size_t maxThreads = std::max(std::thread::hardware_concurrency(), 1U);
+
+	// sequential and near-sorted insertion, with and without hint.
+	auto hi_test1 = [&]()
+	{
+		Timer timer;
+		const size_t n = samples.size();
+
+		// near-sorted: each item is swapped with one of next 8 items.
+		std::vector<u_int32_t> nearSorted(sortedSamples);
+		for (size_t i = 0; i + 8 < nearSorted.size(); ++i)
+			std::swap(nearSorted[i], nearSorted[i + randomUniform(8)]);
+
+		printf("Testing hinted-insert Tree1... (%zu items)\n", n);
+
+		double d[4];
+		size_t counts[4];
+		for (int w = 0; w < 2; ++w)
+		{
+			{
+				Tree1 tree;
+				timer.Reset();
+				if (w == 0)
+				{
+					for (u_int32_t v = 0; v < n; ++v)
+						tree.Insert(v);
+				}
+				else
+				{
+					for (u_int32_t v : nearSorted)
+						tree.Insert(v);
+				}
+				d[w * 2] = timer.Elapsed();
+				counts[w * 2] = tree.Count();
+			}
+			{
+				Tree1 tree;
+				Tree1::ConstIterator hint = tree.end();
+				timer.Reset();
+				if (w == 0)
+				{
+					for (u_int32_t v = 0; v < n; ++v)
+						tree.Insert(tree.end(), v);
+				}
+				else
+				{
+					for (u_int32_t v : nearSorted)
+					{
+						auto it = tree.Insert(hint, v);
+						if (it != tree.end())
+							hint = it;
+					}
+				}
+				d[w * 2 + 1] = timer.Elapsed();
+				counts[w * 2 + 1] = tree.Count();
+			}
+		}
+		printf("Tree1 sequential (%zu) insert elapsed: %f, append elapsed: %f\n", counts[1], d[0], d[1]);
+		printf("Tree1 near-sorted (%zu) insert elapsed: %f, hinted elapsed: %f\n", counts[3], d[2], d[3]);
+		if (counts[0] != counts[1] || counts[2] != counts[3])
+			printf("ERROR hinted-insert count mismatch!\n");
+	};
+
+	// sorted batch of insert/update/remove, per-operation loop vs one merged pass.
+	auto ab_test2 = [&]()
+	{
+		Timer timer;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+		using BatchOperation = Tree2::BatchOperation;
+		using BatchOperationType = Tree2::BatchOperationType;
+
+		Tree2 base;
+		base.Assign(sortedSamples.begin(), sortedSamples.begin() + sortedSamples.size() / 2);
+
+		printf("Testing batch-update Tree2(Count: %lu)...\n", base.Count());
+
+		for (size_t batchSize = 10000; batchSize <= samples.size(); batchSize *= 10)
+		{
+			std::vector<BatchOperation> ops;
+			ops.reserve(batchSize);
+			for (size_t i = 0; i < batchSize; ++i)
+			{
+				BatchOperationType type = (i % 3 == 0) ? BatchOperationType::Insert :
+					(i % 3 == 1) ? BatchOperationType::Update : BatchOperationType::Remove;
+				ops.push_back({ type, samples[randomUniform(samples.size())] });
+			}
+			std::stable_sort(ops.begin(), ops.end(), [](const BatchOperation& a, const BatchOperation& b) { return a.value < b.value; });
+			ops.erase(std::unique(ops.begin(), ops.end(), [](const BatchOperation& a, const BatchOperation& b) { return a.value == b.value; }), ops.end());
+
+			Tree2 tree1(base);
+			Tree2 tree2(base);
+
+			size_t numInsert = 0;
+			size_t numUpdate = 0;
+			size_t numRemove = 0;
+			size_t count = 0;
+			timer.Reset();
+			for (const BatchOperation& op : ops)
+			{
+				switch (op.type)
+				{
+				case BatchOperationType::Insert:
+					if (tree1.Insert(op.value))
+						numInsert++;
+					break;
+				case BatchOperationType::Update:
+					count = tree1.Count();
+					tree1.Update(op.value);
+					if (tree1.Count() > count)
+						numInsert++;
+					else
+						numUpdate++;
+					break;
+				case BatchOperationType::Remove:
+					count = tree1.Count();
+					tree1.Remove(op.value, t2Comp);
+					if (tree1.Count() < count)
+						numRemove++;
+					break;
+				}
+			}
+			double d1 = timer.Elapsed();
+
+			timer.Reset();
+			Tree2::BatchResult result = tree2.ApplyBatch(ops.data(), ops.size());
+			double d2 = timer.Elapsed();
+
+			bool same = tree1.Count() == tree2.Count() && result.inserted == numInsert &&
+				result.updated == numUpdate && result.removed == numRemove;
+			printf("Tree2 batch (%zu ops, insert: %zu, update: %zu, remove: %zu) per-op elapsed: %f, batch elapsed: %f%s\n",
+				   ops.size(), result.inserted, result.updated, result.removed, d1, d2, same ? "" : " ERROR!");
+		}
+	};
+
+	// persistent tree: writer with/without snapshots, readers on snapshot while writer modifies.
+	auto ps_test2 = [&]()
+	{
+		Timer timer;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+		using Tree2D = DKFoundation2::DKAVLTree<u_int32_t,
+			DKFoundation::DKTreeComparison<u_int32_t, u_int32_t>,
+			DKFoundation::DKTreeCopyValue<u_int32_t>,
+			DKMemoryDefaultAllocator>;
+		const size_t n = samples.size();
+		const size_t snapshotInterval = 1000;
+
+		printf("Testing persistent TreeP... (%zu items, snapshot per %zu ops)\n", n, snapshotInterval);
+
+		double d[3];
+		size_t counts[3];
+		{
+			Tree2D tree;
+			timer.Reset();
+			for (u_int32_t v : samples)
+				tree.Insert(v);
+			for (size_t i = 0; i < n; i += 2)
+				tree.Remove(samples[i], t2Comp);
+			d[0] = timer.Elapsed();
+			counts[0] = tree.Count();
+		}
+		for (int w = 0; w < 2; ++w)
+		{
+			TreeP tree;
+			TreeP::Version version;
+			size_t ops = 0;
+			timer.Reset();
+			for (u_int32_t v : samples)
+			{
+				tree.Insert(v);
+				if (w && ++ops % snapshotInterval == 0)
+					version = tree.Snapshot();
+			}
+			for (size_t i = 0; i < n; i += 2)
+			{
+				tree.Remove(samples[i], t2Comp);
+				if (w && ++ops % snapshotInterval == 0)
+					version = tree.Snapshot();
+			}
+			d[w + 1] = timer.Elapsed();
+			counts[w + 1] = tree.Count();
+		}
+		printf("Tree2 insert/remove (%zu) elapsed: %f, TreeP elapsed: %f, TreeP with snapshots elapsed: %f\n",
+			   counts[0], d[0], d[1], d[2]);
+		if (counts[0] != counts[1] || counts[0] != counts[2])
+			printf("ERROR persistent tree count mismatch!\n");
+
+		TreeP tree;
+		for (u_int32_t v : samples)
+			tree.Insert(v);
+
+		const size_t numSnapshots = 1000000;
+		timer.Reset();
+		for (size_t i = 0; i < numSnapshots; ++i)
+		{
+			TreeP::Version v = tree.Snapshot();
+			(void)v;
+		}
+		double d2 = timer.Elapsed();
+		printf("TreeP snapshot (count: %zu) x%zu elapsed: %f\n", tree.Count(), numSnapshots, d2);
+
+		// readers search on snapshot, writer removes all items from tree.
+		TreeP::Version snapshot = tree.Snapshot();
+		size_t numReaders = std::max(maxThreads - 1, (size_t)1);
+		std::vector<size_t> found(numReaders, 0);
+		std::vector<std::thread> readers;
+		timer.Reset();
+		for (size_t r = 0; r < numReaders; ++r)
+		{
+			readers.emplace_back([&, r]()
+			{
+				TreeP::Version v = snapshot;
+				size_t f = 0;
+				for (u_int32_t k : samples)
+				{
+					if (v.Find(k, t2Comp))
+						f++;
+				}
+				found[r] = f;
+			});
+		}
+		for (u_int32_t v : samples)
+			tree.Remove(v, t2Comp);
+		double d3 = timer.Elapsed();
+		for (std::thread& t : readers)
+			t.join();
+		double d4 = timer.Elapsed();
+
+		bool consistent = tree.Count() == 0;
+		for (size_t f : found)
+		{
+			if (f != n)
+				consistent = false;
+		}
+		printf("TreeP %zu readers on snapshot (count: %zu), writer remove elapsed: %f, readers elapsed: %f%s\n",
+			   numReaders, snapshot.Count(), d3, d4, consistent ? "" : " ERROR!");
+	};
+
+	// sharded tree: mixed insert/find/remove from all threads, 1 shard is same as single locked tree.
+	auto sh_test2 = [&]()
+	{
+		Timer timer;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+		using RangePartitioner = DKFoundation2::DKTreeRangePartitioner<u_int32_t>;
+		using HashPartitioner = DKFoundation2::DKTreeHashPartitioner<u_int32_t>;
+		using ShardedTree = DKFoundation2::DKShardedAVLTree<u_int32_t, RangePartitioner>;
+		using HashShardedTree = DKFoundation2::DKShardedAVLTree<u_int32_t, HashPartitioner>;
+		const size_t n = samples.size();
+		const RangePartitioner partitioner(0, (u_int32_t)(numSamples / 2));
+
+		printf("Testing sharded-tree... (%zu ops, %zu threads, insert:find:remove = 2:1:1)\n", n, maxThreads);
+
+		double base = 0;
+		for (size_t shards = 1; shards <= 256; shards *= 4)
+		{
+			ShardedTree tree(shards, partitioner);
+			timer.Reset();
+			ShardedWorkload(tree, samples, maxThreads, t2Comp);
+			double d = timer.Elapsed();
+			if (shards == 1)
+				base = d;
+
+			// check order of cross-shard enumeration.
+			bool ordered = true;
+			u_int32_t prev = 0;
+			size_t count = 0;
+			tree.EnumerateForward([&](const u_int32_t& v, bool*)
+			{
+				if (count++ > 0 && v <= prev)
+					ordered = false;
+				prev = v;
+			});
+			printf("Sharded-tree range (shards: %zu, count: %zu) elapsed: %f, %.2f Mops/s (x%.2f)%s\n",
+				   shards, tree.Count(), d, n / d / 1000000.0, base / d, (ordered && count == tree.Count()) ? "" : " ERROR!");
+		}
+		for (size_t shards = 4; shards <= 256; shards *= 4)
+		{
+			HashShardedTree tree(shards);
+			timer.Reset();
+			ShardedWorkload(tree, samples, maxThreads, t2Comp);
+			double d = timer.Elapsed();
+			printf("Sharded-tree hash (shards: %zu, count: %zu) elapsed: %f, %.2f Mops/s (x%.2f)\n",
+				   shards, tree.Count(), d, n / d / 1000000.0, base / d);
+		}
+	};
+
+	// concurrent tree: read-heavy and write-heavy mixes from all threads,
+	// compared with Tree1 locked by single mutex.
+	auto cc_test1 = [&]()
+	{
+		Timer timer;
+		const size_t numOps = std::min(samples.size(), (size_t)0x3fffff);
+		const size_t numPrefill = numOps / 4;
+		const std::vector<u_int32_t> ops(samples.begin() + numPrefill, samples.begin() + numOps);
+		const size_t mixes[] = { 9, 0 };	// finds out of 10 ops
+
+		for (size_t numFinds : mixes)
+		{
+			printf("Testing concurrent-tree... (%zu ops, find:write = %zu:%zu, 1-%zu threads)\n",
+				   ops.size(), numFinds, 10 - numFinds, maxThreads);
+			double base = 0;
+			for (size_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+			{
+				LockedTree1 locked;
+				for (size_t i = 0; i < numPrefill; ++i)
+					locked.Insert(samples[i]);
+				timer.Reset();
+				ConcurrentWorkload(locked, ops, threads, numFinds);
+				double d1 = timer.Elapsed();
+
+				TreeC tc;
+				for (size_t i = 0; i < numPrefill; ++i)
+					tc.Insert(samples[i]);
+				timer.Reset();
+				ConcurrentWorkload(tc, ops, threads, numFinds);
+				double d2 = timer.Elapsed();
+				if (threads == 1)
+					base = d2;
+
+				printf("Concurrent-tree (threads: %zu) Tree1+mutex: %f, %.2f Mops/s, TreeC: %f, %.2f Mops/s (x%.2f, count: %zu/%zu)\n",
+					   threads, d1, ops.size() / d1 / 1000000.0, d2, ops.size() / d2 / 1000000.0,
+					   base / d2, tc.Count(), locked.Count());
+				if (threads == maxThreads)
+					break;
+			}
+			DKFoundation::DKEpochReclaimer::Reclaim(true);
+		}
+
+		// stress: writers insert, remove keys (k % 4 != 3) while readers check
+		// stable keys (k % 4 == 3) are always found, and enumeration is ordered.
+		TreeC tc;
+		for (size_t i = 0; i < numPrefill; ++i)
+			tc.Insert(samples[i] | 3);
+		std::atomic<bool> done(false);
+		std::atomic<size_t> errors(0);
+		const size_t numWriters = std::max(maxThreads, (size_t)2);
+		std::vector<std::thread> writers, readers;
+		for (size_t t = 0; t < numWriters; ++t)
+		{
+			writers.emplace_back([&, t]()
+			{
+				for (size_t i = t; i < ops.size(); i += numWriters)
+				{
+					u_int32_t k = ops[i] & ~(u_int32_t)3;
+					if (i % 2)
+						tc.Insert(k);
+					else
+						tc.Remove(k);
+				}
+			});
+		}
+		for (size_t t = 0; t < 2; ++t)
+		{
+			readers.emplace_back([&, t]()
+			{
+				while (!done.load(std::memory_order_relaxed))
+				{
+					for (size_t i = t; i < numPrefill && !done.load(std::memory_order_relaxed); i += 64)
+					{
+						if (!tc.Find(samples[i] | 3))
+							errors++;
+					}
+					u_int32_t prev = 0;
+					bool first = true;
+					tc.EnumerateForward([&](const u_int32_t& v, bool*)
+					{
+						if (!first && v <= prev)
+							errors++;
+						prev = v;
+						first = false;
+					});
+				}
+			});
+		}
+		timer.Reset();
+		for (std::thread& t : writers)
+			t.join();
+		done = true;
+		for (std::thread& t : readers)
+			t.join();
+		double d = timer.Elapsed();
+
+		size_t count = 0;
+		tc.EnumerateForward([&](const u_int32_t&, bool*) { count++; });
+		for (size_t i = 0; i < numPrefill; ++i)
+		{
+			if (!tc.Find(samples[i] | 3))
+				errors++;
+		}
+		if (count != tc.Count())
+			errors++;
+		printf("Concurrent-tree stress (%zu writers, 2 readers, count: %zu) elapsed: %f%s\n",
+			   numWriters, count, d, errors == 0 ? "" : " ERROR!");
+		tc.Clear();
+		DKFoundation::DKEpochReclaimer::Reclaim(true);
+	};
+
+	// allocator: multi-threaded alloc/free, compared with malloc.
+	auto al_test1 = [&]()
+	{
+		const size_t unitSize = Tree1::NodeSize();
+		const size_t numUnits = std::min(samples.size(), (size_t)0x3fffff);
+		using SpinPool = DKFoundation::DKFixedSizeAllocator<Tree1::NodeSize()>;
+		using MutexPool = DKFoundation::DKFixedSizeAllocator<Tree1::NodeSize(), 1, 1024, DKMutex>;
+		using CachedPool = DKFoundation::DKThreadCachedAllocator<SpinPool>;
+
+		printf("Testing allocator... (%zu units of %zu bytes, 1-%zu threads)\n", numUnits, unitSize, maxThreads);
+		for (int remote = 0; remote < 2; ++remote)
+		{
+			for (size_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+			{
+				MallocAllocator mallocAlloc;
+				SpinPool spinPool;
+				MutexPool mutexPool;
+				CachedPool cachedPool;
+				double d1 = AllocatorWorkload(mallocAlloc, unitSize, numUnits, threads, remote != 0);
+				double d2 = AllocatorWorkload(spinPool, unitSize, numUnits, threads, remote != 0);
+				double d3 = AllocatorWorkload(mutexPool, unitSize, numUnits, threads, remote != 0);
+				double d4 = AllocatorWorkload(cachedPool, unitSize, numUnits, threads, remote != 0);
+				cachedPool.Purge();
+				bool leaked = spinPool.NumberOfAllocatedUnits() || mutexPool.NumberOfAllocatedUnits() || cachedPool.NumberOfAllocatedUnits();
+				printf("Allocator %s (threads: %zu) malloc: %f, spin-lock: %f, mutex: %f, thread-cached: %f (x%.2f)%s\n",
+					   remote ? "remote-free" : "local-free", threads, d1, d2, d3, d4, d1 / d4, leaked ? " ERROR!" : "");
+				if (threads == maxThreads)
+					break;
+			}
+		}
+	};
+
+	// allocator: alloc latency from fragmented pool, (chunk table is not scanned)
+	// random units are freed from full pool, partial chunks are spread over table.
+	// compared with baseline pool which scans chunk table (first-fit).
+	auto al_test2 = [&]()
+	{
+		const size_t numUnits = std::min(samples.size(), (size_t)0x3fffff);
+		const size_t numOps = numUnits / 2;
+		printf("Testing fragmented allocator... (%zu units, %zu allocs with random free)\n", numUnits, numOps);
+		std::vector<void*> units;
+		Tree1Alloc pool;
+		std::vector<double> latency = FragmentedAllocLatency(pool, Tree1::NodeSize(), samples, numUnits, numOps, units);
+		DKFoundation::DKFixedSizeAllocatorStatistics st = pool.Statistics();
+		PrintAllocatorStatistics("Fragmented allocator", st);
+		for (void* p : units)
+			pool.Dealloc(p);
+
+		FirstFitPool baselinePool(st.unitSize, st.unitsPerChunk);
+		std::vector<double> baseline = FragmentedAllocLatency(baselinePool, Tree1::NodeSize(), samples, numUnits, numOps, units);
+		for (void* p : units)
+			baselinePool.Dealloc(p);
+
+		auto percentile = [](const std::vector<double>& v, double q) { return v[(size_t)(q * (v.size() - 1))] * 1000000000.0; };
+		printf("Fragmented allocator alloc latency(ns) p50: %.0f, p99: %.0f, p99.9: %.0f, max: %.0f\n",
+			   percentile(latency, 0.5), percentile(latency, 0.99), percentile(latency, 0.999), latency.back() * 1000000000.0);
+		printf("Baseline (first-fit) alloc latency(ns) p50: %.0f, p99: %.0f, p99.9: %.0f, max: %.0f\n",
+			   percentile(baseline, 0.5), percentile(baseline, 0.99), percentile(baseline, 0.999), baseline.back() * 1000000000.0);
+	};
+
+	// allocator: statistics of shared node pools.
+	auto al_test4 = [&]()
+	{
+		PrintAllocatorStatistics("Tree1 allocator", t1alloc.Statistics());
+		PrintAllocatorStatistics("Tree2 allocator", t2alloc.Statistics());
+		PrintAllocatorStatistics("Tree1 aligned-chunk allocator", t1aalloc.Statistics());
+	};
+
+	// allocator: large chunks with huge pages, compared with small aligned chunks.
+	auto al_test3 = [&]()
+	{
+		Timer timer;
+		timer.Reset();
+		t1halloc.Reserve(numSamples);
+		double d1 = timer.Elapsed();
+
+		printf("Testing large-chunk allocator... (%lu items, chunk: %zu / %zu bytes)\n",
+			   samples.size(), (size_t)Tree1AAlloc::AlignedChunkSize, (size_t)Tree1HAlloc::AlignedChunkSize);
+		printf("Large-chunk Reserve(%zu) elapsed: %f, pool size: %zu, chunks: %zu (small chunks: %zu)\n",
+			   numSamples, d1, t1halloc.Size(),
+			   t1halloc.Size() / Tree1HAlloc::AlignedChunkSize, t1aalloc.Size() / Tree1AAlloc::AlignedChunkSize);
+
+		Tree1A t1a;
+		Tree1H t1h;
+		timer.Reset();
+		for (u_int32_t v : samples)
+			t1a.Update(v);
+		double d2 = timer.Elapsed();
+		timer.Reset();
+		for (u_int32_t v : samples)
+			t1h.Update(v);
+		double d3 = timer.Elapsed();
+
+		size_t found1 = 0, found2 = 0;
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (t1a.Find(v))
+				found1++;
+		}
+		double d4 = timer.Elapsed();
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (t1h.Find(v))
+				found2++;
+		}
+		double d5 = timer.Elapsed();
+		printf("Tree1 small chunks insert: %f, search: %f / large chunks insert: %f (x%.2f), search: %f (x%.2f)%s\n",
+			   d2, d4, d3, d2 / d3, d5, d4 / d5, found1 == found2 ? "" : " ERROR!");
+	};
+
+	// Clear: visiting all nodes (shared pool) vs releasing private pool at once.
+	//  trees are built from sorted range, nodes are allocated in order.
+	auto cl_test1 = [&]()
+	{
+		Timer timer;
+		const size_t sizes[] = { 0x100000, numSamples, numSamples * 4 };
+
+		for (size_t n : sizes)
+		{
+			printf("Testing Clear... (%zu items)\n", n);
+			std::vector<u_int32_t> values(n);
+			for (size_t i = 0; i < n; ++i)
+				values[i] = (u_int32_t)i;
+
+			double d1, d2, d3, d4;
+			{
+				Tree1 tree(values.begin(), values.end());
+				timer.Reset();
+				tree.Clear();
+				d1 = timer.Elapsed();
+				t1alloc.Purge();
+				t1alloc.Reserve(numSamples);
+			}
+			{
+				Tree1F tree(values.begin(), values.end());
+				timer.Reset();
+				tree.Clear();
+				d2 = timer.Elapsed();
+			}
+			{
+				Tree2 tree(values.begin(), values.end());
+				timer.Reset();
+				tree.Clear();
+				d3 = timer.Elapsed();
+				t2alloc.Purge();
+				t2alloc.Reserve(numSamples);
+			}
+			{
+				Tree2F tree(values.begin(), values.end());
+				timer.Reset();
+				tree.Clear();
+				d4 = timer.Elapsed();
+			}
+			printf("Tree1 Clear: %f, private pool: %f (x%.2f)\n", d1, d2, d1 / d2);
+			printf("Tree2 Clear: %f, private pool: %f (x%.2f)\n", d3, d4, d3 / d4);
+		}
+	};
+
+	// operation counters of Tree1, Tree2 for insert, find, remove workloads.
+	auto pr_test1 = [&]()
+	{
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+		printf("Testing operation counters... (%lu items)\n", samples.size());
+
+		Tree1I t1i;
+		Tree2I t2i;
+		for (u_int32_t v : samples)
+		{
+			t1i.Insert(v);
+			t2i.Insert(v);
+		}
+		PrintOperationCounter("Tree1 insert", t1i.instrumentation);
+		PrintOperationCounter("Tree2 insert", t2i.instrumentation);
+		PrintTreeShape("Tree1", DKFoundation::DKTreeShapeProfile::Profile(t1i.rootNode));
+		PrintTreeShape("Tree2", DKFoundation::DKTreeShapeProfile::Profile(t2i.rootNode));
+
+		t1i.instrumentation.Reset();
+		t2i.instrumentation.Reset();
+		for (u_int32_t v : samples)
+		{
+			t1i.Find(v);
+			t2i.Find(v, t2Comp);
+		}
+		PrintOperationCounter("Tree1 find", t1i.instrumentation);
+		PrintOperationCounter("Tree2 find", t2i.instrumentation);
+
+		t1i.instrumentation.Reset();
+		t2i.instrumentation.Reset();
+		for (u_int32_t v : samples)
+		{
+			t1i.Remove(v);
+			t2i.Remove(v, t2Comp);
+		}
+		PrintOperationCounter("Tree1 remove", t1i.instrumentation);
+		PrintOperationCounter("Tree2 remove", t2i.instrumentation);
+	};
 
-template <typename T, size_t Num> size_t NumArrayItems(T(&)[Num])
-{
-	return Num;
-}
+	auto bp_test1 = [&]()
+	{
+		Timer timer;
 
-template <typename Node>
-void EnumerateTreeNode(Node* node, std::vector<Node*>& vec)
-{
-	if (node->left)
-		EnumerateTreeNode(node->left, vec);
-	vec.push_back(node);
-	if (node->right)
-		EnumerateTreeNode(node->right, vec);
-}
+		printf("Testing parallel-build Tree1... (%lu items, 1-%zu threads)\n", samples.size(), maxThreads);
 
-int main(int argc, const char * argv[])
-{
-	printf("Debug Mode: %d\n", debugMode);
+		double base = 0;
+		for (size_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+		{
+			Tree1 tree;
+			timer.Reset();
+			tree.BuildParallel(samples.begin(), samples.end(), threads);
+			double d = timer.Elapsed();
+			if (threads == 1)
+				base = d;
+			printf("Tree1 parallel-build (count: %zu, threads: %zu) elapsed: %f (x%.2f)\n", tree.Count(), threads, d, base / d);
+			if (threads == maxThreads)
+				break;
+		}
+	};
 
-	size_t numSamples = 0xffffff;
-	std::vector<u_int32_t> samples;
-	samples.reserve(numSamples);
-	for (size_t i = 0; i < numSamples; ++i)
+	auto bp_test2 = [&]()
 	{
-		u_int32_t v = arc4random();
-		v = v % (numSamples/2);
-		samples.push_back(v);
-	}
-
-	printf("Reserving memory...\n");
-	t1alloc.Reserve(numSamples);
-	t2alloc.Reserve(numSamples);
-	printf("Done!\n");
+		Timer timer;
 
-	Tree1 t1;
-	Tree2 t2;
+		printf("Testing parallel-build Tree2... (%lu items, 1-%zu threads)\n", samples.size(), maxThreads);
 
-	const int numLoops = 1;
+		double base = 0;
+		for (size_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+		{
+			Tree2 tree;
+			timer.Reset();
+			tree.BuildParallel(samples.begin(), samples.end(), threads);
+			double d = timer.Elapsed();
+			if (threads == 1)
+				base = d;
+			printf("Tree2 parallel-build (count: %zu, threads: %zu) elapsed: %f (x%.2f)\n", tree.Count(), threads, d, base / d);
+			if (threads == maxThreads)
+				break;
+		}
+	};
 
-	auto ir_test1 = [&]()
+	auto so_test2 = [&]()
 	{
 		Timer timer;
-		size_t numInsert = 0;
-		size_t numRemove = 0;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
 
-		t1.Update(1);	// warm up.
-		t1.Clear();
+		// two sets with each half of samples.
+		Tree2 a, b;
+		a.BuildParallel(samples.begin(), samples.begin() + samples.size() / 2, 0);
+		b.BuildParallel(samples.begin() + samples.size() / 2, samples.end(), 0);
 
-		printf("Testing insert/remove Tree1... (%lu items x %d)\n", samples.size(), numLoops);
+		printf("Testing set-operations Tree2... (%zu, %zu items)\n", a.Count(), b.Count());
+		{
+			Tree2 x(a), y(b);
+			timer.Reset();
+			y.EnumerateForward([&](const u_int32_t& v, bool*) { x.Insert(v); });
+			double d1 = timer.Elapsed();
 
-		timer.Reset();
-		for (int i = 0; i < numLoops; ++i)
+			Tree2 p(a), q(b);
+			timer.Reset();
+			p.Union(q);
+			double d2 = timer.Elapsed();
+			printf("Tree2 union (count: %zu, %zu) insert elapsed: %f, union elapsed: %f\n", x.Count(), p.Count(), d1, d2);
+		}
 		{
-			for (u_int32_t v : samples)
-			{
-				if (t1.Insert(v))
-					numInsert++;
-				else
-				{
-					t1.Remove(v);
-					numRemove++;
-				}
-			}
+			Tree2 x;
+			timer.Reset();
+			a.EnumerateForward([&](const u_int32_t& v, bool*) { if (b.Find(v, t2Comp)) x.Insert(v); });
+			double d1 = timer.Elapsed();
+
+			Tree2 p(a), q(b);
+			timer.Reset();
+			p.Intersect(q);
+			double d2 = timer.Elapsed();
+			printf("Tree2 intersect (count: %zu, %zu) find elapsed: %f, intersect elapsed: %f\n", x.Count(), p.Count(), d1, d2);
+		}
+		{
+			Tree2 x(a);
+			timer.Reset();
+			b.EnumerateForward([&](const u_int32_t& v, bool*) { x.Remove(v, t2Comp); });
+			double d1 = timer.Elapsed();
+
+			Tree2 p(a), q(b);
+			timer.Reset();
+			p.Difference(q);
+			double d2 = timer.Elapsed();
+			printf("Tree2 difference (count: %zu, %zu) remove elapsed: %f, difference elapsed: %f\n", x.Count(), p.Count(), d1, d2);
 		}
-		double d = timer.Elapsed();
-		printf("Tree1 insert: %zu / remove: %zu elapsed: %f\n", numInsert, numRemove, d);
 	};
 
-	auto ir_test2 = [&]()
+	auto os_test2 = [&]()
 	{
 		Timer timer;
 		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
 		size_t numInsert = 0;
 		size_t numRemove = 0;
 
-		t2.Update(1);	// warm up.
-		t2.Clear();
+		printf("Testing order-statistics Tree2 (NodeSize: %zu, %zu)... (%lu items)\n", Tree2::NodeSize(), Tree2S::NodeSize(), samples.size());
 
-		printf("Testing insert/remove Tree2... (%lu items x %d)\n", samples.size(), numLoops);
+		Tree2S tree;
 		timer.Reset();
-		for (int i = 0; i < numLoops; ++i)
+		for (u_int32_t v : samples)
 		{
-			for (u_int32_t v : samples)
+			if (tree.Insert(v))
+				numInsert++;
+			else
 			{
-				if (t2.Insert(v))
-					numInsert++;
-				else
-				{
-					t2.Remove(v, t2Comp);
-					numRemove++;
-				}
+				tree.Remove(v, t2Comp);
+				numRemove++;
 			}
 		}
 		double d = timer.Elapsed();
-		printf("Tree2 insert: %zu / remove: %zu elapsed: %f\n", numInsert, numRemove, d);
+		printf("Tree2S insert: %zu / remove: %zu elapsed: %f\n", numInsert, numRemove, d);
+
+		size_t sum = 0;
+		timer.Reset();
+		for (u_int32_t v : samples)
+			sum += tree.Rank(v, t2Comp);
+		double d1 = timer.Elapsed();
+		timer.Reset();
+		for (u_int32_t v : samples)
+			sum += *tree.Select(v % tree.Count());
+		double d2 = timer.Elapsed();
+		timer.Reset();
+		for (u_int32_t v : samples)
+			sum += tree.CountRange(v, v + 1000, t2Comp);
+		double d3 = timer.Elapsed();
+		printf("Tree2S rank elapsed: %f, select elapsed: %f, count-range elapsed: %f (%zu)\n", d1, d2, d3, sum);
+
+		// rank with enumeration, O(n) per query.
+		const size_t numWalks = 16;
+		size_t mismatch = 0;
+		timer.Reset();
+		for (size_t i = 0; i < numWalks; ++i)
+		{
+			u_int32_t key = samples[i];
+			size_t rank = 0;
+			tree.EnumerateForward([&](const u_int32_t& v, bool* stop)
+			{
+				if (v < key)
+					rank++;
+				else
+					*stop = true;
+			});
+			if (rank != tree.Rank(key, t2Comp))
+				mismatch++;
+		}
+		double d4 = timer.Elapsed();
+		printf("Tree2S enumeration rank x %zu elapsed: %f (%f per query, mismatch: %zu)\n", numWalks, d4, d4 / numWalks, mismatch);
 	};
 
 	auto sr_test1 = [&]()
@@ -228,8 +2032,397 @@ int main(int argc, const char * argv[])
 		printf("Tree2 search (found: %zu, missed: %zu) elapsed: %f\n", found, missed, d);
 	};
 
+	// search with read-only snapshot of each layouts.
+	auto fr_test = [&]()
+	{
+		Timer timer;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+		const u_int32_t width = 1000;
+		const size_t numScans = std::min<size_t>(samples.size(), 0x10000);
+
+		struct { DKFoundation::DKFrozenTreeLayout layout; const char* name; } layouts[] = {
+			{ DKFoundation::DKFrozenTreeLayout::Sorted, "Sorted" },
+			{ DKFoundation::DKFrozenTreeLayout::Eytzinger, "Eytzinger" },
+			{ DKFoundation::DKFrozenTreeLayout::VanEmdeBoas, "VanEmdeBoas" },
+		};
+		printf("Testing Search Frozen Tree1(Count: %lu)... (%lu items x %d)\n", t1.Count(), samples.size(), numLoops);
+
+		for (auto& l : layouts)
+		{
+			timer.Reset();
+			auto frozen = t1.Freeze(l.layout);
+			double d1 = timer.Elapsed();
+
+			size_t found = 0;
+			size_t missed = 0;
+			timer.Reset();
+			for (int i = 0; i < numLoops; ++i)
+			{
+				for (u_int32_t v : samples)
+				{
+					auto p = frozen.Find(v, t2Comp);
+					if (p)
+						found++;
+					else
+						missed++;
+				}
+			}
+			double d2 = timer.Elapsed();
+
+			size_t found2 = 0;
+			timer.Reset();
+			for (size_t i = 0; i < numScans; ++i)
+			{
+				u_int32_t v = samples[i];
+				frozen.EnumerateRange(v, v + width, t2Comp, [&](const u_int32_t&, bool*) { found2++; });
+			}
+			double d3 = timer.Elapsed();
+			printf("Frozen %s (bytes: %zu) freeze elapsed: %f, search (found: %zu, missed: %zu) elapsed: %f, range-scan (found: %zu) elapsed: %f\n",
+				   l.name, frozen.Size(), d1, found, missed, d2, found2, d3);
+		}
+	};
+
+	// batched search with interleaved prefetching, tree size from cache-resident to memory-resident.
+	auto fm_test = [&]()
+	{
+		Timer timer;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+		const size_t numQueries = 0x100000;
+		const size_t maxTreeSize = std::min<size_t>(samples.size(), 0x400000);
+
+		std::vector<const u_int32_t*> results(numQueries);
+		std::vector<u_int32_t> queries(numQueries);
+
+		printf("Testing batched search... (%zu queries)\n", numQueries);
+
+		for (size_t n = 0x1000; n <= maxTreeSize; n *= 4)
+		{
+			std::vector<u_int32_t> items(samples.begin(), samples.begin() + n);
+			std::sort(items.begin(), items.end());
+			// half of queries are not in tree.
+			for (u_int32_t& q : queries)
+				q = samples[randomUniform(std::min(n * 2, samples.size()))];
+
+			// lookups per microsecond
+			auto rate = [numQueries](double d) { return d > 0 ? double(numQueries) / d / 1000000.0 : 0.0; };
+
+			{
+				Tree1 tree;
+				tree.Assign(items.begin(), items.end());
+				size_t found = 0;
+				timer.Reset();
+				for (size_t i = 0; i < numQueries; ++i)
+					results[i] = tree.Find(queries[i]);
+				double d0 = timer.Elapsed();
+				for (auto p : results)
+					found += p != NULL;
+				timer.Reset();
+				tree.FindMany<4>(queries.data(), numQueries, results.data());
+				double d1 = timer.Elapsed();
+				timer.Reset();
+				tree.FindMany<8>(queries.data(), numQueries, results.data());
+				double d2 = timer.Elapsed();
+				timer.Reset();
+				tree.FindMany<16>(queries.data(), numQueries, results.data());
+				double d3 = timer.Elapsed();
+				for (auto p : results)
+					found -= p != NULL;
+				printf("Tree1(Count: %zu) scalar: %.2f, group4: %.2f, group8: %.2f, group16: %.2f M/s%s\n",
+					   tree.Count(), rate(d0), rate(d1), rate(d2), rate(d3), found ? " ERROR!" : "");
+			}
+			{
+				Tree2 tree;
+				tree.Assign(items.begin(), items.end());
+				size_t found = 0;
+				timer.Reset();
+				for (size_t i = 0; i < numQueries; ++i)
+					results[i] = tree.Find(queries[i], t2Comp);
+				double d0 = timer.Elapsed();
+				for (auto p : results)
+					found += p != NULL;
+				timer.Reset();
+				tree.FindMany<4>(queries.data(), numQueries, results.data(), t2Comp);
+				double d1 = timer.Elapsed();
+				timer.Reset();
+				tree.FindMany<8>(queries.data(), numQueries, results.data(), t2Comp);
+				double d2 = timer.Elapsed();
+				timer.Reset();
+				tree.FindMany<16>(queries.data(), numQueries, results.data(), t2Comp);
+				double d3 = timer.Elapsed();
+				for (auto p : results)
+					found -= p != NULL;
+				printf("Tree2(Count: %zu) scalar: %.2f, group4: %.2f, group8: %.2f, group16: %.2f M/s%s\n",
+					   tree.Count(), rate(d0), rate(d1), rate(d2), rate(d3), found ? " ERROR!" : "");
+			}
+		}
+	};
+
+	auto rs_test1 = [&]()
+	{
+		Timer timer;
+		const u_int32_t width = 1000;
+		const size_t numScans = std::min<size_t>(samples.size(), 0x10000);
+		const size_t numWalks = 16;
+
+		printf("Testing range-scan Tree1(Count: %lu)... (%zu scans, width: %u)\n", t1.Count(), numScans, width);
+
+		size_t found = 0;
+		timer.Reset();
+		for (size_t i = 0; i < numScans; ++i)
+		{
+			u_int32_t v = samples[i];
+			t1.EnumerateRange(v, v + width, [&](const u_int32_t&, bool*) { found++; });
+		}
+		double d1 = timer.Elapsed();
+
+		// whole-tree enumeration, stop after range.
+		size_t found2 = 0;
+		timer.Reset();
+		for (size_t i = 0; i < numWalks; ++i)
+		{
+			u_int32_t v = samples[i];
+			t1.EnumerateForward([&](const u_int32_t& x, bool* stop)
+			{
+				if (x >= v + width)
+					*stop = true;
+				else if (x >= v)
+					found2++;
+			});
+		}
+		double d2 = timer.Elapsed();
+		printf("Tree1 range-scan (found: %zu) elapsed: %f, enumeration x %zu (found: %zu) elapsed: %f (%f per scan)\n",
+			   found, d1, numWalks, found2, d2, d2 / numWalks);
+	};
+
+	auto rs_test2 = [&]()
+	{
+		Timer timer;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+		const u_int32_t width = 1000;
+		const size_t numScans = std::min<size_t>(samples.size(), 0x10000);
+		const size_t numWalks = 16;
+
+		printf("Testing range-scan Tree2(Count: %lu)... (%zu scans, width: %u)\n", t2.Count(), numScans, width);
+
+		size_t found = 0;
+		timer.Reset();
+		for (size_t i = 0; i < numScans; ++i)
+		{
+			u_int32_t v = samples[i];
+			t2.EnumerateRange(v, v + width, t2Comp, [&](const u_int32_t&, bool*) { found++; });
+		}
+		double d1 = timer.Elapsed();
+
+		// whole-tree enumeration, stop after range.
+		size_t found2 = 0;
+		timer.Reset();
+		for (size_t i = 0; i < numWalks; ++i)
+		{
+			u_int32_t v = samples[i];
+			t2.EnumerateForward([&](const u_int32_t& x, bool* stop)
+			{
+				if (x >= v + width)
+					*stop = true;
+				else if (x >= v)
+					found2++;
+			});
+		}
+		double d2 = timer.Elapsed();
+		printf("Tree2 range-scan (found: %zu) elapsed: %f, enumeration x %zu (found: %zu) elapsed: %f (%f per scan)\n",
+			   found, d1, numWalks, found2, d2, d2 / numWalks);
+	};
+
+	auto it_test1 = [&]()
+	{
+		Timer timer;
+		const int numIterations = 10;
+
+		printf("Testing iteration Tree1(Count: %lu)... (x %d)\n", t1.Count(), numIterations);
+
+		size_t sum1 = 0;
+		timer.Reset();
+		for (int i = 0; i < numIterations; ++i)
+			t1.EnumerateForward([&](const u_int32_t& v, bool*) { sum1 += v; });
+		double d1 = timer.Elapsed();
+
+		size_t sum2 = 0;
+		timer.Reset();
+		for (int i = 0; i < numIterations; ++i)
+		{
+			for (u_int32_t v : t1)
+				sum2 += v;
+		}
+		double d2 = timer.Elapsed();
+
+		size_t sum3 = 0;
+		timer.Reset();
+		for (int i = 0; i < numIterations; ++i)
+		{
+			for (auto it = t1.rbegin(), end = t1.rend(); it != end; ++it)
+				sum3 += *it;
+		}
+		double d3 = timer.Elapsed();
+		printf("Tree1 iteration (%zu, %zu, %zu) enumerator elapsed: %f, iterator elapsed: %f, reverse-iterator elapsed: %f\n",
+			   sum1, sum2, sum3, d1, d2, d3);
+	};
+
+	auto it_test2 = [&]()
+	{
+		Timer timer;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+		const int numIterations = 10;
+
+		printf("Testing iteration Tree2(Count: %lu)... (x %d)\n", t2.Count(), numIterations);
+
+		size_t sum1 = 0;
+		timer.Reset();
+		for (int i = 0; i < numIterations; ++i)
+			t2.EnumerateForward([&](const u_int32_t& v, bool*) { sum1 += v; });
+		double d1 = timer.Elapsed();
+
+		size_t sum2 = 0;
+		Tree2::Cursor cursor(t2);
+		timer.Reset();
+		for (int i = 0; i < numIterations; ++i)
+		{
+			for (bool b = cursor.First(); b; b = cursor.Next())
+				sum2 += *cursor.Current();
+		}
+		double d2 = timer.Elapsed();
+
+		size_t sum3 = 0;
+		timer.Reset();
+		for (int i = 0; i < numIterations; ++i)
+		{
+			for (bool b = cursor.Last(); b; b = cursor.Prev())
+				sum3 += *cursor.Current();
+		}
+		double d3 = timer.Elapsed();
+
+		// paginated scan, seek and read 100 items for each page.
+		size_t sum4 = 0;
+		size_t numPages = 0;
+		timer.Reset();
+		for (bool b = cursor.First(); b; numPages++)
+		{
+			for (int n = 0; b && n < 100; ++n, b = cursor.Next())
+				sum4 += *cursor.Current();
+			if (b)
+				b = cursor.Seek(*cursor.Current(), t2Comp);
+		}
+		double d4 = timer.Elapsed();
+		printf("Tree2 iteration (%zu, %zu, %zu) enumerator elapsed: %f, cursor elapsed: %f, reverse-cursor elapsed: %f\n",
+			   sum1, sum2, sum3, d1, d2, d3);
+		printf("Tree2 paginated cursor (%zu, pages: %zu) elapsed: %f\n", sum4, numPages, d4);
+	};
+
+	// insert/remove and search with both node layouts.
+	auto nl_test = [&]()
+	{
+		Timer timer;
+		auto t2Comp = DKFoundation2::DKTreeItemComparator<u_int32_t, uint32_t>();
+
+		Tree2 tree2;
+		Tree3 tree3;
+
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (!tree2.Insert(v))
+				tree2.Remove(v, t2Comp);
+		}
+		double d1 = timer.Elapsed();
+		size_t found2 = 0;
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (tree2.Find(v, t2Comp))
+				found2++;
+		}
+		double d2 = timer.Elapsed();
+		printf("Tree2 layout (NodeSize: %zu, bytes per node: %.2f) insert/remove elapsed: %f, search (found: %zu) elapsed: %f\n",
+			   Tree2::NodeSize(), double(t2alloc.Size()) / t2alloc.NumberOfAllocatedUnits(), d1, found2, d2);
+
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (!tree3.Insert(v))
+				tree3.Remove(v, t2Comp);
+		}
+		double d3 = timer.Elapsed();
+		size_t found3 = 0;
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (tree3.Find(v, t2Comp))
+				found3++;
+		}
+		double d4 = timer.Elapsed();
+		printf("Tree3 layout (NodeSize: %zu, bytes per node: %.2f) insert/remove elapsed: %f, search (found: %zu) elapsed: %f\n",
+			   Tree3::NodeSize(), double(t3alloc.Size()) / t3alloc.NumberOfAllocatedUnits(), d3, found3, d4);
+
+		Tree1 tree1;
+		Tree4 tree4;
+
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (!tree1.Insert(v))
+				tree1.Remove(v);
+		}
+		double d5 = timer.Elapsed();
+		size_t found1 = 0;
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (tree1.Find(v))
+				found1++;
+		}
+		double d6 = timer.Elapsed();
+		printf("Tree1 layout (NodeSize: %zu, bytes per node: %.2f) insert/remove elapsed: %f, search (found: %zu) elapsed: %f\n",
+			   Tree1::NodeSize(), double(t1alloc.Size()) / t1alloc.NumberOfAllocatedUnits(), d5, found1, d6);
+
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (!tree4.Insert(v))
+				tree4.Remove(v);
+		}
+		double d7 = timer.Elapsed();
+		size_t found4 = 0;
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (tree4.Find(v))
+				found4++;
+		}
+		double d8 = timer.Elapsed();
+		printf("Tree4 layout (NodeSize: %zu, bytes per node: %.2f) insert/remove elapsed: %f, search (found: %zu) elapsed: %f\n",
+			   Tree4::NodeSize(), double(tree4.PoolSize()) / tree4.Count(), d7, found4, d8);
+
+		Tree5 tree5;
+
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (!tree5.Insert(v))
+				tree5.Remove(v, t2Comp);
+		}
+		double d9 = timer.Elapsed();
+		size_t found5 = 0;
+		timer.Reset();
+		for (u_int32_t v : samples)
+		{
+			if (tree5.Find(v, t2Comp))
+				found5++;
+		}
+		double d10 = timer.Elapsed();
+		printf("Tree5 layout (NodeSize: %zu, bytes per item: %.2f, items per node: %.2f) insert/remove elapsed: %f, search (found: %zu) elapsed: %f\n",
+			   Tree5::NodeSize(), double(t5alloc.Size()) / tree5.Count(), double(tree5.Count()) / tree5.NumberOfNodes(), d9, found5, d10);
+	};
+
 	printf("\nInsert/Remove test...\n");
-	if (arc4random() % 2)
+	if (randomUniform(2))
 	{
 		ir_test1();
 		ir_test2();
@@ -240,8 +2433,49 @@ int main(int argc, const char * argv[])
 		ir_test1();
 	}
 
+	printf("\nBulk-build test...\n");
+	bb_test1();
+	bb_test2();
+
+	printf("\nHinted-insert test...\n");
+	hi_test1();
+
+	printf("\nBatch-update test...\n");
+	ab_test2();
+
+	printf("\nPersistent-tree test...\n");
+	ps_test2();
+
+	printf("\nSharded-tree test...\n");
+	sh_test2();
+
+	printf("\nConcurrent-tree test...\n");
+	cc_test1();
+
+	printf("\nAllocator test...\n");
+	al_test1();
+	al_test2();
+	al_test3();
+	al_test4();
+
+	printf("\nClear test...\n");
+	cl_test1();
+
+	printf("\nProfiling test...\n");
+	pr_test1();
+
+	printf("\nParallel-build test...\n");
+	bp_test1();
+	bp_test2();
+
+	printf("\nSet-operation test...\n");
+	so_test2();
+
+	printf("\nOrder-statistics test...\n");
+	os_test2();
+
 	printf("\nSearch test...\n");
-	if (arc4random() % 2)
+	if (randomUniform(2))
 	{
 		sr_test1();
 		sr_test2();
@@ -251,6 +2485,18 @@ int main(int argc, const char * argv[])
 		sr_test2();
 		sr_test1();
 	}
+	fr_test();
+
+	printf("\nBatched-search test...\n");
+	fm_test();
+
+	printf("\nRange-scan test...\n");
+	rs_test1();
+	rs_test2();
+
+	printf("\nIteration test...\n");
+	it_test1();
+	it_test2();
 
 
 	if (t1.Count() == t2.Count() && t1.rootNode && t2.rootNode)
@@ -295,6 +2541,13 @@ int main(int argc, const char * argv[])
 		printf("ERROR Tree is different!!! (t1.count:%lu, t2.count:%lu)\n", t1.Count(), t2.Count());
 	}
 
+	printf("\nNode layout test...\n");
+	t1.Clear();
+	t2.Clear();
+	t1alloc.Purge();
+	t2alloc.Purge();
+	nl_test();
+
 
 
     return 0;